@@ -110,7 +110,8 @@ barcodeScannerDestroy(BarcodeScanner *pBarcodeScanner)
  *             consumed in this routine, this queue pend has no timeout.
  *             Duplicate keypresses, SHIFTs, wrapped Control characters, and
  *             ENTERs are ignored. This routine will return when the decoding
- *             of a complete barcode finishes.
+ *             of a complete barcode finishes. The input start hook, if set,
+ *             is called as soon as the first byte of the barcode arrives.
  *
  * @param[in]  pBarcodeScanner  Pointer to barcode scanner
  * @param[out] pBarcode         Pointer to barcode to be filled in
@@ -121,6 +122,7 @@ barcodeScannerDecode(BarcodeScanner *pBarcodeScanner, Barcode *pBarcode)
     char                pKeyPressString[MAX_KEY_PRESS_LENGTH];
     EncodedKeyPress    *pEncodedKeyPress    = NULL;
     DecodeStatus        status              = DecodeStatusNotComplete;
+    bool                bStarted            = false;
     if (pBarcodeScanner && pBarcode)
     {
     	// Enable scanner
@@ -137,6 +139,13 @@ barcodeScannerDecode(BarcodeScanner *pBarcodeScanner, Barcode *pBarcode)
 
             if (pEncodedKeyPress != NULL)
             {
+                // Let the owner get ahead of the scan (eg. open a connection)
+                if (!bStarted && pBarcodeScanner->pInputStartHook)
+                {
+                    pBarcodeScanner->pInputStartHook();
+                }
+                bStarted = true;
+
                 // Decode the key press
             	pKeyPressString[0] = '\0';
                 translate_make_code(pEncodedKeyPress->decodeMode,
@@ -217,6 +226,25 @@ barcodeScannerDisable(BarcodeScanner *pBarcodeScanner)
 	}
 } // barcodeScannerDisable
 
+/*****************************************************************************/
+
+/**
+ * @brief      Set a routine to be called, from the decoding task, when the
+ *             first byte of a barcode arrives.
+ *
+ * @param[in]  pBarcodeScanner  Pointer to barcode scanner
+ * @param[in]  pHook            Routine to call, NULL to clear
+ */
+void
+barcodeScannerSetInputStartHook(BarcodeScanner *pBarcodeScanner,
+                                void          (*pHook)(void))
+{
+    if (pBarcodeScanner)
+    {
+        pBarcodeScanner->pInputStartHook = pHook;
+    }
+} // barcodeScannerSetInputStartHook
+
 /*****************************************************************************/
 /* Static Functions                                                          */
 /*****************************************************************************/
@@ -239,6 +267,7 @@ acquireBarcodeScanner()
         pBarcodeScanner->pBarcodeKeyPressQueue  = NULL;
         pBarcodeScanner->enabled                = true;
         pBarcodeScanner->keyPosition            = KeyPositionUp;
+        pBarcodeScanner->pInputStartHook        = NULL;
     }
 
     return pBarcodeScanner;
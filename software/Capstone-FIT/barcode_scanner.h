@@ -75,6 +75,7 @@ typedef struct _BarcodeScanner
     void           *pBarcodeKeyPressQueueData[BARCODE_MESSAGE_QUEUE_SIZE];
     KeyPosition     keyPosition;
     bool            enabled;
+    void          (*pInputStartHook)(void);
 } BarcodeScanner;
 
 /*****************************************************************************/
@@ -89,6 +90,8 @@ void            barcodeScannerDecode(BarcodeScanner *pBarcodeScanner,
                                      Barcode        *pBarcode);
 void            barcodeScannerEnable(BarcodeScanner *pBarcodeScanner);
 void            barcodeScannerDisable(BarcodeScanner *pBarcodeScanner);
+void            barcodeScannerSetInputStartHook(BarcodeScanner *pBarcodeScanner,
+                                                void          (*pHook)(void));
 
 /*****************************************************************************/
 /* End of File                                                               */
@@ -0,0 +1,72 @@
+/** @file   boot_timeline.c
+ *  @brief  Routines for logging how long start up takes
+ *
+ *  The input devices are brought up while the PHY negotiates and DHCP runs,
+ *  so the unit takes scans well before the network is there. Marks from
+ *  both sides land in one log, e.g.
+ *
+ *      [boot]    412 ms   (+412)  Tasks started
+ *      [boot]    437 ms    (+25)  FIT Ready
+ *      [boot]   2930 ms  (+2493)  Network ready
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include "sys/alt_alarm.h"
+#include "boot_timeline.h"
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static INT32U bootLastMs = 0;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Log a start up milestone. May be called from any task.
+ *
+ * @param[in]  pEvent  What was reached
+ */
+void
+bootTimelineMark(const char *pEvent)
+{
+    INT32U  now     = bootTimelineMs();
+    INT32U  last    = 0;
+    char    pDelta[16];
+#if OS_CRITICAL_METHOD == 3
+    OS_CPU_SR cpu_sr = 0;
+#endif
+
+    OS_ENTER_CRITICAL();
+    last       = bootLastMs;
+    bootLastMs = now;
+    OS_EXIT_CRITICAL();
+
+    snprintf(pDelta, sizeof(pDelta), "(+%lu)", (unsigned long) (now - last));
+    printf("[boot] %6lu ms %8s  %s\n", (unsigned long) now, pDelta, pEvent);
+} // bootTimelineMark
+
+/*****************************************************************************/
+
+/**
+ * @brief      Time since the system clock started
+ *
+ * @return     Milliseconds since power-on
+ */
+INT32U
+bootTimelineMs()
+{
+    return (INT32U) ((alt_u64) alt_nticks() * 1000 / alt_ticks_per_second());
+} // bootTimelineMs
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,32 @@
+/** @file   boot_timeline.h
+ *  @brief  Declarations for the boot timeline log.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. Each milestone of start up is printed with the time since the
+ *  system clock started, which is as close to power-on as software can see,
+ *  and the time since the milestone before it.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __BOOT_TIMELINE_H
+#define __BOOT_TIMELINE_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include "includes.h"
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+void    bootTimelineMark(const char *pEvent);
+INT32U  bootTimelineMs();
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __BOOT_TIMELINE_H
@@ -23,7 +23,8 @@
 
 static Buttons* acquireButtons();
 static void     releaseButtons(Buttons *pButtons);
-static INT8U    initQueue(Buttons *pButtons);
+static INT8U    initSemaphore(Buttons *pButtons);
+static void     popEvent(Buttons *pButtons, ButtonEvent *pEvent);
 static void     buttonISR(void *pContext, alt_u32 id);
 
 /*****************************************************************************/
@@ -51,7 +52,7 @@ buttonsCreate()
 
     if (status == OS_NO_ERR)
     {
-        status = initQueue(pButtons);
+        status = initSemaphore(pButtons);
     }
 
     if (status != OS_NO_ERR)
@@ -110,6 +111,8 @@ buttonsInitButton(Buttons      *pButtons,
             pIsrContext->irq            = irq;
             pIsrContext->baseAddress    = baseAddress;
             pIsrContext->buttonID       = buttonID;
+            pIsrContext->lastEdgeTick   = 0;
+            pIsrContext->bEdgeSeen      = false;
 
             // Disable and and free buttons that are being re-initialized
             if (pButtons->isrContexts[buttonID])
@@ -241,23 +244,95 @@ buttonsDisableAll(Buttons *pButtons)
 Button
 buttonsGetButtonPress(Buttons *pButtons)
 {
-    INT8U   queueError  = OS_NO_ERR;
-    Button  buttonID    = ButtonMax;
+    ButtonEvent event;
+    Button      buttonID = ButtonMax;
 
-    if (pButtons && pButtons->pButtonPressQueue)
+    if (buttonsGetEvent(pButtons, &event, 0) == OS_NO_ERR)
     {
-        buttonID = (Button) OSQPend(pButtons->pButtonPressQueue,
-                                    0,
-                                    &queueError);
-        if (queueError != OS_NO_ERR)
-        {
-            buttonID = ButtonMax;
-        }
+        buttonID = (Button) event.buttonID;
     }
 
     return buttonID;
 } // buttonsGetButtonPress
 
+/*****************************************************************************/
+
+/**
+ * @brief      Wait for the next debounced button event. The event is copied
+ *             out of the ring so nothing needs to be freed by the caller.
+ *
+ * @param[in]  pButtons      Valid handle for Buttons object
+ * @param[out] pEvent        Event to be filled in
+ * @param[in]  timeoutTicks  Ticks to wait for an event, 0 waits forever
+ *
+ * @return     OS_NO_ERR if an event was read, OS_TIMEOUT if none arrived in
+ *             time, OS_ERR_PDATA_NULL if parameters are invalid
+ */
+INT8U
+buttonsGetEvent(Buttons *pButtons, ButtonEvent *pEvent, INT16U timeoutTicks)
+{
+    INT8U status = OS_NO_ERR;
+
+    if (pButtons && pButtons->pButtonEventSemaphore && pEvent)
+    {
+        OSSemPend(pButtons->pButtonEventSemaphore, timeoutTicks, &status);
+        if (status == OS_NO_ERR)
+        {
+            popEvent(pButtons, pEvent);
+        }
+    }
+    else
+    {
+        status = OS_ERR_PDATA_NULL;
+    }
+
+    return status;
+} // buttonsGetEvent
+
+/*****************************************************************************/
+
+/**
+ * @brief      Copy out every pending event without blocking.
+ *
+ * @param[in]  pButtons   Valid handle for Buttons object
+ * @param[out] pEvents    Array to receive events, may be NULL to discard them
+ * @param[in]  maxEvents  Capacity of pEvents
+ *
+ * @return     Number of events drained
+ */
+int
+buttonsDrainEvents(Buttons *pButtons, ButtonEvent *pEvents, int maxEvents)
+{
+    ButtonEvent discard;
+    int         count = 0;
+
+    if (pButtons && pButtons->pButtonEventSemaphore)
+    {
+        while ((count < maxEvents) &&
+               (OSSemAccept(pButtons->pButtonEventSemaphore) > 0))
+        {
+            popEvent(pButtons, pEvents ? &pEvents[count] : &discard);
+            count++;
+        }
+    }
+
+    return count;
+} // buttonsDrainEvents
+
+/*****************************************************************************/
+
+/**
+ * @brief      Discard all pending events, for example stale presses left over
+ *             from a previous prompt.
+ *
+ * @param[in]  pButtons  Valid handle for Buttons object
+ */
+void
+buttonsFlushEvents(Buttons *pButtons)
+{
+    buttonsDrainEvents(pButtons, NULL, BUTTONS_EVENT_RING_SIZE);
+} // buttonsFlushEvents
+
 /*****************************************************************************/
 /* Static Functions                                                          */
 /*****************************************************************************/
@@ -281,7 +356,11 @@ acquireButtons()
             pButtons->isrContexts[button] = NULL;
         }
 
-        pButtons->pButtonPressQueue = NULL;
+        pButtons->pButtonEventSemaphore = NULL;
+        pButtons->eventHead             = 0;
+        pButtons->eventTail             = 0;
+        pButtons->droppedEvents         = 0;
+        pButtons->bouncedEvents         = 0;
     }
 
     return pButtons;
@@ -300,7 +379,7 @@ static void
 releaseButtons(Buttons *pButtons)
 {
     Button  button      = 0;
-    INT8U   queueError  = OS_NO_ERR;
+    INT8U   semError    = OS_NO_ERR;
 
     if (pButtons)
     {
@@ -318,14 +397,14 @@ releaseButtons(Buttons *pButtons)
             }
         }
 
-        // Cleanup queue
-        if(pButtons->pButtonPressQueue)
+        // Cleanup semaphore
+        if (pButtons->pButtonEventSemaphore)
         {
-            OSQDel(pButtons->pButtonPressQueue,
-                   OS_DEL_ALWAYS,
-                   &queueError);
+            OSSemDel(pButtons->pButtonEventSemaphore,
+                     OS_DEL_ALWAYS,
+                     &semError);
 
-            pButtons->pButtonPressQueue = NULL;
+            pButtons->pButtonEventSemaphore = NULL;
         }
 
         // Free heap allocated memory
@@ -336,23 +415,23 @@ releaseButtons(Buttons *pButtons)
 /*****************************************************************************/
 
 /**
- * @brief      Initialize the button press queue.
+ * @brief      Initialize the button event semaphore. Its count always matches
+ *             the number of events waiting in the ring.
  *
  * @param[in]  pButtons  Valid handle for Buttons object
  *
- * @return     OS_NO_ERR if no error, OS_ERR_PDATA_NULL is OSQCreate fails or
+ * @return     OS_NO_ERR if no error, OS_ERR_PDATA_NULL is OSSemCreate fails or
  *             if parameters are invalid
  */
 static INT8U
-initQueue(Buttons *pButtons)
+initSemaphore(Buttons *pButtons)
 {
     INT8U status = OS_NO_ERR;
 
     if (pButtons)
     {
-        pButtons->pButtonPressQueue = OSQCreate(pButtons->pButtonPressQueueData,
-                                                BUTTONS_MESSAGE_QUEUE_SIZE);
-        if (pButtons->pButtonPressQueue == NULL)
+        pButtons->pButtonEventSemaphore = OSSemCreate(0);
+        if (pButtons->pButtonEventSemaphore == NULL)
         {
             status = OS_ERR_PDATA_NULL;
         }
@@ -363,15 +442,39 @@ initQueue(Buttons *pButtons)
     }
 
     return status;
-} // initQueue
+} // initSemaphore
+
+/*****************************************************************************/
+
+/**
+ * @brief      Remove the oldest event from the ring. The caller must already
+ *             hold a count from pButtonEventSemaphore, which guarantees the
+ *             ring is not empty. Only the consumer writes eventTail so no
+ *             critical section is needed against buttonISR().
+ *
+ * @param[in]  pButtons  Valid handle for Buttons object
+ * @param[out] pEvent    Event to be filled in
+ */
+static void
+popEvent(Buttons *pButtons, ButtonEvent *pEvent)
+{
+    INT32U tail = pButtons->eventTail;
+
+    *pEvent = pButtons->pButtonEvents[tail & BUTTONS_EVENT_RING_MASK];
+    pButtons->eventTail = tail + 1;
+} // popEvent
 
 /*****************************************************************************/
 
 /**
  * @brief      Interrupt service routine for all button presses. This routine
- *             is triggered on the falling edge of the registered buttons.
- *             The button id of the pressed button is posted to the shared
- *             queue.
+ *             is triggered on the captured edges of the registered buttons.
+ *             The PIOs only capture falling edges, so every accepted edge is
+ *             a press. Edges closer together than BUTTONS_DEBOUNCE_TICKS are
+ *             treated as contact bounce and dropped, accepted edges are
+ *             stamped and written to the event ring. The semaphore is only
+ *             posted for accepted edges so waiting tasks are not woken by
+ *             bounce.
  *
  * @param[in]  pContext  ButtonContext handle wrapped as an isr context.
  * @param[in]  id        UNUSED_PARAMETER
@@ -379,10 +482,34 @@ initQueue(Buttons *pButtons)
 static void
 buttonISR(void *pContext, alt_u32 id)
 {
-    ButtonContext *pButtonContext = (ButtonContext *) pContext;
+    ButtonContext  *pButtonContext = (ButtonContext *) pContext;
+    Buttons        *pButtons       = pButtonContext->pButtons;
+    ButtonEvent    *pEvent         = NULL;
+    INT32U          now            = OSTimeGet();
+    INT32U          head           = pButtons->eventHead;
+
+    if (pButtonContext->bEdgeSeen &&
+        ((now - pButtonContext->lastEdgeTick) < BUTTONS_DEBOUNCE_TICKS))
+    {
+        pButtons->bouncedEvents++;
+    }
+    else if ((head - pButtons->eventTail) >= BUTTONS_EVENT_RING_SIZE)
+    {
+        pButtons->droppedEvents++;
+    }
+    else
+    {
+        pButtonContext->lastEdgeTick = now;
+        pButtonContext->bEdgeSeen    = true;
 
-    // Push buttonID onto the message queue
-    OSQPost(pButtonContext->pButtons->pButtonPressQueue, (void *) pButtonContext->buttonID);
+        pEvent = &pButtons->pButtonEvents[head & BUTTONS_EVENT_RING_MASK];
+        pEvent->tick     = now;
+        pEvent->buttonID = (INT8U) pButtonContext->buttonID;
+
+        // Publish the event before waking the consumer
+        pButtons->eventHead = head + 1;
+        OSSemPost(pButtons->pButtonEventSemaphore);
+    }
 
     // Reset the button's edge capture register
     IOWR_ALTERA_AVALON_PIO_EDGE_CAP(pButtonContext->baseAddress, 0x0);
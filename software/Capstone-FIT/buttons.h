@@ -23,7 +23,9 @@
 /* Constants                                                                 */
 /*****************************************************************************/
 
-#define BUTTONS_MESSAGE_QUEUE_SIZE  64
+#define BUTTONS_EVENT_RING_SIZE     64  // Must be a power of two
+#define BUTTONS_EVENT_RING_MASK     (BUTTONS_EVENT_RING_SIZE - 1)
+#define BUTTONS_DEBOUNCE_TICKS      (OS_TICKS_PER_SEC / 20)
 
 /*****************************************************************************/
 /* Enumerations                                                              */
@@ -43,20 +45,34 @@ typedef enum _Button
 
 struct _Buttons;
 struct _ButtonContext;
+struct _ButtonEvent;
+
+// Packed so the ring stays small, written by buttonISR() only
+typedef struct __attribute__((packed)) _ButtonEvent
+{
+    INT32U                  tick;       // OSTimeGet() at the accepted press
+    INT8U                   buttonID;   // Button
+} ButtonEvent;
 
 typedef struct _Buttons
 {
     struct _ButtonContext  *isrContexts[ButtonMax];
-    OS_EVENT           	   *pButtonPressQueue;
-    void               	   *pButtonPressQueueData[BUTTONS_MESSAGE_QUEUE_SIZE];
+    OS_EVENT               *pButtonEventSemaphore;
+    ButtonEvent             pButtonEvents[BUTTONS_EVENT_RING_SIZE];
+    volatile INT32U         eventHead;      // Producer index, ISR only
+    volatile INT32U         eventTail;      // Consumer index, tasks only
+    volatile INT32U         droppedEvents;  // Ring overflows
+    volatile INT32U         bouncedEvents;  // Edges rejected by debounce
 } Buttons;
 
 typedef struct _ButtonContext
 {
-    struct _Buttons    	   *pButtons;
-    unsigned int        	irq;
-    unsigned int        	baseAddress;
-    Button              	buttonID;
+    struct _Buttons        *pButtons;
+    unsigned int            irq;
+    unsigned int            baseAddress;
+    Button                  buttonID;
+    INT32U                  lastEdgeTick;
+    bool                    bEdgeSeen;
 } ButtonContext;
 
 /*****************************************************************************/
@@ -74,6 +90,13 @@ void        buttonsDisableButton(Buttons *pButtons, Button buttonID);
 void        buttonsEnableAll(Buttons *pButtons);
 void        buttonsDisableAll(Buttons *pButtons);
 Button      buttonsGetButtonPress(Buttons *pButtons);
+INT8U       buttonsGetEvent(Buttons     *pButtons,
+                            ButtonEvent *pEvent,
+                            INT16U       timeoutTicks);
+int         buttonsDrainEvents(Buttons     *pButtons,
+                               ButtonEvent *pEvents,
+                               int          maxEvents);
+void        buttonsFlushEvents(Buttons *pButtons);
 
 /*****************************************************************************/
 /* End of File                                                               */
@@ -21,70 +21,129 @@
 #include "libport.h"
 #include "osport.h"
 #include "tcpport.h"
+#include "includes.h"
+#include "transport.h"
+#include "resolver.h"
 #include "client.h"
+#if FIT_TRANSPORT_COAP
+#include "coap.h"
+#endif
 
 /*****************************************************************************/
 /* Declarations                                                              */
 /*****************************************************************************/
 
-static int  create_connection();
-static int  reliable_receive(char *pResponse);
+struct _FITSegment;
+
+static FITError create_connection(int use_preconnected, INT32U deadline, int *pFd);
+static FITError exchange(char *pRequest,
+                         long  length,
+                         int   use_preconnected,
+                         long  timeout_ms,
+                         char *pResponse);
+static int  take_preconnected();
 static void parse_body(char *pResponse, char *pBody);
 static int  good_response(char *pResponse);
-static void create_barcode_request(char *pBarcodeString, char *pRequest);
+static int  response_status(char *pResponse);
+static int  add_items_sequential(FITBatchItem *pItems, int count);
+static long next_response(char *pData, long length, int closed, int *pStatus, int *pPersistent);
+static int  header_is(const char *pLine, const char *pName);
+static long create_barcode_request(char *pBarcodeString, char *pRequest);
 static long create_audio_request(char *pAudioRecording,
                                  long  audioLengthBytes,
                                  char *pRequest);
-static int  create_add_request(char *pItem, char *pRequest, int amount);
-static void create_delete_request(char *pItem, char *pRequest);
+static long create_add_request(char *pItem, char *pRequest, int amount, int keep_alive);
+static long create_add_body(char *pItem, int amount, char *pBody);
+static long create_delete_request(char *pItem, char *pRequest);
+static long create_sync_request(unsigned long since, char *pRequest);
+static char* put_segment(char *pDestination, const struct _FITSegment *pSegment);
+static char* put_string(char *pDestination, const char *pString, long length);
+static char* put_number(char *pDestination, long value);
+static char* put_unsigned(char *pDestination, unsigned long value);
+static int  number_length(long value);
+#if FIT_TRANSPORT_COAP
+static FITError coap_call(unsigned char  method,
+                          const char    *pPath,
+                          const char    *pPayload,
+                          char          *pBody,
+                          int            bodySize,
+                          int           *pStatus);
+#endif
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+// Constant run of request text and its length
+typedef struct _FITSegment
+{
+    const char *pText;
+    int         length;
+} FITSegment;
+
+#if FIT_TRANSPORT_COAP
+// Working storage for one CoAP exchange, too big for an input task's stack
+typedef struct _FITCoapExchange
+{
+    CoapMessage     request;
+    CoapMessage     response;
+    unsigned char   pBuffer[COAP_MAX_MESSAGE_SIZE];
+} FITCoapExchange;
+#endif
 
 /*****************************************************************************/
 /* Globals                                                                   */
 /*****************************************************************************/
 
-int                 server_fd;
-struct sockaddr_in  server_info;
-
-// HTTP header for barcode
-static const char barcode_request[] = {"\
-GET /barcode/%s HTTP/1.1\r\n\
-Host: %s\r\n\
-Connection: Close\r\n\r\n\
-"};
-
-// HTTP header for audio
-static const char audio_request[] = {"\
-POST /speech HTTP/1.1\r\n\
-Host: %s\r\n\
-Connection: Close\r\n\
-Content-Length: %ld\r\n\
-Content-Type: audio/wav\r\n\r\n\
-"};
-
-// HTTP header for adding
-static const char add_request[] = {"\
-PUT /1/inventory HTTP/1.1\r\n\
-Host: %s\r\n\
-Connection: Close\r\n\
-Content-Length: %i\r\n\
-Content-Type: application/json\r\n\r\n\
-"};
-
-// HTTP header for deleting
-static const char delete_request[] = {"\
-DELETE /1/inventory/title/%s HTTP/1.1\r\n\
-Host: %s\r\n\
-Connection: Close\r\n\r\n\
-"};
-
-// JSON body for adding
-static const char add_json[] = {"{\
-\"title\": \"%s\",\
-\"quantity\": %d,\
-\"units\": \"whole\",\
-\"timeAdded\": 1487568006,\
-\"timeExpired\": 32326905600\
-}"};
+// Connection opened ahead of a request by client_preconnect
+static int          preconnect_fd   = -1;
+static INT32U       preconnect_tick = 0;
+
+// Cleared for good once the server shows it won't answer pipelined requests
+static int          pipeline_enabled = 1;
+
+// Constant parts of each request, laid out at compile time with the host
+// name already in place. Only the variable fields are written per request.
+#define SEGMENT(text)   { text, sizeof(text) - 1 }
+
+// Request line tail and headers shared by the bodiless requests
+static const FITSegment request_tail = SEGMENT(" HTTP/1.1\r\n"
+                                               "Host: " FIT_HOST_NAME "\r\n"
+                                               "Connection: Close\r\n\r\n");
+
+// HTTP header for barcode, followed by the barcode and request_tail
+static const FITSegment barcode_head = SEGMENT("GET /barcode/");
+
+// HTTP header for audio, around the Content-Length value
+static const FITSegment audio_head = SEGMENT("POST /speech HTTP/1.1\r\n"
+                                             "Host: " FIT_HOST_NAME "\r\n"
+                                             "Connection: Close\r\n"
+                                             "Content-Length: ");
+static const FITSegment audio_tail = SEGMENT("\r\nContent-Type: audio/wav\r\n\r\n");
+
+// HTTP header for adding, around the Content-Length value
+static const FITSegment add_head = SEGMENT("PUT /1/inventory HTTP/1.1\r\n"
+                                           "Host: " FIT_HOST_NAME "\r\n"
+                                           "Connection: Close\r\n"
+                                           "Content-Length: ");
+// Same, for requests pipelined ahead of others on one connection
+static const FITSegment add_pipelined_head = SEGMENT("PUT /1/inventory HTTP/1.1\r\n"
+                                                     "Host: " FIT_HOST_NAME "\r\n"
+                                                     "Content-Length: ");
+static const FITSegment add_tail = SEGMENT("\r\nContent-Type: application/json\r\n\r\n");
+
+// HTTP header for deleting, followed by the title and request_tail
+static const FITSegment delete_head = SEGMENT("DELETE /1/inventory/title/");
+
+// HTTP header for inventory changes, followed by the token and request_tail
+static const FITSegment sync_head = SEGMENT("GET /1/inventory?since=");
+
+// JSON body for adding, around the title and quantity
+static const FITSegment add_json_head   = SEGMENT("{\"title\": \"");
+static const FITSegment add_json_middle = SEGMENT("\",\"quantity\": ");
+static const FITSegment add_json_tail   = SEGMENT(",\"units\": \"whole\","
+                                                  "\"timeAdded\": 1487568006,"
+                                                  "\"timeExpired\": 32326905600}");
 
 /*****************************************************************************/
 /* Functions                                                                 */
@@ -95,7 +154,8 @@ static const char add_json[] = {"{\
  *
  * @param[in]     pBarcodeString  Barcode as a string
  * @param[inout]  pItemString     Item string representation, buffer must be
- *                                pre-allocated by caller
+ *                                pre-allocated by caller. Holds a short
+ *                                description of the error on failure.
  *
  *
  * @return     1 if successful, 0 otherwise (pItemString will not be useful)
@@ -103,32 +163,39 @@ static const char add_json[] = {"{\
 int
 translate_barcode(char *pBarcodeString, char *pItemString)
 {
-    int         total_bytes  = 0;
-    FITRequest *pHttpRequest = (FITRequest *) malloc(sizeof(FITRequest));
+#if FIT_TRANSPORT_COAP
+    char        pPath[COAP_MAX_URI_SIZE];
+    int         status  = 0;
+    FITError    error   = FITErrorNone;
 
-    if (pHttpRequest != NULL)
+    snprintf(pPath, sizeof(pPath), "barcode/%s", pBarcodeString);
+    error = coap_call(COAP_GET, pPath, NULL, pItemString, FIT_MAX_BODY_SIZE, &status);
+    if (error != FITErrorNone)
     {
-        if(create_connection() < 0)
-        {
-            sprintf(pItemString, "Could not connect to internet.");
-            free(pHttpRequest);
-            return 0;
-        }
+        strcpy(pItemString, transport_error_string(error));
+        return 0;
+    }
 
-        create_barcode_request(pBarcodeString, pHttpRequest->pRequest);
+    return 1;
+#else
+    FITError    error        = FITErrorNone;
+    FITRequest *pHttpRequest = (FITRequest *) malloc(sizeof(FITRequest));
 
-        if (send(server_fd, pHttpRequest->pRequest, strlen(pHttpRequest->pRequest), 0) < 0)
+    if (pHttpRequest != NULL)
+    {
+        error = exchange(pHttpRequest->pRequest,
+                         create_barcode_request(pBarcodeString, pHttpRequest->pRequest),
+                         1,
+                         FIT_REQUEST_TIMEOUT_MS,
+                         pHttpRequest->pResponse);
+        if (error != FITErrorNone)
         {
-            perror("Error while sending");
-            sprintf(pItemString, "Could not connect to internet.");
+            strcpy(pItemString, transport_error_string(error));
             free(pHttpRequest);
             return 0;
         }
 
-        total_bytes = reliable_receive(pHttpRequest->pResponse);
-        pHttpRequest->pResponse[total_bytes] = '\0';
         parse_body(pHttpRequest->pResponse, pHttpRequest->pBody);
-        close(server_fd);
         strcpy(pItemString, pHttpRequest->pBody);
         free(pHttpRequest);
         return 1;
@@ -136,6 +203,7 @@ translate_barcode(char *pBarcodeString, char *pItemString)
 
     perror("HttpRequest malloc failed");
     return 0;
+#endif
 } // translate_barcode
 
 /*****************************************************************************/
@@ -146,45 +214,35 @@ translate_barcode(char *pBarcodeString, char *pItemString)
  * @param[in]     pAudioRecording   Linear16 lossless audio recording
  * @param[in]     audioLengthBytes  Number of bytes in recording
  * @param[inout]  pItemString       Item string representation, buffer must be
- *                                  pre-allocated by caller
+ *                                  pre-allocated by caller. Holds a short
+ *                                  description of the error on failure.
  *
  * @return     1 if successful, 0 otherwise (pItemString will not be useful)
  */
 int
 translate_audio(char *pAudioRecording, long audioLengthBytes, char *pItemString)
 {
-    int         total_bytes  = 0;
+    FITError    error        = FITErrorNone;
     FITRequest *pHttpRequest = (FITRequest *) malloc(sizeof(FITRequest));
-    
 
     if (pHttpRequest != NULL)
     {
-        if(create_connection() < 0)
-        {
-            sprintf(pItemString, "Could not connect to internet.");
-            free(pHttpRequest);
-            return 0;
-        }
-
         long header_length = create_audio_request(pAudioRecording,
                                                   audioLengthBytes,
                                                   pHttpRequest->pRequest);
-        int sent_bytes = send(server_fd,
-                              pHttpRequest->pRequest,
-                              header_length + audioLengthBytes,
-                              0);
-        if (sent_bytes < 0)
+        error = exchange(pHttpRequest->pRequest,
+                         header_length + audioLengthBytes,
+                         1,
+                         FIT_AUDIO_TIMEOUT_MS,
+                         pHttpRequest->pResponse);
+        if (error != FITErrorNone)
         {
-            perror("Error while sending");
-            sprintf(pItemString, "Could not connect to internet.");
+            strcpy(pItemString, transport_error_string(error));
             free(pHttpRequest);
             return 0;
         }
 
-        total_bytes = reliable_receive(pHttpRequest->pResponse);
-        pHttpRequest->pResponse[total_bytes] = '\0';
         parse_body(pHttpRequest->pResponse, pHttpRequest->pBody);
-        close(server_fd);
         strcpy(pItemString, pHttpRequest->pBody);
         free(pHttpRequest);
         return 1;
@@ -200,34 +258,74 @@ translate_audio(char *pAudioRecording, long audioLengthBytes, char *pItemString)
  * @brief      Adds an item to the FIT database
  *
  * @param[in]  pItemString  The item to be added
+ * @param[in]  amount       Quantity to add, negative to remove
  *
  * @return     1 if successful, 0 in case of error
  */
 int
 add_item(char *pItemString, int amount)
 {
+    return add_item_ex(pItemString, amount, NULL);
+} // add_item
+
+/*****************************************************************************/
+
+/**
+ * @brief      Adds an item to the FIT database and reports the HTTP status so
+ *             callers can tell a rejected request from an unreachable server
+ *
+ * @param[in]     pItemString  The item to be added
+ * @param[in]     amount       Quantity to add, negative to remove
+ * @param[inout]  pHttpStatus  Status code of the response, or a (negative)
+ *                             FITError if no complete response was
+ *                             received. May be NULL.
+ *
+ * @return     1 if successful, 0 in case of error
+ */
+int
+add_item_ex(char *pItemString, int amount, int *pHttpStatus)
+{
+#if FIT_TRANSPORT_COAP
+    char        pJson[FIT_MAX_BODY_SIZE];
+    char        pBody[FIT_MAX_BODY_SIZE];
+    int         status  = 0;
+    FITError    error   = FITErrorNone;
+
+    // Same JSON body as over HTTP, just without the headers
+    create_add_body(pItemString, amount, pJson);
+    error = coap_call(COAP_PUT, "1/inventory", pJson, pBody, sizeof(pBody), &status);
+    if (pHttpStatus)
+    {
+        *pHttpStatus = (error == FITErrorNone) ? status : error;
+    }
+
+    return (error == FITErrorNone) && ((status / 100) == 2);
+#else
     int         retval          = 0;
+    FITError    error           = FITErrorNone;
     FITRequest *pHttpRequest    = (FITRequest *) malloc(sizeof(FITRequest));
-    
+
+    if (pHttpStatus)
+    {
+        *pHttpStatus = FITErrorSocket;
+    }
+
     if (pHttpRequest != NULL)
     {
-        if(create_connection() < 0)
+        long request_length = create_add_request(pItemString, pHttpRequest->pRequest, amount, 0);
+        error = exchange(pHttpRequest->pRequest,
+                         request_length,
+                         0,
+                         FIT_REQUEST_TIMEOUT_MS,
+                         pHttpRequest->pResponse);
+        if (error == FITErrorNone)
         {
-            free(pHttpRequest);
-            return retval;
+            retval = good_response(pHttpRequest->pResponse);
         }
-        long header_length = create_add_request(pItemString, pHttpRequest->pRequest, amount);
-        int sent_bytes = send(server_fd, pHttpRequest->pRequest, header_length, 0);
-        if (sent_bytes < 0)
+        if (pHttpStatus)
         {
-            free(pHttpRequest);
-            perror("Error while sending");
-            return retval;
+            *pHttpStatus = (error == FITErrorNone) ? response_status(pHttpRequest->pResponse) : error;
         }
-        int total_bytes = reliable_receive(pHttpRequest->pResponse);
-        pHttpRequest->pResponse[total_bytes] = '\0';
-        close(server_fd);
-        retval = good_response(pHttpRequest->pResponse);
         free(pHttpRequest);
     }
     else
@@ -236,7 +334,160 @@ add_item(char *pItemString, int amount)
     }
 
     return retval;
-} // add_item
+#endif
+} // add_item_ex
+
+/*****************************************************************************/
+
+/**
+ * @brief      Adds several items to the FIT database in order. Over HTTP the
+ *             requests are pipelined: written back to back on one connection
+ *             and answered in order, so the batch costs about one round trip
+ *             rather than one per item. If the server won't pipeline, the
+ *             items it left unanswered are sent one at a time instead, and so
+ *             is every later batch.
+ *
+ * @param[inout]  pItems  Items to add; the httpStatus of each is filled in.
+ *                        Once an item gets no response the ones after it may
+ *                        not have been applied either.
+ * @param[in]     count   Number of items, at most FIT_PIPELINE_DEPTH are sent
+ *
+ * @return     1 if every item was added, 0 otherwise
+ */
+int
+add_items(FITBatchItem *pItems, int count)
+{
+#if FIT_TRANSPORT_COAP
+    // Datagrams have no connection to pipeline on
+    return add_items_sequential(pItems, MIN(count, FIT_PIPELINE_DEPTH));
+#else
+    FITError    error           = FITErrorNone;
+    FITRequest *pHttpRequest    = NULL;
+    int         fd              = -1;
+    int         index           = 0;
+    int         answered        = 0;
+    int         closed          = 0;
+    int         persistent      = 1;
+    int         status          = 0;
+    long        length          = 0;
+    long        buffered        = 0;
+    long        received        = 0;
+    long        response_length = 0;
+    INT32U      deadline        = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        pItems[index].httpStatus = FITErrorNotSent;
+    }
+    count = MIN(count, FIT_PIPELINE_DEPTH);
+
+    if ((count <= 1) || !pipeline_enabled)
+    {
+        return add_items_sequential(pItems, count);
+    }
+
+    pHttpRequest = (FITRequest *) malloc(sizeof(FITRequest));
+    if (pHttpRequest == NULL)
+    {
+        perror("HttpRequest malloc failed");
+        return 0;
+    }
+
+    // Only the last request asks the server to close the connection
+    for (index = 0; index < count; index++)
+    {
+        length += create_add_request(pItems[index].pItemString,
+                                     pHttpRequest->pRequest + length,
+                                     pItems[index].amount,
+                                     index < (count - 1));
+    }
+
+    deadline = transport_deadline(FIT_REQUEST_TIMEOUT_MS);
+    error = create_connection(0, transport_deadline(FIT_CONNECT_TIMEOUT_MS), &fd);
+    if (error == FITErrorNone)
+    {
+        error = transport_send(fd, pHttpRequest->pRequest, length, deadline);
+    }
+
+    // Responses come back in request order; hand each out as it completes
+    while ((error == FITErrorNone) && (answered < count) && !closed && persistent)
+    {
+        if (buffered >= (FIT_MAX_HTTP_SIZE - 1))
+        {
+            error = FITErrorResponseTooLarge;
+            break;
+        }
+
+        error = transport_receive_some(fd,
+                                       pHttpRequest->pResponse + buffered,
+                                       FIT_MAX_HTTP_SIZE - 1 - buffered,
+                                       deadline,
+                                       &received);
+        closed = (received == 0);
+        buffered += received;
+        pHttpRequest->pResponse[buffered] = '\0';
+
+        while ((error == FITErrorNone) && (answered < count) && persistent)
+        {
+            response_length = next_response(pHttpRequest->pResponse, buffered, closed, &status, &persistent);
+            if (response_length <= 0)
+            {
+                break;
+            }
+            pItems[answered++].httpStatus = status;
+
+            buffered -= response_length;
+            memmove(pHttpRequest->pResponse,
+                    pHttpRequest->pResponse + response_length,
+                    buffered + 1);
+        }
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    free(pHttpRequest);
+
+    if ((error == FITErrorNone) && (answered < count))
+    {
+        if (answered > 0)
+        {
+            // The server closed after answering only part of the batch
+            printf("Server closed after %d of %d pipelined requests, "
+                   "sending one at a time\n", answered, count);
+            pipeline_enabled = 0;
+            add_items_sequential(pItems + answered, count - answered);
+        }
+        else
+        {
+            error = FITErrorReceiveFailed;
+        }
+    }
+
+    if (error != FITErrorNone)
+    {
+        printf("Pipelined request failed after %d of %d responses: %s\n",
+               answered,
+               count,
+               transport_error_string(error));
+        for (index = answered; index < count; index++)
+        {
+            pItems[index].httpStatus = error;
+        }
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        if (pItems[index].httpStatus != 200)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+#endif
+} // add_items
 
 /*****************************************************************************/
 
@@ -250,29 +501,29 @@ add_item(char *pItemString, int amount)
 int
 remove_item(char *pItemString)
 {
+#if FIT_TRANSPORT_COAP
+    char    pPath[COAP_MAX_URI_SIZE];
+    char    pBody[FIT_MAX_BODY_SIZE];
+    int     status  = 0;
+
+    snprintf(pPath, sizeof(pPath), "1/inventory/title/%s", pItemString);
+    return (coap_call(COAP_DELETE, pPath, NULL, pBody, sizeof(pBody), &status) == FITErrorNone) &&
+           ((status / 100) == 2);
+#else
     int         retval          = 0;
     FITRequest *pHttpRequest    = (FITRequest *) malloc(sizeof(FITRequest));
-    
+
     if (pHttpRequest != NULL)
     {
-        if(create_connection() < 0)
+        if (exchange(pHttpRequest->pRequest,
+                     create_delete_request(pItemString, pHttpRequest->pRequest),
+                     0,
+                     FIT_REQUEST_TIMEOUT_MS,
+                     pHttpRequest->pResponse) == FITErrorNone)
         {
-            free(pHttpRequest);
-            return retval;
+            retval = good_response(pHttpRequest->pResponse);
         }
-        create_delete_request(pItemString, pHttpRequest->pRequest);
-        int sent_bytes = send(server_fd, pHttpRequest->pRequest, strlen(pHttpRequest->pRequest), 0);
-        if (sent_bytes < 0)
-        {
-            perror("Error while sending");
-            free(pHttpRequest);
-            return retval;
-        }
-        int total_bytes = reliable_receive(pHttpRequest->pResponse);
-        pHttpRequest->pResponse[total_bytes] = '\0';
-        close(server_fd);
         free(pHttpRequest);
-        retval = good_response(pHttpRequest->pResponse);
     }
     else
     {
@@ -280,81 +531,274 @@ remove_item(char *pItemString)
     }
 
     return retval;
+#endif
 } // remove_item
 
 /*****************************************************************************/
-/* Static Functions                                                          */
+
+/**
+ * @brief      Get the inventory items changed since a sync token
+ *
+ * @param[in]     since     Token from the last sync, 0 for every item
+ * @param[inout]  pBody     Body of response, buffer must be pre-allocated by
+ *                          the caller
+ * @param[in]     bodySize  Size of pBody in bytes
+ *
+ * @return     1 if successful, 0 in case of error or if the body does not
+ *             fit in pBody
+ */
+int
+get_inventory_changes(unsigned long since, char *pBody, int bodySize)
+{
+    int         retval          = 0;
+    char       *pPosition       = NULL;
+    FITRequest *pHttpRequest    = (FITRequest *) malloc(sizeof(FITRequest));
+
+    if (pHttpRequest != NULL)
+    {
+        if (exchange(pHttpRequest->pRequest,
+                     create_sync_request(since, pHttpRequest->pRequest),
+                     0,
+                     FIT_REQUEST_TIMEOUT_MS,
+                     pHttpRequest->pResponse) == FITErrorNone)
+        {
+            pPosition = strstr(pHttpRequest->pResponse, "\r\n\r\n");
+            if (good_response(pHttpRequest->pResponse) &&
+                (pPosition != NULL) &&
+                ((int) strlen(pPosition + 4) < bodySize))
+            {
+                strcpy(pBody, pPosition + 4);
+                retval = 1;
+            }
+        }
+        free(pHttpRequest);
+    }
+    else
+    {
+        perror("HttpRequest malloc failed");
+    }
+
+    return retval;
+} // get_inventory_changes
+
 /*****************************************************************************/
 
 /**
- * @brief      Set up socket file descriptor and connect to server
+ * @brief      Start connecting to the server ahead of a request, so the TCP
+ *             handshake overlaps with the user scanning or speaking. Does not
+ *             block. The next translate request picks the connection up; it
+ *             is dropped if unused after FIT_PRECONNECT_TIMEOUT_MS.
  *
- * @return     1 if successful, otherwise 0 (socket or connection error)
+ * @return     1 if a connection is open or opening, 0 otherwise
  */
-static int
-create_connection()
+int
+client_preconnect()
 {
-    // Setup socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    int     fd      = -1;
+    int     stale   = -1;
+#if OS_CRITICAL_METHOD == 3
+    OS_CPU_SR cpu_sr = 0;
+#endif
+
+    // Keep a connection that is still fresh, drop one that is not
+    OS_ENTER_CRITICAL();
+    if ((preconnect_fd >= 0) &&
+        ((OSTimeGet() - preconnect_tick) < FIT_PRECONNECT_TICKS))
     {
-        perror("Couldn't open socket");
-        return 0;
+        OS_EXIT_CRITICAL();
+        return 1;
     }
+    stale         = preconnect_fd;
+    preconnect_fd = -1;
+    OS_EXIT_CRITICAL();
 
-    // Set up information for server
-    bzero(&server_info, sizeof(server_info));
-    server_info.sin_family      = AF_INET;
-    server_info.sin_port        = htons(FIT_PORT);
-    server_info.sin_addr.s_addr = inet_addr(FIT_IP_ADDR);
+    if (stale >= 0)
+    {
+        close(stale);
+    }
 
-    // Connect to server
-    if (connect(server_fd, (struct sockaddr *) &server_info, sizeof(server_info)) != 0)
+    if (transport_start_connect(resolverGetAddress(), FIT_PORT, &fd) != FITErrorNone)
     {
-        perror("Couldn't connect to server");
         return 0;
     }
 
+    // Another task may have raced us here, only one connection is kept
+    OS_ENTER_CRITICAL();
+    if (preconnect_fd < 0)
+    {
+        preconnect_fd   = fd;
+        preconnect_tick = OSTimeGet();
+        fd              = -1;
+    }
+    OS_EXIT_CRITICAL();
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
     return 1;
-} // create_connection
+} // client_preconnect
 
 /*****************************************************************************/
 
 /**
- * @brief      Gets the response on the socket, returns total received bytes
- *             once connection dies
- *
- * @param[inout]  pResponse  Response from server for particular request,
- *                           buffer must be pre-allocated by the caller
- *
- * @return     Total number of bytes received
+ * @brief      Drop the connection opened by client_preconnect if it has gone
+ *             unused for too long. Meant to be called periodically.
  */
-static int
-reliable_receive(char *pResponse)
+void
+client_expire_preconnect()
 {
-    int total_bytes     = 0;
-    int bytes_received  = 0;
+    int fd = take_preconnected();
 
-    // Loop over receiving until connection dies because it might be split into multiple packets
-    while (1)
+    // Still fresh, put it back unless a new one was opened meanwhile
+    if (fd >= 0)
     {
-        bytes_received = recv(server_fd, pResponse + total_bytes, FIT_MAX_HTTP_SIZE - total_bytes, 0);
-        if (bytes_received == 0)
+#if OS_CRITICAL_METHOD == 3
+        OS_CPU_SR cpu_sr = 0;
+#endif
+        OS_ENTER_CRITICAL();
+        if (preconnect_fd < 0)
         {
-            return total_bytes;
+            preconnect_fd = fd;
+            fd            = -1;
         }
-        else if (bytes_received < 0)
+        OS_EXIT_CRITICAL();
+
+        if (fd >= 0)
         {
-            perror("Error while receiving");
-            return 0;
+            close(fd);
         }
-        else
+    }
+} // client_expire_preconnect
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Connect to the server before a deadline. Each request gets its
+ *             own socket so requests may be issued from more than one task
+ *             at a time.
+ *
+ * @param[in]     use_preconnected  Use the connection opened by
+ *                                  client_preconnect if there is one
+ * @param[in]     deadline          Give up at this tick
+ * @param[inout]  pFd               Connected socket, -1 on error
+ *
+ * @return     FITErrorNone if connected, error otherwise
+ */
+static FITError
+create_connection(int use_preconnected, INT32U deadline, int *pFd)
+{
+    FITError error = FITErrorNone;
+
+    if (use_preconnected && ((*pFd = take_preconnected()) >= 0))
+    {
+        if (transport_finish_connect(*pFd, deadline) == FITErrorNone)
         {
-            total_bytes += bytes_received;
+            return FITErrorNone;
         }
+
+        // Speculative connection failed, fall back to a fresh one
+        close(*pFd);
     }
 
-    return 0;
-} // reliable_receive
+    error = transport_connect(resolverGetAddress(), FIT_PORT, deadline, pFd);
+    if (error != FITErrorNone)
+    {
+        printf("Couldn't connect to server: %s\n", transport_error_string(error));
+    }
+
+    return error;
+} // create_connection
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send a request and collect the whole response, all within
+ *             timeout_ms. The connect phase gets at most
+ *             FIT_CONNECT_TIMEOUT_MS of that.
+ *
+ * @param[in]     pRequest          Request to send
+ * @param[in]     length            Length of the request in bytes
+ * @param[in]     use_preconnected  Use the connection opened by
+ *                                  client_preconnect if there is one
+ * @param[in]     timeout_ms        Time allowed for the whole exchange
+ * @param[inout]  pResponse         Response, FIT_MAX_HTTP_SIZE buffer
+ *                                  pre-allocated by the caller
+ *
+ * @return     FITErrorNone if a complete response arrived, error otherwise
+ */
+static FITError
+exchange(char *pRequest,
+         long  length,
+         int   use_preconnected,
+         long  timeout_ms,
+         char *pResponse)
+{
+    FITError    error               = FITErrorNone;
+    int         fd                  = -1;
+    long        total_bytes         = 0;
+    INT32U      deadline            = transport_deadline(timeout_ms);
+    INT32U      connect_deadline    = transport_deadline(MIN(timeout_ms, FIT_CONNECT_TIMEOUT_MS));
+
+    pResponse[0] = '\0';
+
+    error = create_connection(use_preconnected, connect_deadline, &fd);
+    if (error == FITErrorNone)
+    {
+        error = transport_send(fd, pRequest, length, deadline);
+    }
+    if (error == FITErrorNone)
+    {
+        error = transport_receive(fd, pResponse, FIT_MAX_HTTP_SIZE, deadline, &total_bytes);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if ((error != FITErrorNone) && (error != FITErrorConnectTimeout) && (error != FITErrorConnectFailed))
+    {
+        printf("Request failed after %ld bytes: %s\n", total_bytes, transport_error_string(error));
+    }
+
+    return error;
+} // exchange
+
+/*****************************************************************************/
+
+/**
+ * @brief      Take the connection opened by client_preconnect, if it is
+ *             still fresh
+ *
+ * @return     Socket with a connection in progress or complete, -1 if none
+ */
+static int
+take_preconnected()
+{
+    int     fd      = -1;
+    int     stale   = 0;
+#if OS_CRITICAL_METHOD == 3
+    OS_CPU_SR cpu_sr = 0;
+#endif
+
+    OS_ENTER_CRITICAL();
+    fd            = preconnect_fd;
+    stale         = ((OSTimeGet() - preconnect_tick) >= FIT_PRECONNECT_TICKS);
+    preconnect_fd = -1;
+    OS_EXIT_CRITICAL();
+
+    if ((fd >= 0) && stale)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+} // take_preconnected
 
 /*****************************************************************************/
 
@@ -369,8 +813,8 @@ static void
 parse_body(char *pResponse, char *pBody)
 {
     // Ignore the starting newlines in body by adding 4
-    char *pPosition = strstr(pResponse, "\r\n\r\n") + 4;
-    strcpy(pBody, pPosition);
+    char *pPosition = strstr(pResponse, "\r\n\r\n");
+    strcpy(pBody, pPosition ? pPosition + 4 : "");
 } // parse_body
 
 /*****************************************************************************/
@@ -390,17 +834,198 @@ good_response(char *pResponse)
 
 /*****************************************************************************/
 
+/**
+ * @brief      Get the status code from the status line of a response
+ *
+ * @param[in]  pResponse  HTTP response that is checked
+ *
+ * @return     Status code (eg. 200), 0 if the status line is missing
+ */
+static int
+response_status(char *pResponse)
+{
+    char *pPosition = NULL;
+
+    if (strncmp(pResponse, "HTTP/", 5) != 0)
+    {
+        return 0;
+    }
+
+    pPosition = strchr(pResponse, ' ');
+    return (pPosition != NULL) ? atoi(pPosition + 1) : 0;
+} // response_status
+
+/*****************************************************************************/
+
+/**
+ * @brief      Add items one request at a time, stopping at the first one
+ *             that isn't added, as a pipelined batch would have to
+ *
+ * @param[inout]  pItems  Items to add, the httpStatus of each is filled in
+ * @param[in]     count   Number of items
+ *
+ * @return     1 if every item was added, 0 otherwise
+ */
+static int
+add_items_sequential(FITBatchItem *pItems, int count)
+{
+    int retval  = 1;
+    int index   = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        // Stop at the first failure so nothing after it reaches the server
+        if (!add_item_ex(pItems[index].pItemString, pItems[index].amount, &pItems[index].httpStatus))
+        {
+            retval = 0;
+            break;
+        }
+    }
+
+    for (index++; index < count; index++)
+    {
+        pItems[index].httpStatus = FITErrorNotSent;
+    }
+
+    return retval;
+} // add_items_sequential
+
+/*****************************************************************************/
+
+/**
+ * @brief      Find the end of the first response in data received on a
+ *             connection carrying pipelined requests
+ *
+ * @param[in]     pData        Data received so far, NUL terminated
+ * @param[in]     length       Length of pData in bytes
+ * @param[in]     closed       The server has closed the connection
+ * @param[inout]  pStatus      Status code of the response, set once it is
+ *                             complete
+ * @param[inout]  pPersistent  0 if the server closes the connection after
+ *                             the response, set once it is complete
+ *
+ * @return     Length of the response in bytes, 0 if it is not all here yet
+ */
+static long
+next_response(char *pData, long length, int closed, int *pStatus, int *pPersistent)
+{
+    char   *pHeadEnd        = strstr(pData, "\r\n\r\n");
+    char   *pLine           = NULL;
+    char   *pValue          = NULL;
+    long    head_length     = 0;
+    long    content_length  = -1;
+    int     status          = 0;
+    int     persistent      = 0;
+
+    if (pHeadEnd == NULL)
+    {
+        return 0;
+    }
+    head_length = (pHeadEnd + 4) - pData;
+
+    status     = response_status(pData);
+    persistent = (strncmp(pData, "HTTP/1.1", 8) == 0);
+
+    for (pLine = strstr(pData, "\r\n") + 2; pLine < pHeadEnd + 2; pLine = strstr(pLine, "\r\n") + 2)
+    {
+        pValue = strchr(pLine, ':');
+        if ((pValue == NULL) || (pValue > pHeadEnd))
+        {
+            continue;
+        }
+        for (pValue++; *pValue == ' '; pValue++)
+        {
+        }
+
+        if (header_is(pLine, "Content-Length"))
+        {
+            content_length = atol(pValue);
+        }
+        else if (header_is(pLine, "Connection") && (header_is(pValue, "close")))
+        {
+            persistent = 0;
+        }
+        else if (header_is(pLine, "Transfer-Encoding"))
+        {
+            // Chunked bodies aren't decoded, so can only end at the close
+            persistent = 0;
+        }
+    }
+
+    // These never have a body
+    if (((status / 100) == 1) || (status == 204) || (status == 304))
+    {
+        content_length = 0;
+    }
+
+    // Without a length the body runs to the close
+    if (content_length < 0)
+    {
+        if (!closed)
+        {
+            return 0;
+        }
+        content_length = length - head_length;
+        persistent     = 0;
+    }
+
+    if ((length - head_length) < content_length)
+    {
+        return 0;
+    }
+
+    *pStatus     = status;
+    *pPersistent = persistent;
+    return head_length + content_length;
+} // next_response
+
+/*****************************************************************************/
+
+/**
+ * @brief      Check a header line (or value) starts with a token, ignoring
+ *             case
+ *
+ * @param[in]  pLine  Start of the header line
+ * @param[in]  pName  Token, eg. "Content-Length"
+ *
+ * @return     1 if it does, 0 otherwise
+ */
+static int
+header_is(const char *pLine, const char *pName)
+{
+    for (; *pName; pLine++, pName++)
+    {
+        if (tolower((unsigned char) *pLine) != tolower((unsigned char) *pName))
+        {
+            return 0;
+        }
+    }
+
+    return ((*pLine == ':') || (*pLine == '\r') || (*pLine == ' ') || (*pLine == ','));
+} // header_is
+
+/*****************************************************************************/
+
 /**
  * @brief      Creates a barcode request
  *
  * @param[in]     pBarcodeString  Barcode represented as a string
  * @param[inout]  pRequest  Request to be filled in, this buffer must be
  *                          pre-allocated by the caller
+ *
+ * @return     The length of the resulting request in bytes
  */
-static void
+static long
 create_barcode_request(char *pBarcodeString, char *pRequest)
 {
-    sprintf(pRequest, barcode_request, pBarcodeString, FIT_IP_ADDR);
+    char *pPosition = pRequest;
+
+    pPosition = put_segment(pPosition, &barcode_head);
+    pPosition = put_string(pPosition, pBarcodeString, strlen(pBarcodeString));
+    pPosition = put_segment(pPosition, &request_tail);
+    *pPosition = '\0';
+
+    return pPosition - pRequest;
 } // create_barcode_request
 
 /*****************************************************************************/
@@ -414,55 +1039,346 @@ create_barcode_request(char *pBarcodeString, char *pRequest)
  * @param[inout]  pRequest  Request to be filled in, this buffer must be
  *                          pre-allocated by the caller
  *
- * @return     The length of the resulting request in bytes
+ * @return     The length of the header in bytes
  */
 static long
 create_audio_request(char *pAudioRecording, long audioLengthBytes, char *pRequest)
 {
-    sprintf(pRequest, audio_request, FIT_IP_ADDR, audioLengthBytes);
-    long header_length = strlen(pRequest);
-    memcpy(pRequest + strlen(pRequest), pAudioRecording, audioLengthBytes);
-    return header_length;
+    char *pPosition = pRequest;
+
+    pPosition = put_segment(pPosition, &audio_head);
+    pPosition = put_number(pPosition, audioLengthBytes);
+    pPosition = put_segment(pPosition, &audio_tail);
+    memcpy(pPosition, pAudioRecording, audioLengthBytes);
+
+    return pPosition - pRequest;
 } // create_audio_request
 
 /*****************************************************************************/
 
 /**
- * @brief      Create add request by generating the json we need then creating
-               the header and returning the length of the total request size
+ * @brief      Create add request. The body length is known from the lengths
+ *             of its parts, so the header is written first and the body
+ *             straight after it.
  *
  * @param[in]     pItemString  Item to be added
- * @param[in]     amount       amount of item to be added
  * @param[inout]  pRequest     Request to be filled in, this buffer must be
  *                             pre-allocated by the caller
+ * @param[in]     amount       amount of item to be added
+ * @param[in]     keep_alive   Leave the connection open for a request
+ *                             pipelined after this one
  *
  * @return     The length of the resulting request in bytes
  */
-static int
-create_add_request(char *pItemString, char *pRequest, int amount)
+static long
+create_add_request(char *pItemString, char *pRequest, int amount, int keep_alive)
 {
-    char body[FIT_MAX_BODY_SIZE];
-    sprintf(body, add_json, pItemString, amount);
-    sprintf(pRequest, add_request, FIT_IP_ADDR, (int)strlen(body));
-    memcpy(pRequest+strlen(pRequest), body, strlen(body));
-    return (int)strlen(pRequest);
+    char   *pPosition   = pRequest;
+    long    item_length = strlen(pItemString);
+    long    body_length = add_json_head.length +
+                          item_length +
+                          add_json_middle.length +
+                          number_length(amount) +
+                          add_json_tail.length;
+
+    pPosition = put_segment(pPosition, keep_alive ? &add_pipelined_head : &add_head);
+    pPosition = put_number(pPosition, body_length);
+    pPosition = put_segment(pPosition, &add_tail);
+    pPosition += create_add_body(pItemString, amount, pPosition);
+
+    return pPosition - pRequest;
 } // create_add_request
 
 /*****************************************************************************/
 
+/**
+ * @brief      Create the JSON body for adding an item
+ *
+ * @param[in]     pItemString  Item to be added
+ * @param[in]     amount       amount of item to be added
+ * @param[inout]  pBody        Body to be filled in, this buffer must be
+ *                             pre-allocated by the caller
+ *
+ * @return     The length of the body in bytes
+ */
+static long
+create_add_body(char *pItemString, int amount, char *pBody)
+{
+    char *pPosition = pBody;
+
+    pPosition = put_segment(pPosition, &add_json_head);
+    pPosition = put_string(pPosition, pItemString, strlen(pItemString));
+    pPosition = put_segment(pPosition, &add_json_middle);
+    pPosition = put_number(pPosition, amount);
+    pPosition = put_segment(pPosition, &add_json_tail);
+    *pPosition = '\0';
+
+    return pPosition - pBody;
+} // create_add_body
+
+/*****************************************************************************/
+
 /**
  * @brief      Creates a delete request
  *
  * @param[in]     pItemString  Item to be deleted
  * @param[inout]  pRequest     Request to be filled in, this buffer must be
  *                             pre-allocated by the caller
+ *
+ * @return     The length of the resulting request in bytes
  */
-static void
+static long
 create_delete_request(char *pItemString, char *pRequest)
 {
-    sprintf(pRequest, delete_request, pItemString, FIT_IP_ADDR);
+    char *pPosition = pRequest;
+
+    pPosition = put_segment(pPosition, &delete_head);
+    pPosition = put_string(pPosition, pItemString, strlen(pItemString));
+    pPosition = put_segment(pPosition, &request_tail);
+    *pPosition = '\0';
+
+    return pPosition - pRequest;
 } // create_delete_request
 
+/*****************************************************************************/
+
+/**
+ * @brief      Creates an inventory sync request
+ *
+ * @param[in]     since     Token from the last sync, 0 for every item
+ * @param[inout]  pRequest  Request to be filled in, this buffer must be
+ *                          pre-allocated by the caller
+ *
+ * @return     The length of the resulting request in bytes
+ */
+static long
+create_sync_request(unsigned long since, char *pRequest)
+{
+    char *pPosition = pRequest;
+
+    pPosition = put_segment(pPosition, &sync_head);
+    pPosition = put_unsigned(pPosition, since);
+    pPosition = put_segment(pPosition, &request_tail);
+    *pPosition = '\0';
+
+    return pPosition - pRequest;
+} // create_sync_request
+
+/*****************************************************************************/
+
+/**
+ * @brief      Copy a constant segment into a request
+ *
+ * @param[inout]  pDestination  Where to write
+ * @param[in]     pSegment      Segment to copy
+ *
+ * @return     Position after the segment
+ */
+static char*
+put_segment(char *pDestination, const FITSegment *pSegment)
+{
+    memcpy(pDestination, pSegment->pText, pSegment->length);
+    return pDestination + pSegment->length;
+} // put_segment
+
+/*****************************************************************************/
+
+/**
+ * @brief      Copy a variable field of known length into a request
+ *
+ * @param[inout]  pDestination  Where to write
+ * @param[in]     pString       Field to copy
+ * @param[in]     length        Length of the field in bytes
+ *
+ * @return     Position after the field
+ */
+static char*
+put_string(char *pDestination, const char *pString, long length)
+{
+    memcpy(pDestination, pString, length);
+    return pDestination + length;
+} // put_string
+
+/*****************************************************************************/
+
+/**
+ * @brief      Write a signed decimal number, without going through sprintf
+ *
+ * @param[inout]  pDestination  Where to write
+ * @param[in]     value         Number to write
+ *
+ * @return     Position after the number
+ */
+static char*
+put_number(char *pDestination, long value)
+{
+    if (value < 0)
+    {
+        *pDestination++ = '-';
+        return put_unsigned(pDestination, 0UL - (unsigned long) value);
+    }
+
+    return put_unsigned(pDestination, (unsigned long) value);
+} // put_number
+
+/*****************************************************************************/
+
+/**
+ * @brief      Write an unsigned decimal number, without going through sprintf
+ *
+ * @param[inout]  pDestination  Where to write
+ * @param[in]     value         Number to write
+ *
+ * @return     Position after the number
+ */
+static char*
+put_unsigned(char *pDestination, unsigned long value)
+{
+    char    pDigits[20];    // Enough for a 64 bit long
+    int     count = 0;
+
+    // Digits come out least significant first
+    do
+    {
+        pDigits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    while (count)
+    {
+        *pDestination++ = pDigits[--count];
+    }
+
+    return pDestination;
+} // put_unsigned
+
+/*****************************************************************************/
+
+/**
+ * @brief      Number of characters put_number writes for a value
+ *
+ * @param[in]  value  Number to measure
+ *
+ * @return     Length in characters, including any sign
+ */
+static int
+number_length(long value)
+{
+    int             length      = (value < 0) ? 2 : 1;
+    unsigned long   magnitude   = (value < 0) ? 0UL - (unsigned long) value : (unsigned long) value;
+
+    while (magnitude >= 10)
+    {
+        magnitude /= 10;
+        length++;
+    }
+
+    return length;
+} // number_length
+
+#if FIT_TRANSPORT_COAP
+/*****************************************************************************/
+
+/**
+ * @brief      Make one confirmable CoAP request to the server. Takes a single
+ *             round trip when nothing is lost, with no handshake or headers.
+ *
+ * @param[in]     method    COAP_GET, COAP_PUT, ...
+ * @param[in]     pPath     Resource path without the leading '/'
+ * @param[in]     pPayload  JSON payload, NULL for none
+ * @param[inout]  pBody     Response payload, NUL terminated, buffer must be
+ *                          pre-allocated by the caller
+ * @param[in]     bodySize  Size of pBody in bytes
+ * @param[inout]  pStatus   Response code as an HTTP style number, eg. 2.04
+ *                          Changed is 204
+ *
+ * @return     FITErrorNone if a response arrived, error otherwise
+ */
+static FITError
+coap_call(unsigned char  method,
+          const char    *pPath,
+          const char    *pPayload,
+          char          *pBody,
+          int            bodySize,
+          int           *pStatus)
+{
+    FITError            error       = FITErrorNone;
+    int                 fd          = -1;
+    int                 result      = COAP_OK;
+    int                 length      = 0;
+    struct sockaddr_in  server_info;
+    FITCoapExchange    *pExchange   = (FITCoapExchange *) malloc(sizeof(FITCoapExchange));
+
+    pBody[0] = '\0';
+    *pStatus = 0;
+
+    if (!iniche_net_ready)
+    {
+        free(pExchange);
+        return FITErrorNoNetwork;
+    }
+
+    if (pExchange == NULL)
+    {
+        perror("CoapExchange malloc failed");
+        return FITErrorSocket;
+    }
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        perror("Couldn't open socket");
+        free(pExchange);
+        return FITErrorSocket;
+    }
+
+    bzero(&server_info, sizeof(server_info));
+    server_info.sin_family      = AF_INET;
+    server_info.sin_port        = htons(FIT_COAP_PORT);
+    server_info.sin_addr.s_addr = resolverGetAddress();
+
+    coap_init_message(&pExchange->request, CoapTypeConfirmable, method);
+    strncpy(pExchange->request.pUriPath, pPath, COAP_MAX_URI_SIZE - 1);
+    if (pPayload)
+    {
+        pExchange->request.contentFormat = COAP_FORMAT_JSON;
+        pExchange->request.pPayload      = (const unsigned char *) pPayload;
+        pExchange->request.payloadLength = strlen(pPayload);
+    }
+
+    result = coap_exchange(fd,
+                           &server_info,
+                           sizeof(server_info),
+                           &pExchange->request,
+                           pExchange->pBuffer,
+                           sizeof(pExchange->pBuffer),
+                           &pExchange->response,
+                           FIT_REQUEST_TIMEOUT_MS);
+    close(fd);
+
+    switch (result)
+    {
+    case COAP_OK:
+        *pStatus = COAP_CODE_TO_HTTP(pExchange->response.code);
+        length   = MIN(pExchange->response.payloadLength, bodySize - 1);
+        memcpy(pBody, pExchange->response.pPayload, length);
+        pBody[length] = '\0';
+        break;
+
+    case COAP_ERR_TIMEOUT:  error = FITErrorSlowResponse;   break;
+    case COAP_ERR_RESET:    error = FITErrorConnectFailed;  break;
+    default:                error = FITErrorSendFailed;     break;
+    }
+
+    if (error != FITErrorNone)
+    {
+        printf("CoAP request failed: %s\n", transport_error_string(error));
+    }
+
+    free(pExchange);
+    return error;
+} // coap_call
+#endif
+
 /*****************************************************************************/
 /* End of File                                                               */
 /*****************************************************************************/
@@ -12,9 +12,26 @@
 /*****************************************************************************/
 
 #define FIT_PORT            80
-#define FIT_IP_ADDR         "13.56.5.40"
+#define FIT_HOST_NAME       "ec2-13-56-5-40.us-west-1.compute.amazonaws.com"
+#define FIT_IP_ADDR         "13.56.5.40"    // Until FIT_HOST_NAME first resolves
 #define FIT_MAX_HTTP_SIZE   500000
 #define FIT_MAX_BODY_SIZE   1000
+#define FIT_PIPELINE_DEPTH  8       // Most requests add_items sends back to back
+
+// Build with -DFIT_TRANSPORT_COAP=1 to send barcode lookups, adds and
+// removes as CoAP over UDP (coap.h) instead of HTTP. Audio and inventory
+// sync don't fit in one datagram and always use HTTP.
+#ifndef FIT_TRANSPORT_COAP
+#define FIT_TRANSPORT_COAP  0
+#endif
+#define FIT_COAP_PORT       5683
+
+// Requests fail rather than wait past these, see transport.h
+#define FIT_CONNECT_TIMEOUT_MS      3000
+#define FIT_REQUEST_TIMEOUT_MS      8000
+#define FIT_AUDIO_TIMEOUT_MS        20000   // Upload plus speech recognition
+#define FIT_PRECONNECT_TIMEOUT_MS   10000   // Unused pre-connections are dropped
+#define FIT_PRECONNECT_TICKS        ((FIT_PRECONNECT_TIMEOUT_MS * OS_TICKS_PER_SEC) / 1000)
 
 /*****************************************************************************/
 /* Structures                                                                */
@@ -27,6 +44,15 @@ typedef struct _FITRequest
     char pBody[FIT_MAX_BODY_SIZE];
 } FITRequest;
 
+// One change in a batch given to add_items
+typedef struct _FITBatchItem
+{
+    char   *pItemString;
+    int     amount;
+    int     httpStatus;     // As add_item_ex reports it, FITErrorNotSent if
+                            // left unsent after an earlier item failed
+} FITBatchItem;
+
 /*****************************************************************************/
 /* Functions                                                                 */
 /*****************************************************************************/
@@ -37,7 +63,12 @@ int translate_audio(char *pAudioRecording,
                     long  audioLengthBytes,
                     char *pItemString);
 int add_item(char *pItemString, int amount);
+int add_item_ex(char *pItemString, int amount, int *pHttpStatus);
+int add_items(FITBatchItem *pItems, int count);
 int remove_item(char *pItemString);
+int get_inventory_changes(unsigned long since, char *pBody, int bodySize);
+int client_preconnect();
+void client_expire_preconnect();
 
 /*****************************************************************************/
 /* End of File                                                               */
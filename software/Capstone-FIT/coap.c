@@ -0,0 +1,674 @@
+/** @file   coap.c
+ *  @brief  Routines for the compact UDP (CoAP) transport
+ *
+ *  Encodes and decodes the CoAP subset in coap.h and runs one confirmable
+ *  request/response exchange over a UDP socket. Retransmission follows RFC
+ *  7252: the request is resent with the same Message ID after
+ *  COAP_ACK_TIMEOUT_MS, doubling each time, up to COAP_MAX_RETRANSMIT times.
+ *  The server uses the Message ID to drop duplicates, and replies that don't
+ *  match the outstanding Message ID or token (late duplicates of earlier
+ *  exchanges) are ignored here.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ALT_INICHE
+#include "ipport.h"
+#include "tcpport.h"
+#include "includes.h"
+typedef int coap_socklen_t;
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+typedef socklen_t coap_socklen_t;
+
+// Host tests make one request at a time
+typedef unsigned int OS_CPU_SR;
+#define OS_ENTER_CRITICAL()     ((void) cpu_sr)
+#define OS_EXIT_CRITICAL()
+#endif
+
+#include "coap.h"
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static unsigned long    now_ms();
+static unsigned long    next_token();
+static unsigned char*   put_option(unsigned char       *pPosition,
+                                   unsigned char       *pEnd,
+                                   int                 *pLastNumber,
+                                   int                  number,
+                                   const unsigned char *pValue,
+                                   int                  length);
+static unsigned char*   put_segments(unsigned char *pPosition,
+                                     unsigned char *pEnd,
+                                     int           *pLastNumber,
+                                     int            number,
+                                     const char    *pValue,
+                                     char           separator);
+static void             append_segment(char                *pString,
+                                       const unsigned char *pValue,
+                                       int                  length,
+                                       char                 separator);
+static int              send_empty_ack(int             fd,
+                                       const void     *pServer,
+                                       int             serverLength,
+                                       unsigned short  messageId);
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static unsigned short   message_id  = 0;
+static unsigned long    token_count = 0;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Reset a message to an empty request or response
+ *
+ * @param[inout]  pMessage  Message to reset
+ * @param[in]     type      Message type
+ * @param[in]     code      Method or response code
+ */
+void
+coap_init_message(CoapMessage *pMessage, CoapType type, unsigned char code)
+{
+    memset(pMessage, 0, sizeof(CoapMessage));
+    pMessage->type          = type;
+    pMessage->code          = code;
+    pMessage->contentFormat = -1;
+} // coap_init_message
+
+/*****************************************************************************/
+
+/**
+ * @brief      Get a fresh Message ID. Safe to call from any task.
+ *
+ * @return     Message ID, never 0
+ */
+unsigned short
+coap_next_message_id()
+{
+    OS_CPU_SR       cpu_sr  = 0;
+    unsigned short  seed    = (unsigned short) now_ms();
+    unsigned short  id      = 0;
+
+    OS_ENTER_CRITICAL();
+    // Start somewhere different each boot so a restarted client isn't
+    // mistaken for a retransmission of its previous life
+    if (message_id == 0)
+    {
+        message_id = seed;
+    }
+
+    if (++message_id == 0)
+    {
+        message_id = 1;
+    }
+    id = message_id;
+    OS_EXIT_CRITICAL();
+
+    return id;
+} // coap_next_message_id
+
+/*****************************************************************************/
+
+/**
+ * @brief      Encode a message
+ *
+ * @param[in]     pMessage  Message to encode
+ * @param[inout]  pBuffer   Buffer for the datagram, pre-allocated by caller
+ * @param[in]     size      Size of pBuffer
+ *
+ * @return     Length of the datagram, -1 if it does not fit
+ */
+int
+coap_encode(const CoapMessage *pMessage, unsigned char *pBuffer, int size)
+{
+    unsigned char  *pPosition   = pBuffer;
+    unsigned char  *pEnd        = pBuffer + size;
+    int             lastNumber  = 0;
+    unsigned char   format[2];
+    int             formatLength = 0;
+
+    if ((size < 4 + pMessage->tokenLength) ||
+        (pMessage->tokenLength > COAP_MAX_TOKEN_LENGTH))
+    {
+        return -1;
+    }
+
+    *pPosition++ = (COAP_VERSION << 6) | (pMessage->type << 4) | pMessage->tokenLength;
+    *pPosition++ = pMessage->code;
+    *pPosition++ = pMessage->messageId >> 8;
+    *pPosition++ = pMessage->messageId & 0xFF;
+    memcpy(pPosition, pMessage->pToken, pMessage->tokenLength);
+    pPosition += pMessage->tokenLength;
+
+    // Options go out in ascending number order
+    pPosition = put_segments(pPosition, pEnd, &lastNumber, COAP_OPTION_URI_PATH, pMessage->pUriPath, '/');
+    if (pPosition && (pMessage->contentFormat >= 0))
+    {
+        // Unsigned integer options drop leading zero bytes
+        if (pMessage->contentFormat > 0xFF)
+        {
+            format[formatLength++] = pMessage->contentFormat >> 8;
+        }
+        if (pMessage->contentFormat > 0)
+        {
+            format[formatLength++] = pMessage->contentFormat & 0xFF;
+        }
+        pPosition = put_option(pPosition, pEnd, &lastNumber, COAP_OPTION_CONTENT_FORMAT, format, formatLength);
+    }
+    if (pPosition)
+    {
+        pPosition = put_segments(pPosition, pEnd, &lastNumber, COAP_OPTION_URI_QUERY, pMessage->pUriQuery, '&');
+    }
+    if (pPosition == NULL)
+    {
+        return -1;
+    }
+
+    if (pMessage->payloadLength > 0)
+    {
+        if ((pEnd - pPosition) < (1 + pMessage->payloadLength))
+        {
+            return -1;
+        }
+        *pPosition++ = 0xFF;
+        memcpy(pPosition, pMessage->pPayload, pMessage->payloadLength);
+        pPosition += pMessage->payloadLength;
+    }
+
+    return pPosition - pBuffer;
+} // coap_encode
+
+/*****************************************************************************/
+
+/**
+ * @brief      Decode a datagram. The payload is left in the datagram, so
+ *             pBuffer must outlive the message.
+ *
+ * @param[in]     pBuffer   Datagram
+ * @param[in]     length    Length of the datagram
+ * @param[inout]  pMessage  Decoded message
+ *
+ * @return     0 if decoded, -1 if the datagram is not a valid message
+ */
+int
+coap_decode(const unsigned char *pBuffer, int length, CoapMessage *pMessage)
+{
+    const unsigned char    *pPosition   = pBuffer + 4;
+    const unsigned char    *pEnd        = pBuffer + length;
+    int                     number      = 0;
+    int                     delta       = 0;
+    int                     optionLength = 0;
+    int                     index       = 0;
+
+    if ((length < 4) || ((pBuffer[0] >> 6) != COAP_VERSION))
+    {
+        return -1;
+    }
+
+    coap_init_message(pMessage, (CoapType) ((pBuffer[0] >> 4) & 0x3), pBuffer[1]);
+    pMessage->tokenLength = pBuffer[0] & 0xF;
+    pMessage->messageId   = (pBuffer[2] << 8) | pBuffer[3];
+    if ((pMessage->tokenLength > COAP_MAX_TOKEN_LENGTH) ||
+        ((pEnd - pPosition) < pMessage->tokenLength))
+    {
+        return -1;
+    }
+    memcpy(pMessage->pToken, pPosition, pMessage->tokenLength);
+    pPosition += pMessage->tokenLength;
+
+    while ((pPosition < pEnd) && (*pPosition != 0xFF))
+    {
+        delta        = *pPosition >> 4;
+        optionLength = *pPosition & 0xF;
+        pPosition++;
+
+        // 13 and 14 mean one or two extension bytes follow, 15 is reserved
+        if ((delta == 15) || (optionLength == 15))
+        {
+            return -1;
+        }
+        if (delta == 13)
+        {
+            if (pPosition >= pEnd) return -1;
+            delta = 13 + *pPosition++;
+        }
+        else if (delta == 14)
+        {
+            if ((pEnd - pPosition) < 2) return -1;
+            delta = 269 + ((pPosition[0] << 8) | pPosition[1]);
+            pPosition += 2;
+        }
+        if (optionLength == 13)
+        {
+            if (pPosition >= pEnd) return -1;
+            optionLength = 13 + *pPosition++;
+        }
+        else if (optionLength == 14)
+        {
+            if ((pEnd - pPosition) < 2) return -1;
+            optionLength = 269 + ((pPosition[0] << 8) | pPosition[1]);
+            pPosition += 2;
+        }
+        if ((pEnd - pPosition) < optionLength)
+        {
+            return -1;
+        }
+
+        number += delta;
+        switch (number)
+        {
+        case COAP_OPTION_URI_PATH:
+            append_segment(pMessage->pUriPath, pPosition, optionLength, '/');
+            break;
+
+        case COAP_OPTION_URI_QUERY:
+            append_segment(pMessage->pUriQuery, pPosition, optionLength, '&');
+            break;
+
+        case COAP_OPTION_CONTENT_FORMAT:
+            pMessage->contentFormat = 0;
+            for (index = 0; index < optionLength; index++)
+            {
+                pMessage->contentFormat = (pMessage->contentFormat << 8) | pPosition[index];
+            }
+            break;
+
+        default:
+            break;
+        }
+        pPosition += optionLength;
+    }
+
+    if ((pPosition < pEnd) && (*pPosition == 0xFF))
+    {
+        pPosition++;
+        if (pPosition == pEnd)
+        {
+            return -1;  // Marker with no payload is a format error
+        }
+        pMessage->pPayload      = pPosition;
+        pMessage->payloadLength = pEnd - pPosition;
+    }
+
+    return 0;
+} // coap_decode
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send a confirmable request and wait for its response,
+ *             retransmitting as needed. The request is given a Message ID
+ *             and token if it has none.
+ *
+ * @param[in]     fd            UDP socket
+ * @param[in]     pServer       Server address (struct sockaddr_in)
+ * @param[in]     serverLength  Size of the server address
+ * @param[inout]  pRequest      Request to send
+ * @param[inout]  pBuffer       Buffer for datagrams, pre-allocated by caller;
+ *                              holds the response payload on return
+ * @param[in]     size          Size of pBuffer
+ * @param[inout]  pResponse     Response
+ * @param[in]     timeout_ms    Time allowed for the whole exchange
+ *
+ * @return     COAP_OK if a response arrived, COAP_ERR_* otherwise
+ */
+int
+coap_exchange(int            fd,
+              const void    *pServer,
+              int            serverLength,
+              CoapMessage   *pRequest,
+              unsigned char *pBuffer,
+              int            size,
+              CoapMessage   *pResponse,
+              long           timeout_ms)
+{
+    unsigned char   pDatagram[COAP_MAX_MESSAGE_SIZE];
+    int             requestLength   = 0;
+    int             received        = 0;
+    int             attempts        = 0;
+    int             bAcknowledged   = 0;
+    unsigned long   deadline        = now_ms() + timeout_ms;
+    unsigned long   retransmitAt    = now_ms();
+    unsigned long   ackTimeout      = COAP_ACK_TIMEOUT_MS;
+    unsigned long   token           = 0;
+    long            remaining       = 0;
+    fd_set          read_fds;
+    struct timeval  timeout;
+
+    pRequest->type = CoapTypeConfirmable;
+    if (pRequest->messageId == 0)
+    {
+        pRequest->messageId = coap_next_message_id();
+    }
+    if (pRequest->tokenLength == 0)
+    {
+        token = next_token();
+        pRequest->tokenLength = 4;
+        pRequest->pToken[0]   = token >> 24;
+        pRequest->pToken[1]   = token >> 16;
+        pRequest->pToken[2]   = token >> 8;
+        pRequest->pToken[3]   = token;
+    }
+
+    requestLength = coap_encode(pRequest, pDatagram, sizeof(pDatagram));
+    if (requestLength < 0)
+    {
+        return COAP_ERR_ENCODE;
+    }
+
+    while (1)
+    {
+        // (Re)transmit until the server acknowledges the request
+        if (!bAcknowledged && ((long) (now_ms() - retransmitAt) >= 0))
+        {
+            if (attempts > COAP_MAX_RETRANSMIT)
+            {
+                return COAP_ERR_TIMEOUT;
+            }
+            if (sendto(fd, (char *) pDatagram, requestLength, 0,
+                       (struct sockaddr *) pServer, serverLength) < 0)
+            {
+                return COAP_ERR_SOCKET;
+            }
+            retransmitAt = now_ms() + ackTimeout;
+            ackTimeout  *= 2;
+            attempts++;
+        }
+
+        remaining = (long) ((bAcknowledged ? deadline : retransmitAt) - now_ms());
+        if ((long) (deadline - now_ms()) <= 0)
+        {
+            return COAP_ERR_TIMEOUT;
+        }
+        if (remaining > (long) (deadline - now_ms()))
+        {
+            remaining = (long) (deadline - now_ms());
+        }
+        if (remaining <= 0)
+        {
+            continue;
+        }
+
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+        timeout.tv_sec  = remaining / 1000;
+        timeout.tv_usec = (remaining % 1000) * 1000;
+        if (select(fd + 1, &read_fds, NULL, NULL, &timeout) <= 0)
+        {
+            continue;
+        }
+
+        received = recvfrom(fd, (char *) pBuffer, size, 0, NULL, NULL);
+        if ((received <= 0) || (coap_decode(pBuffer, received, pResponse) != 0))
+        {
+            continue;
+        }
+
+        if (pResponse->messageId == pRequest->messageId)
+        {
+            if (pResponse->type == CoapTypeReset)
+            {
+                return COAP_ERR_RESET;
+            }
+            if ((pResponse->type == CoapTypeAcknowledgement) &&
+                (pResponse->code == 0))
+            {
+                bAcknowledged = 1;
+                continue;               // Empty ACK, response follows
+            }
+            // A piggybacked response must also carry the request's token
+            // (RFC 7252, 5.3.2), else it answers an older use of the ID
+            if ((pResponse->type == CoapTypeAcknowledgement) &&
+                (pResponse->tokenLength == pRequest->tokenLength) &&
+                (memcmp(pResponse->pToken, pRequest->pToken, pRequest->tokenLength) == 0))
+            {
+                return COAP_OK;         // Piggybacked response
+            }
+        }
+
+        // Separate response, matched on token
+        if (((pResponse->type == CoapTypeConfirmable) ||
+             (pResponse->type == CoapTypeNonConfirmable)) &&
+            (pResponse->code != 0) &&
+            (pResponse->tokenLength == pRequest->tokenLength) &&
+            (memcmp(pResponse->pToken, pRequest->pToken, pRequest->tokenLength) == 0))
+        {
+            if (pResponse->type == CoapTypeConfirmable)
+            {
+                send_empty_ack(fd, pServer, serverLength, pResponse->messageId);
+            }
+            return COAP_OK;
+        }
+
+        // Anything else is a stray or duplicate from an older exchange
+    }
+} // coap_exchange
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Milliseconds from an arbitrary fixed point
+ *
+ * @return     Current time in milliseconds
+ */
+static unsigned long
+now_ms()
+{
+#ifdef ALT_INICHE
+    return (unsigned long) (((unsigned long long) OSTimeGet() * 1000) / OS_TICKS_PER_SEC);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+#endif
+} // now_ms
+
+/*****************************************************************************/
+
+/**
+ * @brief      Get a fresh request token. Safe to call from any task.
+ *
+ * @return     Token, the low 32 bits go on the wire
+ */
+static unsigned long
+next_token()
+{
+    OS_CPU_SR       cpu_sr  = 0;
+    unsigned long   token   = 0;
+
+    OS_ENTER_CRITICAL();
+    token = ++token_count;
+    OS_EXIT_CRITICAL();
+
+    return token;
+} // next_token
+
+/*****************************************************************************/
+
+/**
+ * @brief      Write one option
+ *
+ * @param[in]     pPosition    Where to write
+ * @param[in]     pEnd         End of the buffer
+ * @param[inout]  pLastNumber  Number of the previous option
+ * @param[in]     number       Option number
+ * @param[in]     pValue       Option value
+ * @param[in]     length       Length of the value
+ *
+ * @return     Position after the option, NULL if it does not fit
+ */
+static unsigned char*
+put_option(unsigned char       *pPosition,
+           unsigned char       *pEnd,
+           int                 *pLastNumber,
+           int                  number,
+           const unsigned char *pValue,
+           int                  length)
+{
+    int             delta           = number - *pLastNumber;
+    unsigned char  *pHeader         = pPosition++;
+    int             deltaNibble     = delta;
+    int             lengthNibble    = length;
+
+    if ((pEnd - pPosition) < (4 + length))
+    {
+        return NULL;
+    }
+
+    if (delta >= 269)
+    {
+        deltaNibble  = 14;
+        *pPosition++ = (delta - 269) >> 8;
+        *pPosition++ = (delta - 269) & 0xFF;
+    }
+    else if (delta >= 13)
+    {
+        deltaNibble  = 13;
+        *pPosition++ = delta - 13;
+    }
+
+    if (length >= 269)
+    {
+        lengthNibble = 14;
+        *pPosition++ = (length - 269) >> 8;
+        *pPosition++ = (length - 269) & 0xFF;
+    }
+    else if (length >= 13)
+    {
+        lengthNibble = 13;
+        *pPosition++ = length - 13;
+    }
+
+    *pHeader = (deltaNibble << 4) | lengthNibble;
+    memcpy(pPosition, pValue, length);
+    *pLastNumber = number;
+
+    return pPosition + length;
+} // put_option
+
+/*****************************************************************************/
+
+/**
+ * @brief      Write a separated string (eg. a path) as repeated options
+ *
+ * @param[in]     pPosition    Where to write
+ * @param[in]     pEnd         End of the buffer
+ * @param[inout]  pLastNumber  Number of the previous option
+ * @param[in]     number       Option number
+ * @param[in]     pValue       String to split
+ * @param[in]     separator    Character between segments
+ *
+ * @return     Position after the options, NULL if they do not fit
+ */
+static unsigned char*
+put_segments(unsigned char *pPosition,
+             unsigned char *pEnd,
+             int           *pLastNumber,
+             int            number,
+             const char    *pValue,
+             char           separator)
+{
+    const char *pSegmentEnd = NULL;
+
+    while (pPosition && *pValue)
+    {
+        pSegmentEnd = strchr(pValue, separator);
+        if (pSegmentEnd == NULL)
+        {
+            pSegmentEnd = pValue + strlen(pValue);
+        }
+
+        if (pSegmentEnd != pValue)
+        {
+            pPosition = put_option(pPosition, pEnd, pLastNumber, number,
+                                   (const unsigned char *) pValue,
+                                   pSegmentEnd - pValue);
+        }
+
+        pValue = (*pSegmentEnd) ? pSegmentEnd + 1 : pSegmentEnd;
+    }
+
+    return pPosition;
+} // put_segments
+
+/*****************************************************************************/
+
+/**
+ * @brief      Append an option value to a separated string, truncating at
+ *             COAP_MAX_URI_SIZE
+ *
+ * @param[inout]  pString    String to append to
+ * @param[in]     pValue     Option value
+ * @param[in]     length     Length of the value
+ * @param[in]     separator  Character between segments
+ */
+static void
+append_segment(char                *pString,
+               const unsigned char *pValue,
+               int                  length,
+               char                 separator)
+{
+    int used = strlen(pString);
+
+    if (used && (used < COAP_MAX_URI_SIZE - 1))
+    {
+        pString[used++] = separator;
+    }
+    if (length > (COAP_MAX_URI_SIZE - 1 - used))
+    {
+        length = COAP_MAX_URI_SIZE - 1 - used;
+    }
+    memcpy(pString + used, pValue, length);
+    pString[used + length] = '\0';
+} // append_segment
+
+/*****************************************************************************/
+
+/**
+ * @brief      Acknowledge a confirmable separate response
+ *
+ * @param[in]  fd            UDP socket
+ * @param[in]  pServer       Server address
+ * @param[in]  serverLength  Size of the server address
+ * @param[in]  messageId     Message ID of the response
+ *
+ * @return     Result of sendto
+ */
+static int
+send_empty_ack(int fd, const void *pServer, int serverLength, unsigned short messageId)
+{
+    unsigned char pAck[4];
+
+    pAck[0] = (COAP_VERSION << 6) | (CoapTypeAcknowledgement << 4);
+    pAck[1] = 0;
+    pAck[2] = messageId >> 8;
+    pAck[3] = messageId & 0xFF;
+
+    return sendto(fd, (char *) pAck, sizeof(pAck), 0,
+                  (struct sockaddr *) pServer, serverLength);
+} // send_empty_ack
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,113 @@
+/** @file   coap.h
+ *  @brief  Public facing routines for the compact UDP (CoAP) transport
+ *
+ *  A small subset of CoAP (RFC 7252): confirmable requests with
+ *  retransmission, piggybacked or separate responses, Uri-Path, Uri-Query
+ *  and Content-Format options. No OS dependencies besides sockets, so the
+ *  host test project builds it too.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __COAP_H
+#define __COAP_H
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define COAP_PORT                   5683
+#define COAP_VERSION                1
+#define COAP_MAX_MESSAGE_SIZE       1152    // RFC 7252 section 4.6
+#define COAP_MAX_TOKEN_LENGTH       8
+#define COAP_MAX_URI_SIZE           256
+#define COAP_ACK_TIMEOUT_MS         2000
+#define COAP_MAX_RETRANSMIT         4
+
+// Method codes
+#define COAP_GET                    1
+#define COAP_POST                   2
+#define COAP_PUT                    3
+#define COAP_DELETE                 4
+
+// Response codes are class.detail packed as (class << 5) | detail
+#define COAP_CODE(c, d)             (((c) << 5) | (d))
+#define COAP_CODE_CLASS(code)       ((code) >> 5)
+#define COAP_CODE_DETAIL(code)      ((code) & 0x1F)
+#define COAP_CODE_TO_HTTP(code)     (COAP_CODE_CLASS(code) * 100 + COAP_CODE_DETAIL(code))
+
+// Options used
+#define COAP_OPTION_URI_PATH        11
+#define COAP_OPTION_CONTENT_FORMAT  12
+#define COAP_OPTION_URI_QUERY       15
+
+#define COAP_FORMAT_TEXT            0
+#define COAP_FORMAT_JSON            50
+
+// coap_exchange results
+#define COAP_OK                     0
+#define COAP_ERR_SOCKET             -1
+#define COAP_ERR_TIMEOUT            -2
+#define COAP_ERR_RESET              -3
+#define COAP_ERR_ENCODE             -4
+
+/*****************************************************************************/
+/* Enumerations                                                              */
+/*****************************************************************************/
+
+typedef enum _CoapType
+{
+    CoapTypeConfirmable     = 0,
+    CoapTypeNonConfirmable  = 1,
+    CoapTypeAcknowledgement = 2,
+    CoapTypeReset           = 3
+} CoapType;
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _CoapMessage;
+
+typedef struct _CoapMessage
+{
+    CoapType                type;
+    unsigned char           code;
+    unsigned short          messageId;
+    unsigned char           pToken[COAP_MAX_TOKEN_LENGTH];
+    int                     tokenLength;
+    int                     contentFormat;  // -1 if absent
+    char                    pUriPath[COAP_MAX_URI_SIZE];    // "a/b/c"
+    char                    pUriQuery[COAP_MAX_URI_SIZE];   // "x=1&y=2"
+    const unsigned char    *pPayload;
+    int                     payloadLength;
+} CoapMessage;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+void            coap_init_message(CoapMessage *pMessage,
+                                  CoapType     type,
+                                  unsigned char code);
+unsigned short  coap_next_message_id();
+int             coap_encode(const CoapMessage *pMessage,
+                            unsigned char     *pBuffer,
+                            int                size);
+int             coap_decode(const unsigned char *pBuffer,
+                            int                  length,
+                            CoapMessage         *pMessage);
+int             coap_exchange(int                 fd,
+                              const void         *pServer,
+                              int                 serverLength,
+                              CoapMessage        *pRequest,
+                              unsigned char      *pBuffer,
+                              int                 size,
+                              CoapMessage        *pResponse,
+                              long                timeout_ms);
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __COAP_H
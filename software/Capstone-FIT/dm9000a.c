@@ -1,11 +1,16 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
+#include "altera_avalon_timer_regs.h"
 #include "dm9000a.h"
 #include "dm9000a_regs.h"
 #include "basic_io.h"
 #include <ether.h>
 
 dm9000a_dev g_dm9ka;
-int autoReset = 0;
+static OS_STK rx_task_stk[DM9000A_RX_TASK_STACKSIZE];
 
 #define DM9KA dm9000a_dev*
 
@@ -14,6 +19,109 @@ int dm9ka_init(int iface);
 int dm9ka_pkt_send(PACKET pkt);
 int dm9ka_close(int iface);
 
+#if BURST_NOPS > 0
+#define BURST_DELAY() \
+  do { int n; for (n = 0; n < BURST_NOPS; n++) __asm__ volatile ("nop"); } while (0)
+#else
+#define BURST_DELAY()
+#endif
+
+/* CPU cycles from the system clock timer: whole ticks plus the snapshot of
+   its down counter. Only differences are meaningful. */
+static alt_u32 dm9000a_cycles(void)
+{
+  alt_irq_context context;
+  alt_u32 ticks, count;
+
+  context = alt_irq_disable_all();
+  ticks = alt_nticks();
+  IOWR_ALTERA_AVALON_TIMER_SNAPL(TIMER_BASE, 0);
+  count = IORD_ALTERA_AVALON_TIMER_SNAPL(TIMER_BASE) |
+          (IORD_ALTERA_AVALON_TIMER_SNAPH(TIMER_BASE) << 16);
+  /* the counter has wrapped but the tick interrupt, held off while we run
+     with interrupts disabled, hasn't counted it yet */
+  if ((IORD_ALTERA_AVALON_TIMER_STATUS(TIMER_BASE) & ALTERA_AVALON_TIMER_STATUS_TO_MSK) &&
+      (count > TIMER_LOAD_VALUE / 2))
+    ticks++;
+  alt_irq_enable_all(context);
+
+  return ticks * (TIMER_LOAD_VALUE + 1) + (TIMER_LOAD_VALUE - count);
+}
+
+/* Register accesses go through dm9000a_iow()/dm9000a_ior() and keep the
+   settling delay after the index write. Packet data is moved with the burst
+   routines below once MWCMD/MRCMD is selected; the chip steps its SRAM
+   pointer on every data port access, so no delay is needed between words.
+   The Nios II is little endian, so an aligned halfword load/store matches
+   the chip's low byte first word order. */
+
+static void dm9000a_write_burst(const unsigned char *data_ptr, unsigned int len)
+{
+  unsigned int words = (len + 1) >> 1;
+
+  if (((u_long)data_ptr & 1) == 0) {
+    const unsigned short *p = (const unsigned short *)data_ptr;
+    while (words >= 4) {
+      IOWR(DM9000A_INST_BASE, IO_data, p[0]); BURST_DELAY();
+      IOWR(DM9000A_INST_BASE, IO_data, p[1]); BURST_DELAY();
+      IOWR(DM9000A_INST_BASE, IO_data, p[2]); BURST_DELAY();
+      IOWR(DM9000A_INST_BASE, IO_data, p[3]); BURST_DELAY();
+      p += 4;
+      words -= 4;
+    }
+    while (words--) {
+      IOWR(DM9000A_INST_BASE, IO_data, *p++);
+      BURST_DELAY();
+    }
+  } else {
+    while (words--) {
+      IOWR(DM9000A_INST_BASE, IO_data, (data_ptr[1]<<8)|data_ptr[0]);
+      data_ptr += 2;
+      BURST_DELAY();
+    }
+  }
+}
+
+static void dm9000a_read_burst(unsigned char *data_ptr, unsigned int len)
+{
+  unsigned int words = (len + 1) >> 1;
+  unsigned int tmp;
+
+  if (((u_long)data_ptr & 1) == 0) {
+    unsigned short *p = (unsigned short *)data_ptr;
+    while (words >= 4) {
+      p[0] = IORD(DM9000A_INST_BASE, IO_data); BURST_DELAY();
+      p[1] = IORD(DM9000A_INST_BASE, IO_data); BURST_DELAY();
+      p[2] = IORD(DM9000A_INST_BASE, IO_data); BURST_DELAY();
+      p[3] = IORD(DM9000A_INST_BASE, IO_data); BURST_DELAY();
+      p += 4;
+      words -= 4;
+    }
+    while (words--) {
+      *p++ = IORD(DM9000A_INST_BASE, IO_data);
+      BURST_DELAY();
+    }
+  } else {
+    while (words--) {
+      tmp = IORD(DM9000A_INST_BASE, IO_data);
+      *data_ptr++ = tmp & 0xFF;
+      *data_ptr++ = (tmp>>8) & 0xFF;
+      BURST_DELAY();
+    }
+  }
+}
+
+/* dump a packet from RX SRAM */
+static void dm9000a_skip_burst(unsigned int len)
+{
+  unsigned int words = (len + 1) >> 1;
+
+  while (words--) {
+    (void)IORD(DM9000A_INST_BASE, IO_data);
+    BURST_DELAY();
+  }
+}
+
 
 void dm9000a_iow(unsigned int reg, unsigned int data)
 {
@@ -46,6 +154,39 @@ void phy_write(unsigned int reg, unsigned int value)
   usleep(50);  /* wait 1~30 us (>20 us) for PHY + WRITE completion */
 }
 
+unsigned int phy_read(unsigned int reg)
+{
+  unsigned int i;
+
+  /* set PHY register address into EPAR REG. 0CH */
+  dm9000a_iow(0x0C, reg | 0x40);
+
+  /* issue PHY + READ command = 0xc into EPCR REG. 0BH, then wait for
+     ERRE Bit [0] to drop (1~30 us) */
+  dm9000a_iow(0x0B, 0x0C);
+  for (i = 0; i < 50 && (dm9000a_ior(0x0B) & 0x01); i++)
+    usleep(1);
+  dm9000a_iow(0x0B, 0x08);                    /* clear PHY command */
+
+  /* PHY data from EPDR REG. 0EH & REG. 0DH */
+  return (dm9000a_ior(0x0E) << 8) | dm9000a_ior(0x0D);
+}
+
+/* Poll a PHY register until (value & mask) == match, for at most timeout
+   us. Returns 0 when it matched. */
+static int phy_wait(unsigned int reg, unsigned int mask, unsigned int match,
+                    unsigned int timeout)
+{
+  unsigned int waited;
+
+  for (waited = 0; waited < timeout; waited += 100) {
+    if ((phy_read(reg) & mask) == match)
+      return 0;
+    usleep(100);
+  }
+  return (phy_read(reg) & mask) == match ? 0 : -1;
+}
+
 /* DM9000_init I/O routine */
 unsigned int dm9000a_reset(unsigned char *mac_address)
 {
@@ -55,7 +196,8 @@ unsigned int dm9000a_reset(unsigned char *mac_address)
                     		       GPIO0 "output" port for internal PHY */
   dm9000a_iow(0x1F, 0x00);  // GPR  REG. 1FH GEPIO0
                     		    //   Bit [0] = 0 to activate internal PHY */
-  msleep(10);                // wait > 2 ms for PHY power-up ready 
+  phy_wait(2, 0xFFFF, PHY_ID1, PHY_UP_TIMEOUT); /* wait for PHY power-up ready,
+                                                   > 2 ms at most */
 
   /* software-RESET NIC */
   dm9000a_iow(NCR, 0x03);   /* NCR REG. 00 RST Bit [0] = 1 reset on,
@@ -75,12 +217,14 @@ unsigned int dm9000a_reset(unsigned char *mac_address)
   /* set GPIO0=1 then GPIO0=0 to turn off and on the internal PHY */
   dm9000a_iow(0x1F, 0x01);  // GPR PHYPD Bit [0] = 1 turn-off PHY */
   dm9000a_iow(0x1F, 0x00);  // PHYPD Bit [0] = 0 activate phyxcer */
-  msleep(20);               /* wait >4 ms for PHY power-up */
+  phy_wait(2, 0xFFFF, PHY_ID1, PHY_UP_TIMEOUT); /* wait for PHY power-up,
+                                                   > 4 ms at most */
 
   /* set PHY operation mode */
 
   phy_write(0,PHY_reset);   /* reset PHY registers back to the default state */
-  usleep(50);               /* wait >30 us for PHY software-RESET ok */
+  phy_wait(0, PHY_reset, 0, PHY_RST_TIMEOUT); /* wait for PHY software-RESET
+                                                 to self-clear */
   phy_write(16, 0x404);     /* turn off PHY reduce-power-down mode only */
   phy_write(4, PHY_txab);   /* set PHY TX advertised ability:
                    			       ALL + Flow_control */  
@@ -88,8 +232,7 @@ unsigned int dm9000a_reset(unsigned char *mac_address)
                                (RESTART_AUTO_NEGOTIATION +
                                AUTO_NEGOTIATION_ENABLE)
                                to auto sense and recovery PHY registers */
-  msleep(20);                /* wait >2 ms for PHY auto-sense
-			                         linking to partner */
+  /* autonegotiation carries on in the PHY, dm9ka_init() waits for the link */
 
   /* store MAC address into NIC */
   for (i = 0; i < 6; i++) 
@@ -118,61 +261,137 @@ unsigned int dm9000a_reset(unsigned char *mac_address)
 
   /* set other registers depending on applications */
   dm9000a_iow(ETXCSR, ETXCSR_set); /* Early Transmit 75% */
+  dm9000a_iow(TCSCR, TCSCR_set);   /* TCP checksums on TX */
+  dm9000a_iow(RCSCSR, RCSCSR_set); /* checksum status on RX */
 
   /* enable interrupts to activate DM9000 ~on */
   dm9000a_iow(IMR, INTR_set);   /* IMR REG. FFH PAR=1 only,
 			                             or + PTM=1& PRM=1 enable RxTx interrupts */
 
-  /* enable RX (Broadcast/ ALL_MULTICAST) ~go */
-  dm9000a_iow(RCR, RCR_set | RX_ENABLE | PASS_MULTICAST);
+  /* enable RX (Broadcast/ multicast through the MAR hash) ~go */
+  dm9000a_iow(RCR, RCR_set | RX_ENABLE);
   /* RCR REG. 05 RXEN Bit [0] = 1 to enable the RX machine/ filter */
 
   /* RETURN "DEVICE_SUCCESS" back to upper layer */
   return  (dm9000a_ior(0x2D)==0x80) ? DMFE_SUCCESS : DMFE_FAIL;
 }
 
-unsigned int TransmitPacket(unsigned char *data_ptr, unsigned int tx_len)
+/* issue TX packet's length into TXPLH REG. FDH & TXPLL REG. FCH and start
+   sending the frame that was copied to the chip first */
+static void dm9000a_tx_start(unsigned int tx_len)
 {
-  unsigned int i;
-  
-  /* mask NIC interrupts IMR: PAR only */
-  dm9000a_iow(IMR, PAR_set);
-
-  /* issue TX packet's length into TXPLH REG. FDH & TXPLL REG. FCH */
   dm9000a_iow(0xFD, (tx_len >> 8) & 0xFF);  /* TXPLH High_byte length */
   dm9000a_iow(0xFC, tx_len & 0xFF);         /* TXPLL Low_byte  length */
+  dm9000a_iow(TCR, TCR_set | TX_REQUEST);   /* TXCR Bit [0] TXREQ auto clear
+                                               after TX completed */
+}
 
-  /* wirte transmit data to chip SRAM */
-  IOWR(DM9000A_INST_BASE, IO_addr, MWCMD);  /* set MWCMD REG. F8H
-					  TX I/O port ready */
-  for (i = 0; i < tx_len; i += 2) {
-    usleep(STD_DELAY);
-    IOWR(DM9000A_INST_BASE, IO_data, (data_ptr[i+1]<<8)|data_ptr[i] );
-  }
+/* Copy a frame into the next free TX SRAM slot. The chip holds two frames:
+   the first is started right away, the second waits in SRAM for the
+   PTM interrupt of the first. Called with the NIC interrupt masked, from
+   the RX task or from dm9ka_pkt_send while the RX task is idle. */
+static void dm9000a_tx_load(DM9KA dm9ka, PACKET pkt)
+{
+  unsigned int tx_len = pkt->nb_plen - ETHHDR_BIAS;
+  alt_u32 start = dm9000a_cycles();
+  if (tx_len < 64) tx_len = 64;
 
-  /* issue TX polling command activated */
-  dm9000a_iow(TCR , TCR_set | TX_REQUEST);  /* TXCR Bit [0] TXREQ auto clear
-				       after TX completed */
+  /* write transmit data to chip SRAM */
+  IOWR(dm9ka->regbase, IO_addr, MWCMD);  /* set MWCMD REG. F8H
+                                            TX I/O port ready */
+  usleep(STD_DELAY);
+  dm9000a_write_burst((unsigned char *)pkt->nb_prot + ETHHDR_BIAS, tx_len);
+
+  if (dm9ka->sending++ == 0)
+    dm9000a_tx_start(tx_len);
+  else
+    dm9ka->snd_len = tx_len;
+
+  /* update packet statistics */
+  dm9ka->stats.tx_frames++;
+  dm9ka->stats.tx_bytes += tx_len;
+  dm9ka->stats.tx_copy_cycles += dm9000a_cycles() - start;
+  dm9ka->netp->n_mib->ifOutOctets += (u_long)pkt->nb_plen;
+  if(*pkt->nb_prot & 0x80)
+    dm9ka->netp->n_mib->ifOutNUcastPkts++;
+  else
+    dm9ka->netp->n_mib->ifOutUcastPkts++;
+}
 
-  /* wait for transmit complete */
-  while(!(dm9000a_ior(NSR)&0x0C)) {
-    usleep(STD_DELAY);
+/* fill free TX slots from the send queue */
+static void dm9000a_tx_refill(DM9KA dm9ka)
+{
+  PACKET pkt;
+
+  while ((dm9ka->sending < TX_SLOTS) &&
+         ((pkt = (PACKET)getq(&dm9ka->tosend)) != NULL))
+  {
+    dm9000a_tx_load(dm9ka, pkt);
+    pk_free(pkt);
   }
+}
 
-  /* clear the NSR Register */
-  dm9000a_iow(NSR,0x00);
+/* PTM interrupt, handled in the RX task: a frame has left the chip. Start
+   the one waiting in the other slot and refill the slot just freed. */
+static void dm9000a_tx_done(DM9KA dm9ka)
+{
+  unsigned int tx_status = dm9000a_ior(NSR) & (TX1END | TX2END);
+
+  dm9ka->stats.tx_ints++;
+  if (!tx_status || !dm9ka->sending)
+    return;
+
+  /* clear TX1END/TX2END, by RW/C1 */
+  dm9000a_iow(NSR, tx_status);
 
-  /* re-enable NIC interrupts */
-  dm9000a_iow(IMR, INTR_set);
+  if (--dm9ka->sending)
+    dm9000a_tx_start(dm9ka->snd_len);
 
-  /* RETURN "TX_SUCCESS" to upper layer */
-  return  DMFE_SUCCESS;
+  dm9000a_tx_refill(dm9ka);
 }
 
 #ifndef MTU
 #define MTU 1514
 #endif
 
+#ifdef DM9000A_BENCHMARK
+#define BENCH_FRAMES 200
+
+/* Time copying full size frames into TX SRAM with the old per word sleep
+   and with the burst path, and print frames/s and Mbit/s for each. Nothing
+   is transmitted. Runs before dm9000a_reset(), which puts the SRAM pointers
+   back where they belong. */
+static void dm9000a_bench(void)
+{
+  static unsigned char frame[MTU + 1];
+  unsigned long start, ticks, frames_s, kbits_s;
+  unsigned int  n, i, pass;
+
+  for (pass = 0; pass < 2; pass++) {
+    start = alt_nticks();
+    for (n = 0; n < BENCH_FRAMES; n++) {
+      IOWR(DM9000A_INST_BASE, IO_addr, MWCMD);
+      if (pass == 0) {
+        for (i = 0; i < MTU; i += 2) {
+          usleep(STD_DELAY);
+          IOWR(DM9000A_INST_BASE, IO_data, (frame[i+1]<<8)|frame[i]);
+        }
+      } else {
+        dm9000a_write_burst(frame, MTU);
+      }
+    }
+    ticks = alt_nticks() - start;
+    if (ticks == 0) ticks = 1;
+
+    frames_s = (BENCH_FRAMES * alt_ticks_per_second()) / ticks;
+    kbits_s  = (frames_s * MTU * 8) / 1000;
+    printf("dm9ka %s copy: %lu frames/s, %lu.%03lu Mbit/s\n",
+           pass ? "burst" : "per word sleep",
+           frames_s, kbits_s / 1000, kbits_s % 1000);
+  }
+}
+#endif
+
 int prep_dm9000a(int index)
 {  
   DM9KA dm9ka = &g_dm9ka;
@@ -200,6 +419,7 @@ int prep_dm9000a(int index)
 #else
   ifp->n_flags |= NF_NBPROT;
 #endif
+  ifp->n_flags |= (NF_CSUM_TX | NF_CSUM_RX);  /* TCSCR_set/RCSCSR_set */
 
   get_mac_addr(dm9ka->netp, dm9ka->mac_addr);
     
@@ -208,12 +428,15 @@ int prep_dm9000a(int index)
   dm9ka->intnum  = DM9000A_INST_IRQ;
   dm9ka->regbase = DM9000A_INST_BASE;
   dm9ka->sending = 0;
-  dm9ka->rx_ints = 0;
-  dm9ka->tx_ints = 0;
+  memset(&dm9ka->stats, 0, sizeof(dm9ka->stats));
   dm9ka->rcv_len = 0;
   dm9ka->snd_len = 0;
   dm9ka->tosend.q_len = 0;
   dm9ka->tosend.q_max = 0;
+  dm9ka->rx_sem = NULL;
+  dm9ka->rx_busy = 0;
+  dm9ka->isr_status = 0;
+  dm9ka->mar_dirty = 0;
   
   ifp->n_local = (void*)dm9ka;
 
@@ -239,88 +462,190 @@ static unsigned char dm9000a_rxReady(DM9KA dm9ka)
   return rv;
 }
 
-static void dm9000a_isr(int iface)
+/* Bit of the 64 bit MAR hash filter a destination address falls in: the
+   low 6 bits of its CRC-32, computed LSB first as the chip does */
+static unsigned int dm9000a_hash(const unsigned char *addr)
+{
+  unsigned long crc = 0xFFFFFFFF;
+  int i, bit;
+
+  for (i = 0; i < 6; i++) {
+    crc ^= addr[i];
+    for (bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+  }
+  return crc & 0x3F;
+}
+
+/* Rebuild the hash filter from the groups the stack has joined on this
+   interface. Broadcast also goes through the filter, so it is always in. */
+static void dm9000a_hash_groups(DM9KA dm9ka)
 {
-  unsigned char rx_rdy, istatus;
-  unsigned int  tmp, rx_sts, i, rx_len;
+  unsigned char addr[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+  unsigned int h;
+
+  memset(dm9ka->mar, 0, sizeof(dm9ka->mar));
+  h = dm9000a_hash(addr);
+  dm9ka->mar[h >> 3] |= 1 << (h & 7);
+
+#ifdef IP_MULTICAST
+  {
+    struct in_multi *inm;
+    u_long group;
+
+    for (inm = dm9ka->netp->mc_list; inm; inm = inm->inm_next) {
+      if (inm->inm_addr) {
+        /* 01:00:5E and the low 23 bits of the group */
+        group = ntohl(inm->inm_addr);
+        addr[0] = 0x01; addr[1] = 0x00; addr[2] = 0x5E;
+        addr[3] = (group >> 16) & 0x7F;
+        addr[4] = (group >> 8) & 0xFF;
+        addr[5] = group & 0xFF;
+      }
+#ifdef IP_V6
+      else {
+        /* 33:33 and the low 32 bits of the group */
+        addr[0] = 0x33; addr[1] = 0x33;
+        memcpy(&addr[2], &inm->ip6addr.addr[12], 4);
+      }
+#else
+      else
+        continue;
+#endif
+      h = dm9000a_hash(addr);
+      dm9ka->mar[h >> 3] |= 1 << (h & 7);
+    }
+  }
+#endif
+}
+
+/* load the hash filter into MAR REG. 16H~1DH */
+static void dm9000a_write_mar(DM9KA dm9ka)
+{
+  int i;
+
+  dm9ka->mar_dirty = 0;
+  for (i = 0; i < 8; i++)
+    dm9000a_iow(MAR + i, dm9ka->mar[i]);
+}
+
+#ifdef IP_MULTICAST
+/* n_mcastlist hook, called by in_addmulti()/in_delmulti() once mc_list has
+   changed. The chip is only touched while the RX task is idle, as in
+   dm9ka_pkt_send(); otherwise the RX task loads the filter. */
+static int dm9ka_mcastlist(struct in_multi *inm)
+{
+  DM9KA dm9ka = (DM9KA)inm->inm_netp->n_local;
+
+  alt_irq_disable(dm9ka->intnum);
+  dm9000a_hash_groups(dm9ka);
+  if (dm9ka->rx_busy)
+    dm9ka->mar_dirty = 1;
+  else
+    dm9000a_write_mar(dm9ka);
+  alt_irq_enable(dm9ka->intnum);
+
+  return 0;
+}
+#endif
+
+/* Pass on what the chip verified about a received frame. rx_rdy is the
+   first byte of the RX header: a protocol bit and, three bits up, whether
+   its checksum failed. Fragments are left to the stack to check. */
+static void dm9000a_rx_csum(PACKET pkt, unsigned int rx_rdy)
+{
+  unsigned char *iph = (unsigned char *)pkt->nb_prot;
+
+  pkt->flags &= ~(PKF_IPCSUM_OK | PKF_L4CSUM_OK);
+  if (!(rx_rdy & RX_IPP) || (rx_rdy & (RX_IPP << 3)))
+    return;
+  pkt->flags |= PKF_IPCSUM_OK;
+
+  if ((iph[6] & 0x3F) || iph[7])  /* more fragments or an offset */
+    return;
+  if (((rx_rdy & RX_TCPP) && !(rx_rdy & (RX_TCPP << 3))) ||
+      ((rx_rdy & RX_UDPP) && !(rx_rdy & (RX_UDPP << 3))))
+    pkt->flags |= PKF_L4CSUM_OK;
+}
+
+/* Copy up to budget frames out of RX SRAM onto the stack's receive queue.
+   Returns the number of frames taken; if that is the whole budget more may
+   be waiting. Runs in the RX task with NIC interrupts masked. */
+static int dm9000a_rx_drain(DM9KA dm9ka, int budget)
+{
+  unsigned char rx_rdy;
+  unsigned int  rx_sts, rx_len;
   struct ethhdr * eth;
   PACKET pkt;
-  DM9KA dm9ka = (DM9KA)nets[iface]->n_local;
-  
-  /* mask NIC interrupts IMR: PAR only */
-  dm9000a_iow(IMR, PAR_set);
-  istatus = dm9000a_ior(ISR);
+  int frames = 0;
 
   rx_rdy = dm9000a_rxReady(dm9ka);  
   usleep(STD_DELAY);
   
-  while(rx_rdy == DM9000_PKT_READY)
+  while((rx_rdy == DM9000_PKT_READY) && (frames < budget))
   {
+    frames++;
+
     /* get RX Status & Length from RX SRAM */
     /* set MRCMD REG. F2H RX I/O port ready */    
     IOWR(dm9ka->regbase, IO_addr, MRCMD); 
     usleep(STD_DELAY);
     rx_sts = IORD(dm9ka->regbase,IO_data);
-    usleep(STD_DELAY);
     rx_len = IORD(dm9ka->regbase,IO_data);
     
     /* Check this packet_status: GOOD or BAD? */
     if( !(rx_sts & 0xBF00) && (rx_len < MAX_PACKET_SIZE) )
     {
-      if ((pkt = pk_alloc(rx_len + ETHHDR_BIAS)) == NULL)   
+      if ((pkt = pk_cache_alloc(&dm9ka->rx_cache, rx_len + ETHHDR_BIAS)) == NULL)
       { /* couldn't get a free buffer for rx */
+        dm9ka->stats.rx_discards++;
         dm9ka->netp->n_mib->ifInDiscards++;
         /* treat packet as bad, dump it from RX SRAM */
-        for (i = 0; i < rx_len; i += 2) {
-          usleep(STD_DELAY);
-          tmp = IORD(dm9ka->regbase, IO_data);
-        }
+        dm9000a_skip_burst(rx_len);
       }
       else
       { /* packet allocation succeeded */
-        unsigned char* data_ptr = pkt->nb_buff + ETHHDR_BIAS;
         /* read 1 received packet from RX SRAM into RX packet buffer */
-        for (i = 0; i < rx_len; i += 2) {
-          usleep(STD_DELAY);
-          tmp = IORD(dm9ka->regbase, IO_data);
-          *data_ptr++ = tmp & 0xFF;
-          *data_ptr++ = (tmp>>8) & 0xFF;
-        }
+        dm9000a_read_burst((unsigned char *)pkt->nb_buff + ETHHDR_BIAS, rx_len);
 
         pkt->nb_prot = pkt->nb_buff + ETHHDR_SIZE;
         pkt->nb_plen = rx_len - 14;
         pkt->nb_tstamp = cticks;
         pkt->net = dm9ka->netp;
+        dm9ka->stats.rx_frames++;
+        dm9ka->stats.rx_bytes += rx_len;
 
         /* set packet type for demux routine */
         eth = (struct ethhdr *)(pkt->nb_buff + ETHHDR_BIAS);
         pkt->type = eth->e_type;
+        if (pkt->type == IP_TYPE)
+          dm9000a_rx_csum(pkt, rx_sts & 0xFF);
 
         /* shove packet into iniche stack's recv queue */
         //printf("rx: 0x%x l %d s %x:%x:%x\n", eth->e_type, rx_len,
         //       eth->e_src[0], eth->e_src[1], eth->e_src[2]);
         putq(&rcvdq, pkt);
-        SignalPktDemux();
       }      
     } else {
       /* this packet is bad, dump it from RX SRAM */
-      for (i = 0; i < rx_len; i += 2) {
-        usleep(STD_DELAY);
-        tmp = IORD(dm9ka->regbase, IO_data);
-      }
+      dm9ka->stats.rx_bad++;
+      dm9ka->netp->n_mib->ifInErrors++;
+      dm9000a_skip_burst(rx_len);
       rx_len = 0;
     }
 
-    usleep(STD_DELAY);
-    rx_rdy = dm9000a_rxReady(dm9ka);
-    usleep(STD_DELAY);    
+    if (frames < budget) {
+      usleep(STD_DELAY);
+      rx_rdy = dm9000a_rxReady(dm9ka);
+      usleep(STD_DELAY);
+    }
   }
   
   if (rx_rdy & 0x02)
   { /* status check first byte: rx_READY Bit[1:0] must be "00"b or "01"b */
     /* software-RESET NIC */
     printf("whoa ... got a strange thing here ... \n");
-    autoReset++;
+    dm9ka->stats.auto_resets++;
     dm9000a_iow(NCR, 0x03);   /* NCR REG. 00 RST Bit [0] = 1 reset on,
                           			 and LBK Bit [2:1] = 01b MAC loopback on */
     usleep(20);               /* wait > 10us for a software-RESET ok */
@@ -344,42 +669,184 @@ static void dm9000a_isr(int iface)
     dm9000a_iow(0x2D, 0x80);      /* Switch LED to mode 1 */
     /* set other registers depending on applications */
     dm9000a_iow(ETXCSR, ETXCSR_set); /* Early Transmit 75% */
-    /* enable interrupts to activate DM9000 ~on */
-    dm9000a_iow(IMR, INTR_set);   /* IMR REG. FFH PAR=1 only,
-			                               or + PTM=1& PRM=1 enable RxTx interrupts */
-    /* enable RX (Broadcast/ ALL_MULTICAST) ~go */
-    dm9000a_iow(RCR , RCR_set | RX_ENABLE | PASS_MULTICAST);
+    dm9000a_iow(TCSCR, TCSCR_set);   /* TCP checksums on TX */
+    dm9000a_iow(RCSCSR, RCSCSR_set); /* checksum status on RX */
+    /* interrupts stay masked, the RX task enables them when it is done */
+    /* enable RX (Broadcast/ multicast through the MAR hash) ~go */
+    dm9000a_write_mar(dm9ka);
+    dm9000a_iow(RCR , RCR_set | RX_ENABLE);
     /* RCR REG. 05 RXEN Bit [0] = 1 to enable the RX machine/ filter */
+
+    /* frames in TX SRAM were lost with the reset, carry on from the queue */
+    dm9ka->sending = 0;
+    dm9000a_tx_refill(dm9ka);
   }
+
+  return frames;
+}
+
+/* Interrupt: only mask and acknowledge the chip, note what happened and
+   wake the RX task. The NIC interrupt stays masked until the task has
+   emptied the chip. */
+static void dm9000a_isr(int iface)
+{
+  unsigned char istatus;
+  DM9KA dm9ka = (DM9KA)nets[iface]->n_local;
+  alt_u32 start = dm9000a_cycles();
+  alt_u32 cycles, us;
+  int bin = 0;
   
-  /* Clear the DM9000A ISR: PRS, PTS, ROS, ROOS 4 bits, by RW/C1 */
-  dm9000a_iow(ISR, 0x3F);  
-  /* Re-enable DM9000A interrupts */
-  dm9000a_iow(IMR, INTR_set);  
+  /* mask NIC interrupts IMR: PAR only */
+  dm9000a_iow(IMR, PAR_set);
+  istatus = dm9000a_ior(ISR);
+  /* acknowledge what we are about to handle, by RW/C1, so events that
+     arrive meanwhile raise the interrupt again */
+  dm9000a_iow(ISR, istatus & 0x3F);
+
+  dm9ka->isr_status |= istatus;
+  dm9ka->rx_busy = 1;
+  if (istatus & 0x01)
+    dm9ka->stats.rx_ints++;
+  OSSemPost(dm9ka->rx_sem);
+
+  cycles = dm9000a_cycles() - start;
+  if (cycles > dm9ka->stats.isr_max_cycles)
+    dm9ka->stats.isr_max_cycles = cycles;
+  us = cycles / (TIMER_FREQ / 1000000);
+  while ((us >>= 1) && (bin < DM9000A_ISR_HIST_BINS - 1))
+    bin++;
+  dm9ka->stats.isr_hist[bin]++;
+}
+
+/* RX task: drains the chip in batches of RX_BUDGET frames, waking the
+   stack once per batch, and finishes any transmit work noted by the ISR.
+   If a whole batch was taken it sleeps a tick before the next, so a flood
+   can't starve lower priority tasks; the chip buffers meanwhile. */
+static void dm9ka_rx_task(void *pdata)
+{
+  DM9KA dm9ka = (DM9KA)pdata;
+  unsigned char istatus, chip_status;
+  int frames;
+  INT8U err;
+
+  while (1)
+  {
+    /* restock while idle, so taking buffers for frames doesn't have to
+       turn interrupts off */
+    pk_cache_fill(&dm9ka->rx_cache);
+    OSSemPend(dm9ka->rx_sem, 0, &err);
+
+    while (1)
+    {
+      alt_irq_disable(dm9ka->intnum);
+      istatus = dm9ka->isr_status;
+      dm9ka->isr_status = 0;
+      alt_irq_enable(dm9ka->intnum);
+
+      /* events raised since then are latched in the chip, not seen by
+         the masked ISR */
+      chip_status = dm9000a_ior(ISR) & 0x3F;
+      dm9000a_iow(ISR, chip_status);
+      istatus |= chip_status;
+
+      if (istatus & PTS)
+        dm9000a_tx_done(dm9ka);
+      if (dm9ka->mar_dirty)
+        dm9000a_write_mar(dm9ka);
+
+      frames = dm9000a_rx_drain(dm9ka, RX_BUDGET);
+      if (frames)
+        SignalPktDemux();
+      if (frames == RX_BUDGET) {
+        pk_cache_fill(&dm9ka->rx_cache);
+        OSTimeDly(1);
+        continue;
+      }
+
+      /* the chip is empty; hand it back to the ISR unless a frame was
+         queued for sending or the filter changed meanwhile */
+      alt_irq_disable(dm9ka->intnum);
+      if (((dm9ka->tosend.q_len == 0) || (dm9ka->sending >= TX_SLOTS)) &&
+          !dm9ka->mar_dirty) {
+        dm9ka->rx_busy = 0;
+        dm9000a_iow(IMR, INTR_set);
+        alt_irq_enable(dm9ka->intnum);
+        break;
+      }
+      alt_irq_enable(dm9ka->intnum);
+      dm9000a_tx_refill(dm9ka);
+    }
+  }
 }
 
 
+
 int netisrs = 0;
 
 void dm9Ka_isr_wrap(void *context, u_long intnum)
 {
   netisrs++;
-  dm9000a_isr((int)context);
+  dm9000a_isr((int)(intptr_t)context);
 }
 
 int dm9ka_init(int iface)
 {
   int err;
+  int waited;
   DM9KA   dm9ka;
   printf("dm9ka_init\n");
 
    /* get pointer to device structure */
   dm9ka = (DM9KA)nets[iface]->n_local;
 
+  /* start the RX task before the chip can interrupt */
+  if (dm9ka->rx_sem == NULL) {
+    dm9ka->rx_sem = OSSemCreate(0);
+    if (dm9ka->rx_sem == NULL)
+      return (ENP_RESOURCE);
+    err = OSTaskCreateExt(dm9ka_rx_task,
+                          dm9ka,
+                          &rx_task_stk[DM9000A_RX_TASK_STACKSIZE-1],
+                          DM9000A_RX_TASK_PRIO,
+                          DM9000A_RX_TASK_PRIO,
+                          rx_task_stk,
+                          DM9000A_RX_TASK_STACKSIZE,
+                          NULL,
+                          0);
+    if (err != OS_NO_ERR)
+      return (ENP_RESOURCE);
+  }
+  dm9ka->isr_status = 0;
+  dm9ka->rx_busy = 0;
+
+#ifdef DM9000A_BENCHMARK
+  dm9000a_bench();
+#endif
+
   err = dm9000a_reset(dm9ka->mac_addr);
 
+  /* only broadcast and the groups the stack joins get through */
+  dm9000a_hash_groups(dm9ka);
+  dm9000a_write_mar(dm9ka);
+#ifdef IP_MULTICAST
+  nets[iface]->n_mcastlist = dm9ka_mcastlist;
+#endif
+
+  /* Autonegotiation takes a second or two, and DHCP starts as soon as we
+     return. Wait for the link rather than a fixed time, sleeping so the
+     application can bring its devices up meanwhile. Frames that arrive
+     wait in RX SRAM until the ISR is registered. */
+  for (waited = 0; waited < LINK_TIMEOUT && !(dm9000a_ior(NSR) & LINKST);
+       waited += LINK_POLL)
+    OSTimeDly(LINK_POLL * OS_TICKS_PER_SEC / 1000);
+  if (dm9000a_ior(NSR) & LINKST)
+    printf("dm9ka link up at %lu ms\n",
+           (unsigned long)(alt_nticks() * 1000ULL / alt_ticks_per_second()));
+  else
+    printf("dm9ka no link after %d ms\n", LINK_TIMEOUT);
+
   /* register the ISR with the ALTERA HAL interface */
-  err = alt_irq_register (dm9ka->intnum, (void *)iface, dm9Ka_isr_wrap);
+  err = alt_irq_register (dm9ka->intnum, (void *)(intptr_t)iface, dm9Ka_isr_wrap);
   if (err)
     return (err);
   
@@ -393,6 +860,7 @@ int dm9ka_init(int iface)
 int dm9ka_close(int iface)
 {
   DM9KA   dm9ka;
+  PACKET  pkt;
   printf("dm9ka_close\n");
   nets[iface]->n_mib->ifAdminStatus = 2;    /* status = down */
   
@@ -412,6 +880,11 @@ int dm9ka_close(int iface)
   dm9000a_iow(IMR,  0x00);  /* no interrupts */
   dm9000a_iow(RCR , 0x00);  /* disable receive */
   dm9000a_iow(0x0F, 0x00);  /* Clear the all Event */
+
+  /* drop frames still waiting to go out */
+  dm9ka->sending = 0;
+  while ((pkt = (PACKET)getq(&dm9ka->tosend)) != NULL)
+    pk_free(pkt);
   
   //s91_port_close(smsc);   /* release the ISR */
   //s91_reset(smsc);        /* reset the chip */
@@ -422,47 +895,57 @@ int dm9ka_close(int iface)
 
 void dm9ka_stats(void * pio, int iface)
 {
-  DM9KA dm9ka;
-  printf("dm9ka_stats\n");
-  dm9ka = (DM9KA)(nets[iface]->n_local);
-
-  /*
-    ns_printf(pio, "Interrupts: rx:%lu, tx:%lu alloc:%lu, total:%lu\n",
-            smsc->rx_ints, smsc->tx_ints, smsc->alloc_ints, smsc->total_ints);
-    ns_printf(pio, "coll1:%lu collx:%lu overrun:%lu mdint:%lu\n",
-            smsc->coll1, smsc->collx, smsc->rx_overrun, smsc->mdint);
-    ns_printf(pio, "Sendq max:%d, current %d. IObase: 0x%lx ISR %d\n", 
-            smsc->tosend.q_max, smsc->tosend.q_len, smsc->regbase, smsc->intnum);
-  */
-  
-  return;
+  DM9KA dm9ka = (DM9KA)(nets[iface]->n_local);
+  dm9000a_stats st;
+  int i;
+
+  dm9000a_get_stats(&st);
+
+  ns_printf(pio, "Interrupts: rx:%lu, tx:%lu, auto resets:%lu\n",
+            st.rx_ints, st.tx_ints, st.auto_resets);
+  ns_printf(pio, "RX frames:%lu bytes:%lu, no buffer:%lu, bad:%lu\n",
+            st.rx_frames, st.rx_bytes, st.rx_discards, st.rx_bad);
+  ns_printf(pio, "TX frames:%lu bytes:%lu, waited for slot:%lu, copy cycles:%lu\n",
+            st.tx_frames, st.tx_bytes, st.tx_queued, st.tx_copy_cycles);
+  ns_printf(pio, "ISR max %lu cycles, us <2:%lu",
+            st.isr_max_cycles, st.isr_hist[0]);
+  for (i = 1; i < DM9000A_ISR_HIST_BINS - 1; i++)
+    ns_printf(pio, " <%d:%lu", 2 << i, st.isr_hist[i]);
+  ns_printf(pio, " more:%lu\n", st.isr_hist[DM9000A_ISR_HIST_BINS - 1]);
+  ns_printf(pio, "Sendq max:%d, current %d. IObase: 0x%lx IRQ %d\n",
+            dm9ka->tosend.q_max, dm9ka->tosend.q_len, dm9ka->regbase,
+            dm9ka->intnum);
 }
 
-extern void irq_Mask(void);
-extern void irq_Unmask(void);
+/* copy the driver counters, from any task */
+void dm9000a_get_stats(dm9000a_stats *stats)
+{
+  alt_irq_context context;
+
+  context = alt_irq_disable_all();
+  memcpy(stats, &g_dm9ka.stats, sizeof(*stats));
+  alt_irq_enable_all(context);
+}
 
 int dm9ka_pkt_send(PACKET pkt)
 {
-  unsigned int rv, slen;  
   DM9KA dm9ka = (DM9KA)pkt->net->n_local;
-  slen = pkt->nb_plen - ETHHDR_BIAS;
-  if(slen < 64) slen = 64;
 
-  //irq_Mask();
-    
-  rv = TransmitPacket(pkt->nb_prot + ETHHDR_BIAS, slen);
-  if(rv == DMFE_SUCCESS) {
-    /* update packet statistics */
-    dm9ka->netp->n_mib->ifOutOctets += (u_long)pkt->nb_plen;
-    if(*pkt->nb_prot & 0x80)
-      dm9ka->netp->n_mib->ifOutNUcastPkts++;
-    else
-      dm9ka->netp->n_mib->ifOutUcastPkts++;
-  }  
-    
-  //irq_Unmask();
-  
-  if(pkt) pk_free(pkt);
-  
-  return (0);      /* alloc done interrupt will start xmit */
+  /* The ISR and RX task use the index port and refill TX slots from
+     tosend, so keep just the NIC interrupt off while handing the frame
+     over. Frames go straight to the chip only while the RX task is idle
+     and none are waiting ahead of them; otherwise the RX task or the next
+     PTM interrupt picks them up. */
+  alt_irq_disable(dm9ka->intnum);
+  if (!dm9ka->rx_busy && (dm9ka->sending < TX_SLOTS) && (dm9ka->tosend.q_len == 0)) {
+    dm9000a_tx_load(dm9ka, pkt);
+    alt_irq_enable(dm9ka->intnum);
+    pk_free(pkt);
+  } else {
+    putq(&dm9ka->tosend, pkt);
+    dm9ka->stats.tx_queued++;
+    alt_irq_enable(dm9ka->intnum);
+  }
+
+  return (0);      /* PTM interrupt will send the rest */
 }
@@ -7,6 +7,15 @@
 #define DM9000A_INST_BASE DM9000A_BASE
 #define DM9000A_INST_IRQ DM9000A_IF_ETHERNET_IRQ
 
+/* Received frames are copied out of the chip by a task rather than in the
+   ISR. It runs below the stack's own tasks and above the application's. */
+#define DM9000A_RX_TASK_PRIO      4
+#define DM9000A_RX_TASK_STACKSIZE 1024
+
+/* ISR durations are binned by powers of two microseconds: bin 0 is under
+   2us, bin n under 2^(n+1)us and the last one everything longer */
+#define DM9000A_ISR_HIST_BINS     8
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -30,7 +39,26 @@ typedef struct dm9000a_if_struct
 #define DM9000A_INIT(name, dev_inst)                                      \
     alt_iniche_dev_reg(&(dev_inst.dev))
 
+/* driver counters, shown by the stack's stats menu and dm9000a_get_stats() */
+typedef struct dm9000a_stats_struct
+{
+  unsigned long rx_ints;         /* interrupts reporting received frames */
+  unsigned long tx_ints;         /* transmit completions handled */
+  unsigned long rx_frames;       /* frames handed to the stack */
+  unsigned long rx_bytes;
+  unsigned long tx_frames;       /* frames copied into TX SRAM */
+  unsigned long tx_bytes;
+  unsigned long rx_discards;     /* dropped, pk_alloc() had no buffer */
+  unsigned long rx_bad;          /* dropped, bad RX status or length */
+  unsigned long auto_resets;     /* chip resets after a bad RX header */
+  unsigned long tx_queued;       /* frames that had to wait for a TX slot */
+  unsigned long tx_copy_cycles;  /* CPU cycles spent copying into TX SRAM */
+  unsigned long isr_max_cycles;  /* longest ISR */
+  unsigned long isr_hist[DM9000A_ISR_HIST_BINS];
+} dm9000a_stats;
+
 error_t dm9000a_init(alt_iniche_dev *p_dev);
+void dm9000a_get_stats(dm9000a_stats *stats);
 
 #ifdef __cplusplus
 }
@@ -6,14 +6,22 @@
 
 #define NCR    0x00  /* Network  Control Register REG. 00 */
 #define NSR    0x01  /* Network  Status Register  REG. 01 */
+#define TX1END 0x04  /* NSR REG. 01 TX packet 1 complete */
+#define TX2END 0x08  /* NSR REG. 01 TX packet 2 complete */
+#define LINKST 0x40  /* NSR REG. 01 link is up */
 #define TCR    0x02  /* Transmit Control Register REG. 02 */
 #define RCR    0x05  /* Receive  Control Register REG. 05 */
+#define MAR    0x16  /* Multicast Address Registers REG. 16H~1DH,
+                        64 bit hash filter */
 #define ETXCSR 0x30  /* TX early Control Register REG. 30 */
+#define TCSCR  0x31  /* TX Checksum Control Register REG. 31 */
+#define RCSCSR 0x32  /* RX Checksum Control Status Register REG. 32 */
 #define MRCMDX 0xF0  /* RX FIFO I/O port command: READ a byte from RX SRAM */
 #define MRCMD  0xF2  /* RX FIFO I/O port command READ  from RX SRAM */
 #define MWCMD  0xF8  /* TX FIFO I/O port command WRITE into TX FIFO */
 #define ISR    0xFE  /* NIC Interrupt Status Register REG. FEH */
 #define IMR    0xFF  /* NIC Interrupt Mask   Register REG. FFH */
+#define PTS    0x02  /* ISR REG. FEH packet transmitted */
 
 #define NCR_set    0x00
 #define TCR_set    0x00
@@ -25,7 +33,8 @@
                             Bit [0] = 1 to enable RX machine */
 #define RCR_long   0x40  /* packet disable RX Watchdog Timer */
 #define PASS_MULTICAST 0x08 /* RCR REG. 05 PASS_ALL_MULTICAST
-                              Bit [3] = 1: RCR_set value ORed 0x08 */
+                              Bit [3] = 1: RCR_set value ORed 0x08, not
+                              used: multicast goes through the MAR hash */
 #define BPTR_set   0x3F  /* BPTR REG. 08 RX Back Pressure Threshold:
                             High Water Overflow Threshold setting
                             3KB and Jam_Pattern_Time = 600 us */
@@ -35,7 +44,18 @@
                             enable TXPEN + BKPM(TX_Half) + FLCE(RX) */
 #define ETXCSR_set 0x83  /* Early Transmit Bit [7] Enable and
                             Threshold 0~3: 12.5%, 25%, 50%, 75% */
-#define INTR_set   0x81  /* IMR REG. FFH: PAR +PRM, or 0x83: PAR + PRM + PTM */
+#define TCSCR_set  0x02  /* TCSCR REG. 31 TCPCSE: generate TCP checksums. The
+                            stack fills in the IP header checksum itself and
+                            sends UDP with a zero one */
+#define RCSCSR_set 0x02  /* RCSCSR REG. 32 RCSEN: checksum status in the
+                            first byte of the RX header, bad frames kept */
+#define RX_IPP     0x04  /* RX header byte 0: IP packet, bit << 3 = IP
+                            checksum failed */
+#define RX_TCPP    0x08  /* RX header byte 0: TCP packet, bit << 3 = TCP
+                            checksum failed */
+#define RX_UDPP    0x10  /* RX header byte 0: UDP packet, bit << 3 = UDP
+                            checksum failed */
+#define INTR_set   0x83  /* IMR REG. FFH: PAR + PRM + PTM */
 #define PAR_set    0x80  /* IMR REG. FFH: PAR only, RX/TX FIFO R/W
                             Pointer Auto Return enable */
 
@@ -45,10 +65,24 @@
                               Full-capability + Flow-control (if necessary) */
 #define PHY_mode   0x3100  /* set PHY media mode: Auto negotiation
                               (AUTO sense) */
+#define PHY_ID1    0x0181  /* PHY REG. 02 PHYID1 of the internal PHY, reads
+                              back once the PHY is powered up */
+
+#define PHY_UP_TIMEOUT   20000  /* us, PHY power-up, datasheet asks > 4 ms */
+#define PHY_RST_TIMEOUT  1000   /* us, PHY software reset, > 30 us */
+#define LINK_TIMEOUT     3000   /* ms to wait for autonegotiation at init */
+#define LINK_POLL        10     /* ms between link checks */
 
 // #define STD_DELAY       20      /* standard delay 20 us */
 #define STD_DELAY 1
 
+/* Packet data moves through the data port back to back, paced only by the
+   wait states of the DM9000A_IF Avalon slave. Raise this to add that many
+   nops between words if the interface is run faster than it was timed for. */
+#ifndef BURST_NOPS
+#define BURST_NOPS 0
+#endif
+
 #define DMFE_SUCCESS    0
 #define DMFE_FAIL       1
 
@@ -57,6 +91,8 @@
 #define MAX_PACKET_SIZE   1522  /* RX largest legal size packet
                                    with fcs & QoS */
 #define DM9000_PKT_MAX    3072  /* TX 1 packet max size without 4-byte CRC */
+#define TX_SLOTS          2     /* frames the TX SRAM holds at once */
+#define RX_BUDGET         8     /* frames the RX task takes per pass */
 
 
 typedef struct dm9000a_dev {
@@ -66,15 +102,20 @@ typedef struct dm9000a_dev {
   NET      netp;           /* pointer to Interniche NET struct */
   queue    tosend;         /* packets queued for sending */
   
-  int      sending;        /* TRUE while device is transmitting */
+  int      sending;        /* frames in TX SRAM, up to TX_SLOTS */
   PACKET   snd_pkt;        /* send packet info */
-  int      snd_len;
+  int      snd_len;        /* length of the frame waiting in the 2nd slot */
   PACKET   rcv_pkt;        /* receive packet info */
   int      rcv_len;
   
-   /* counters */
-  u_long   rx_ints;
-  u_long   tx_ints;
+  OS_EVENT *rx_sem;        /* ISR wakes the RX task */
+  volatile int rx_busy;    /* RX task owns the chip, NIC interrupt masked */
+  volatile unsigned int isr_status;  /* ISR bits not handled yet */
+  unsigned char mar[8];    /* multicast hash filter for MAR REG. 16H~1DH */
+  volatile int mar_dirty;  /* mar changed while the RX task owned the chip */
+  struct pk_cache rx_cache; /* buffers only the RX task takes from */
+
+  dm9000a_stats stats;     /* counters */
 
 } dm9000a_dev;
 
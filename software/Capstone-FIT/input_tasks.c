@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <sys/param.h>
 #include "system.h"
 #include "includes.h"
 #include "altera_avalon_pio_regs.h"
@@ -26,8 +27,13 @@
 #include "buttons.h"
 #include "barcode_scanner.h"
 #include "microphone.h"
-#include "altera_up_avalon_character_lcd.h"
+#include "lcd_display.h"
 #include "client.h"
+#include "inventory.h"
+#include "reconcile.h"
+#include "resolver.h"
+#include "status_server.h"
+#include "boot_timeline.h"
 
 // Parsing
 #include "word_parser.h"
@@ -54,7 +60,18 @@
 #define MUTEX_PRIORITY              6
 #define BARCODE_TASK_PRIORITY       7
 #define MICROPHONE_TASK_PRIORITY    8
+#define LCD_TASK_PRIORITY           9
+#define RECONCILE_TASK_PRIORITY     10
+#define STATUS_SERVER_PRIORITY      11
 #define ITEM_NAME_MAX_LENGTH        256
+#define STATUS_OVERLAY_TICKS        (2 * OS_TICKS_PER_SEC)
+#define UNKNOWN_OVERLAY_TICKS       (3 * OS_TICKS_PER_SEC)
+
+// LED bits, bit 0 of each bank is owned by displayStatus
+#define LED_STATUS_MASK             0x1
+#define LED_SYNC_PENDING_GREEN      0x2
+#define LED_SYNC_FAILED_RED         0x2
+#define LED_SYNC_CONFLICT_RED       0x4
 
 /*****************************************************************************/
 /* Globals                                                                   */
@@ -64,6 +81,27 @@ OS_EVENT   *pConfirmationMutex;
 OS_STK      pBarcodeTaskStack[TASK_STACKSIZE];
 OS_STK      pMicrophoneTaskStack[TASK_STACKSIZE];
 
+// Shadow copies of the LED banks so status and indicators can share them
+static INT32U redLeds   = 0;
+static INT32U greenLeds = 0;
+
+// Confirmation latency in ticks: prompt to press, and press to ConfirmItem
+// acting on it. Kept for a debugger rather than printed, the console carries
+// the FIT_MSG_* lines.
+static INT32U confirmPresses            = 0;
+static INT32U confirmResponseTicksMax   = 0;
+static INT32U confirmDispatchTicksMax   = 0;
+static INT32U confirmDispatchTicksTotal = 0;
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static bool commitItem(char *pItemName, int amount);
+static void startRequestEarly(void);
+static void writeLeds(INT32U redMask, INT32U redBits,
+                      INT32U greenMask, INT32U greenBits);
+
 /*****************************************************************************/
 /* Functions                                                                 */
 /*****************************************************************************/
@@ -104,6 +142,7 @@ MicrophoneTask(void* pData)
     {
         // Record audio clip (wait on push-to-talk)
         microphoneWaitAndBeginRecording(pMicrophone);
+        startRequestEarly();
         microphoneWaitAndFinishRecording(pMicrophone);
         microphoneExportLinear16(pMicrophone, pExportedRecording);
 
@@ -111,9 +150,15 @@ MicrophoneTask(void* pData)
         OSMutexPend(pConfirmationMutex, 1, &status);
         if (status == OS_ERR_NONE)
         {
-            translate_audio(pExportedRecording->pRecording, (pExportedRecording->size) * 2, audio_string);
-            printf("Voice decoded: %s\n", audio_string);
-            ConfirmItem(audio_string, pButtons);
+            if (translate_audio(pExportedRecording->pRecording, (pExportedRecording->size) * 2, audio_string))
+            {
+                printf("Voice decoded: %s\n", audio_string);
+                ConfirmItem(audio_string, pButtons);
+            }
+            else
+            {
+                displayStatusEx(FITStatusRequestFailed, audio_string);
+            }
             OSMutexPost(pConfirmationMutex);
         }
         else
@@ -162,6 +207,10 @@ BarcodeTask(void* pData)
     {
         printf("Barcode scanner setup failed.\n");
     }
+    else
+    {
+        barcodeScannerSetInputStartHook(pBarcodeScanner, startRequestEarly);
+    }
 
     while (pBarcodeScanner != NULL)
     {
@@ -172,9 +221,15 @@ BarcodeTask(void* pData)
         OSMutexPend(pConfirmationMutex, 1, &status);
         if (status == OS_ERR_NONE) {
             printf("Barcode: %s\n", barcode.pString);
-            translate_barcode(barcode.pString, pItemString);
-            printf("Barcode decoded: %s\n", pItemString);
-            ConfirmItem(pItemString, pButtons);
+            if (translate_barcode(barcode.pString, pItemString))
+            {
+                printf("Barcode decoded: %s\n", pItemString);
+                ConfirmItem(pItemString, pButtons);
+            }
+            else
+            {
+                displayStatusEx(FITStatusRequestFailed, pItemString);
+            }
             OSMutexPost(pConfirmationMutex);
         }
         else
@@ -187,67 +242,78 @@ BarcodeTask(void* pData)
 /*****************************************************************************/
 
 /**
- * @brief      Display item on LCD and process button response
+ * @brief      Display item on LCD and process button response. The result is
+ *             shown as a timed LCD overlay so this returns (and the caller
+ *             releases pConfirmationMutex) as soon as the item is handled.
  *
  * @param[in]  pItemName  String representing item to be added
  */
 void
 ConfirmItem(char* pItemName, Buttons *pButtons)
 {
-    alt_up_character_lcd_dev   *pLCD    = NULL;
     Button                      button  = ButtonMax;
+    ButtonEvent                 event;
+    INT32U                      promptTick = 0;
     Command                     command = CommandNothing;
     char 						pItemNameNoCommand[ITEM_NAME_MAX_LENGTH];
     char 						pItemNameNoQuantity[ITEM_NAME_MAX_LENGTH];
     int amount = 1;
-    
-
-    if ((pLCD = alt_up_character_lcd_open_dev(CHARACTER_LCD_NAME)) != NULL)
-    {
-        // Clear LCD
-        alt_up_character_lcd_init(pLCD);
-        alt_up_character_lcd_set_cursor_pos(pLCD, 0, 0);
 
+    command = parse_command(pItemName, pItemNameNoCommand);
+    amount = parse_number(pItemNameNoCommand, pItemNameNoQuantity);
 
-        command = parse_command(pItemName, pItemNameNoCommand);
-        amount = parse_number(pItemNameNoCommand, pItemNameNoQuantity);
 
+    if (command == CommandNothing) {
+        // A new item is being handled, so stop flagging the last conflict
+        displayIndicator(FITIndicatorSyncConflict, false);
 
-        if (command == CommandNothing) {
-			// Write item string to LCD
-			alt_up_character_lcd_string(pLCD, pItemName);
+        // Write item string to LCD, the display task scrolls long names.
+        // The previous result overlay would hide the prompt, so drop it.
+        lcdDisplayClearOverlay();
+        lcdDisplaySetText(pItemName, NULL);
 
-            // Get confirmation response
-            buttonsEnableAll(pButtons);
-            button = buttonsGetButtonPress(pButtons);
-            buttonsDisableAll(pButtons);
+        // Get confirmation response, ignoring presses left from before
+        buttonsFlushEvents(pButtons);
+        promptTick = OSTimeGet();
+        buttonsEnableAll(pButtons);
+        if (buttonsGetEvent(pButtons, &event, 0) == OS_NO_ERR)
+        {
+            button = (Button) event.buttonID;
         }
+        buttonsDisableAll(pButtons);
+
+        if (button != ButtonMax)
+        {
+            INT32U dispatchTicks = OSTimeGet() - event.tick;
 
-        if (command == CommandUnknown) {
-        	// Write item string to LCD
-        	alt_up_character_lcd_string(pLCD, FIT_MSG_ITEM_UNKNOWN);
-        	OSTimeDlyHMSM(0,0,3,0);
+            confirmPresses++;
+            confirmResponseTicksMax = MAX(confirmResponseTicksMax, event.tick - promptTick);
+            confirmDispatchTicksMax = MAX(confirmDispatchTicksMax, dispatchTicks);
+            confirmDispatchTicksTotal += dispatchTicks;
         }
+    }
 
-        // Add or remove item depending on response
-        if (button == ButtonAdd || command == CommandAdd)
-        {
-            add_item(pItemNameNoQuantity, amount);
+    if (command == CommandUnknown) {
+    	// Write item string to LCD
+    	lcdDisplayShowOverlay(FIT_MSG_ITEM_UNKNOWN, pItemName, UNKNOWN_OVERLAY_TICKS);
+    }
+
+    // Add or remove item depending on response
+    if (button == ButtonAdd || command == CommandAdd)
+    {
+        if (commitItem(pItemNameNoQuantity, amount))
             displayStatusEx(FITStatusItemAdded, pItemNameNoCommand);
-            OSTimeDlyHMSM(0,0,2,0);
-        }
-        else if (button == ButtonRemove || command == CommandRemove)
-        {
-            add_item(pItemNameNoQuantity, -1 * amount);
-            displayStatusEx(FITStatusItemRemoved, pItemNameNoCommand);
-            OSTimeDlyHMSM(0,0,2,0);
-        }
-        displayStatus(FITStatusReady);
+        else
+            displayStatusEx(FITStatusItemFailed, pItemNameNoCommand);
     }
-    else
+    else if (button == ButtonRemove || command == CommandRemove)
     {
-        printf("LCD setup failed\n");
+        if (commitItem(pItemNameNoQuantity, -1 * amount))
+            displayStatusEx(FITStatusItemRemoved, pItemNameNoCommand);
+        else
+            displayStatusEx(FITStatusItemFailed, pItemNameNoCommand);
     }
+    displayStatus(FITStatusReady);
 } // ConfirmItem
 
 /*****************************************************************************/
@@ -275,84 +341,131 @@ displayStatus(FITStatus status)
 void
 displayStatusEx(FITStatus status, char *pOptionalString)
 {
-    alt_up_character_lcd_dev *pLCD = NULL;
-
-    if ((pLCD = alt_up_character_lcd_open_dev(CHARACTER_LCD_NAME)) != NULL)
+    switch (status)
     {
-        // Clear LCD
-        alt_up_character_lcd_init(pLCD);
-        alt_up_character_lcd_set_cursor_pos(pLCD, 0, 0);
+    case FITStatusReady:
 
-        switch (status)
-        {
-        case FITStatusReady:
+        // Write Messages
+        lcdDisplaySetText(FIT_MSG_READY, NULL);
+        printf("%s\n", FIT_MSG_READY);
 
-            // Write Messages
-            alt_up_character_lcd_string(pLCD, FIT_MSG_READY);
-            printf("%s\n", FIT_MSG_READY);
+        // Set LEDs
+        writeLeds(LED_STATUS_MASK, 0x0, LED_STATUS_MASK, 0x1);
 
-            // Set LEDs
-            IOWR(RED_LEDS_BASE,   0, 0x0);
-            IOWR(GREEN_LEDS_BASE, 0, 0x1);
+        break;
 
-            break;
+    case FITStatusSetupFailed:
 
-        case FITStatusSetupFailed:
+        // Write Messages
+        lcdDisplaySetText(FIT_MSG_SETUP_FAILED, NULL);
+        printf("%s\n", FIT_MSG_SETUP_FAILED);
 
-            // Write Messages
-            alt_up_character_lcd_string(pLCD, FIT_MSG_SETUP_FAILED);
-            printf("%s\n", FIT_MSG_SETUP_FAILED);
+        // Set LEDs
+        writeLeds(LED_STATUS_MASK, 0x1, LED_STATUS_MASK, 0x0);
 
-            // Set LEDs
-            IOWR(RED_LEDS_BASE,   0, 0x1);
-            IOWR(GREEN_LEDS_BASE, 0, 0x0);
+        break;
 
-            break;
+    case FITStatusItemAdded:
 
-        case FITStatusItemAdded:
+        // Write Messages
+        lcdDisplayShowOverlay(FIT_MSG_ITEM_ADDED, pOptionalString, STATUS_OVERLAY_TICKS);
+        if (pOptionalString)
+        {
+            printf("%s: %s\n", FIT_MSG_ITEM_ADDED, pOptionalString);
+        }
+        else
+        {
+            printf("%s\n", FIT_MSG_ITEM_ADDED);
+        }
 
-            // Write Messages
-            alt_up_character_lcd_string(pLCD, FIT_MSG_ITEM_ADDED);
-            if (pOptionalString)
-            {
-                printf("%s: %s\n", FIT_MSG_ITEM_ADDED, pOptionalString);
-            }
-            else
-            {
-                printf("%s\n", FIT_MSG_ITEM_ADDED);
-            }
+        break;
+    case FITStatusItemRemoved:
 
-            break;
-        case FITStatusItemRemoved:
+        // Write Messages
+        lcdDisplayShowOverlay(FIT_MSG_ITEM_REMOVED, pOptionalString, STATUS_OVERLAY_TICKS);
+        if (pOptionalString)
+        {
+            printf("%s: %s\n", FIT_MSG_ITEM_REMOVED, pOptionalString);
+        }
+        else
+        {
+            printf("%s\n", FIT_MSG_ITEM_REMOVED);
+        }
 
-            // Write Messages
-            alt_up_character_lcd_string(pLCD, FIT_MSG_ITEM_REMOVED);
-            if (pOptionalString)
-            {
-                printf("%s: %s\n", FIT_MSG_ITEM_REMOVED, pOptionalString);
-            }
-            else
-            {
-                printf("%s\n", FIT_MSG_ITEM_REMOVED);
-            }
+        break;
+
+    case FITStatusRequestFailed:
+
+        // Write Messages
+        lcdDisplayShowOverlay(FIT_MSG_REQUEST_FAILED, pOptionalString, UNKNOWN_OVERLAY_TICKS);
+        if (pOptionalString)
+        {
+            printf("%s: %s\n", FIT_MSG_REQUEST_FAILED, pOptionalString);
+        }
+        else
+        {
+            printf("%s\n", FIT_MSG_REQUEST_FAILED);
+        }
 
-            break;
+        break;
 
-        default:
-            break;
+    case FITStatusItemFailed:
+
+        // Write Messages
+        lcdDisplayShowOverlay(FIT_MSG_ITEM_FAILED, pOptionalString, UNKNOWN_OVERLAY_TICKS);
+        if (pOptionalString)
+        {
+            printf("%s: %s\n", FIT_MSG_ITEM_FAILED, pOptionalString);
         }
+        else
+        {
+            printf("%s\n", FIT_MSG_ITEM_FAILED);
+        }
+
+        break;
+
+    default:
+        break;
     }
-    else
+} // DisplayStatusEx
+
+/*****************************************************************************/
+
+/**
+ * @brief      Light or clear one of the sync indicator LEDs without
+ *             disturbing the status LEDs. Safe to call from any task.
+ *
+ * @param[in]  indicator  Indicator to change
+ * @param[in]  bOn        True to light the indicator, False to clear it
+ */
+void
+displayIndicator(FITIndicator indicator, bool bOn)
+{
+    switch (indicator)
     {
-        printf("LCD setup failed\n");
+    case FITIndicatorSyncPending:
+        writeLeds(0, 0, LED_SYNC_PENDING_GREEN, bOn ? LED_SYNC_PENDING_GREEN : 0);
+        break;
+
+    case FITIndicatorSyncFailed:
+        writeLeds(LED_SYNC_FAILED_RED, bOn ? LED_SYNC_FAILED_RED : 0, 0, 0);
+        break;
+
+    case FITIndicatorSyncConflict:
+        writeLeds(LED_SYNC_CONFLICT_RED, bOn ? LED_SYNC_CONFLICT_RED : 0, 0, 0);
+        break;
+
+    default:
+        break;
     }
-} // DisplayStatusEx
+} // displayIndicator
 
 /*****************************************************************************/
 
 /**
  * @brief      Routine which sets up input tasks, sync objects, and shared
- *             devices
+ *             devices. Touches nothing on the network, so it runs while the
+ *             PHY negotiates and DHCP is still going; see FITNetworkSetup.
  */
 void
 FITSetup()
@@ -360,11 +473,30 @@ FITSetup()
     INT8U       status      = OS_NO_ERR;
     Buttons    *pButtons    = NULL;
 
+    // Start the LCD display service, every status update goes through it
+    status = lcdDisplayInit(CHARACTER_LCD_NAME, LCD_TASK_PRIORITY);
+
+    // Local inventory mirror, synced and served once the network is up
+    if (status == OS_NO_ERR)
+    {
+        status = inventoryInit();
+    }
+
+    // Queue for changes to the mirror; scans made before the network is up
+    // wait here until FITNetworkSetup starts delivering them
+    if (status == OS_NO_ERR)
+    {
+        status = reconcileInit();
+    }
+
     // Initialize input synchronization mutex
-    pConfirmationMutex = OSMutexCreate(MUTEX_PRIORITY, &status);
-    if (status != OS_NO_ERR)
+    if (status == OS_NO_ERR)
     {
-        printf("Mutex creation failed.\n");
+        pConfirmationMutex = OSMutexCreate(MUTEX_PRIORITY, &status);
+        if (status != OS_NO_ERR)
+        {
+            printf("Mutex creation failed.\n");
+        }
     }
 
     // Create Buttons object
@@ -437,6 +569,7 @@ FITSetup()
     if (status == OS_NO_ERR)
     {
         displayStatus(FITStatusReady);
+        bootTimelineMark(FIT_MSG_READY);
     }
     else
     {
@@ -444,6 +577,119 @@ FITSetup()
     }
 } // FITSetup
 
+/*****************************************************************************/
+
+/**
+ * @brief      Routine which starts everything that talks to the network.
+ *             Must be called after FITSetup, once the network stack is up.
+ */
+void
+FITNetworkSetup()
+{
+    INT8U       status      = OS_NO_ERR;
+
+    // Server address, resolved by name in the background
+    status = resolverInit(FIT_HOST_NAME, FIT_IP_ADDR);
+
+    // Keep the inventory mirror in sync with the server in the background
+    // and serve it to the local network
+    if (status == OS_NO_ERR)
+    {
+        status = reconcileStart(RECONCILE_TASK_PRIORITY);
+    }
+    if (status == OS_NO_ERR)
+    {
+        status = statusServerInit(STATUS_SERVER_PRIORITY);
+    }
+
+    if (status != OS_NO_ERR)
+    {
+        displayStatus(FITStatusSetupFailed);
+    }
+} // FITNetworkSetup
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Apply a confirmed item change. In optimistic mode the change is
+ *             committed to the local mirror and queued for the server, so
+ *             this returns without waiting on the network; if the queue is
+ *             full it falls back to a synchronous update.
+ *
+ * @param[in]  pItemName  Item to change
+ * @param[in]  amount     Quantity to add, negative to remove
+ *
+ * @return     True if the change was committed, False if the server refused
+ *             it or could not be reached
+ */
+static bool
+commitItem(char *pItemName, int amount)
+{
+    int applied = 0;
+
+    if (FIT_OPTIMISTIC_COMMIT)
+    {
+        if (inventoryApply(pItemName, amount, NULL, &applied) == OS_NO_ERR)
+        {
+            if (reconcileSubmit(pItemName, amount, applied) == OS_NO_ERR)
+            {
+                return true;
+            }
+
+            // Queue is full, undo the local change and go to the server
+            inventoryApply(pItemName, -applied, NULL, NULL);
+        }
+    }
+
+    if (add_item(pItemName, amount))
+    {
+        inventoryApply(pItemName, amount, NULL, NULL);
+        return true;
+    }
+
+    return false;
+} // commitItem
+
+/*****************************************************************************/
+
+/**
+ * @brief      Input has started (first barcode byte or push-to-talk), start
+ *             connecting to the server so the handshake overlaps with it.
+ */
+static void
+startRequestEarly(void)
+{
+    client_preconnect();
+} // startRequestEarly
+
+/*****************************************************************************/
+
+/**
+ * @brief      Update some bits of the red and green LED banks, leaving the
+ *             others as they were.
+ *
+ * @param[in]  redMask    Red LEDs to change
+ * @param[in]  redBits    New value of the red LEDs in redMask
+ * @param[in]  greenMask  Green LEDs to change
+ * @param[in]  greenBits  New value of the green LEDs in greenMask
+ */
+static void
+writeLeds(INT32U redMask, INT32U redBits, INT32U greenMask, INT32U greenBits)
+{
+#if OS_CRITICAL_METHOD == 3
+    OS_CPU_SR cpu_sr = 0;
+#endif
+
+    OS_ENTER_CRITICAL();
+    redLeds   = (redLeds & ~redMask) | (redBits & redMask);
+    greenLeds = (greenLeds & ~greenMask) | (greenBits & greenMask);
+    IOWR(RED_LEDS_BASE,   0, redLeds);
+    IOWR(GREEN_LEDS_BASE, 0, greenLeds);
+    OS_EXIT_CRITICAL();
+} // writeLeds
+
 /*****************************************************************************/
 /* End of File                                                               */
 /*****************************************************************************/
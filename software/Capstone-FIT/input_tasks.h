@@ -8,15 +8,30 @@
 #ifndef __INPUT_TASKS_H
 #define __INPUT_TASKS_H
 
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdbool.h>
+
 /*****************************************************************************/
 /* Constants                                                                 */
 /*****************************************************************************/
 
+// Commit item changes to the local inventory mirror and report them right
+// away, reconciling with the server in the background. Set to 0 to wait on
+// the server before reporting instead.
+#ifndef FIT_OPTIMISTIC_COMMIT
+#define FIT_OPTIMISTIC_COMMIT   1
+#endif
+
 #define FIT_MSG_READY           "FIT Ready"
 #define FIT_MSG_SETUP_FAILED    "FIT Setup Failed"
 #define FIT_MSG_ITEM_ADDED      "Item added"
 #define FIT_MSG_ITEM_REMOVED    "Item removed"
 #define FIT_MSG_ITEM_UNKNOWN    "Unrecognized"
+#define FIT_MSG_ITEM_FAILED     "Update failed"
+#define FIT_MSG_REQUEST_FAILED  "Lookup failed"
 
 
 /*****************************************************************************/
@@ -28,9 +43,18 @@ typedef enum _FITStatus
     FITStatusReady,
     FITStatusSetupFailed,
     FITStatusItemAdded,
-    FITStatusItemRemoved
+    FITStatusItemRemoved,
+    FITStatusItemFailed,
+    FITStatusRequestFailed
 } FITStatus;
 
+typedef enum _FITIndicator
+{
+    FITIndicatorSyncPending,    // Changes waiting to reach the server
+    FITIndicatorSyncFailed,     // Server unreachable, changes being retried
+    FITIndicatorSyncConflict    // Server rejected a change, rolled back
+} FITIndicator;
+
 /*****************************************************************************/
 /* Functions                                                                 */
 /*****************************************************************************/
@@ -40,7 +64,9 @@ void BarcodeTask(void* pData);
 void ConfirmItem(char* pItemName, Buttons *pButtons);
 void dispalyStatus(FITStatus status);
 void displayStatusEx(FITStatus status, char *pOptionalString);
+void displayIndicator(FITIndicator indicator, bool bOn);
 void FITSetup();
+void FITNetworkSetup();
 
 /*****************************************************************************/
 /* End of File                                                               */
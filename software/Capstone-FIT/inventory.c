@@ -0,0 +1,486 @@
+/** @file   inventory.c
+ *  @brief  Routines for the local inventory mirror
+ *
+ *  Open addressed hash table keyed on item name. Lookups and updates are
+ *  O(1) on average and never touch the network or the heap. The table is
+ *  shared between the input tasks and the reconciliation task so every
+ *  access is made under pInventoryLock.
+ *
+ *  Every change bumps the mirror version and stamps the entry with it, so
+ *  readers (the status server) can ask for only what changed since a version
+ *  they already have. The server's own since-token is kept separately and is
+ *  advanced by inventoryApplySync.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "inventory.h"
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static INT32U           hashName(const char *pItemName);
+static InventoryEntry*  findEntry(const char *pItemName, bool bCreate);
+static const char*      findValue(const char *pStart,
+                                  const char *pEnd,
+                                  const char *pKey);
+static bool             copyString(const char *pValue,
+                                   char       *pString,
+                                   int         length);
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static OS_EVENT        *pInventoryLock = NULL;
+static InventoryEntry   pInventoryTable[INVENTORY_TABLE_SIZE];
+static INT32U           inventoryVersion = 0;
+static INT32U           inventorySyncToken = 0;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Clear the mirror and create its lock. Must be called before any
+ *             other inventory routine.
+ *
+ * @return     OS_NO_ERR if no error, OS_ERR_PDATA_NULL if the lock could not
+ *             be created
+ */
+INT8U
+inventoryInit()
+{
+    INT8U status = OS_NO_ERR;
+
+    memset(pInventoryTable, 0, sizeof(pInventoryTable));
+    inventoryVersion   = 0;
+    inventorySyncToken = 0;
+
+    pInventoryLock = OSSemCreate(1);
+    if (pInventoryLock == NULL)
+    {
+        status = OS_ERR_PDATA_NULL;
+        printf("Inventory setup failed.\n");
+    }
+
+    return status;
+} // inventoryInit
+
+/*****************************************************************************/
+
+/**
+ * @brief      Add delta to the local quantity of an item, creating the entry
+ *             if it is new. Quantities never go below zero, so the change
+ *             made can be smaller than delta; undo it with -*pApplied.
+ *
+ * @param[in]     pItemName  Item to update
+ * @param[in]     delta      Amount to add, negative to remove
+ * @param[inout]  pQuantity  New local quantity, may be NULL
+ * @param[inout]  pApplied   Amount actually added, may be NULL
+ *
+ * @return     OS_NO_ERR if updated, OS_ERR_PDATA_NULL if the table is full or
+ *             the mirror is not initialized
+ */
+INT8U
+inventoryApply(const char *pItemName, int delta, INT32S *pQuantity, int *pApplied)
+{
+    INT8U           status      = OS_NO_ERR;
+    InventoryEntry *pEntry      = NULL;
+    INT32S          previous    = 0;
+
+    if ((pInventoryLock == NULL) || (pItemName == NULL))
+    {
+        return OS_ERR_PDATA_NULL;
+    }
+
+    OSSemPend(pInventoryLock, 0, &status);
+    if (status == OS_NO_ERR)
+    {
+        pEntry = findEntry(pItemName, true);
+        if (pEntry != NULL)
+        {
+            previous = pEntry->quantity;
+            pEntry->quantity += delta;
+            if (pEntry->quantity < 0)
+            {
+                pEntry->quantity = 0;
+            }
+            pEntry->version = ++inventoryVersion;
+
+            if (pQuantity)
+            {
+                *pQuantity = pEntry->quantity;
+            }
+            if (pApplied)
+            {
+                *pApplied = pEntry->quantity - previous;
+            }
+        }
+        else
+        {
+            status = OS_ERR_PDATA_NULL;
+        }
+        OSSemPost(pInventoryLock);
+    }
+
+    return status;
+} // inventoryApply
+
+/*****************************************************************************/
+
+/**
+ * @brief      Read the local quantity of an item.
+ *
+ * @param[in]     pItemName  Item to look up
+ * @param[inout]  pQuantity  Local quantity, left untouched if not found
+ *
+ * @return     True if the item is in the mirror, False otherwise
+ */
+bool
+inventoryLookup(const char *pItemName, INT32S *pQuantity)
+{
+    INT8U           status  = OS_NO_ERR;
+    InventoryEntry *pEntry  = NULL;
+    bool            bFound  = false;
+
+    if ((pInventoryLock == NULL) || (pItemName == NULL))
+    {
+        return false;
+    }
+
+    OSSemPend(pInventoryLock, 0, &status);
+    if (status == OS_NO_ERR)
+    {
+        pEntry = findEntry(pItemName, false);
+        if (pEntry != NULL)
+        {
+            bFound = true;
+            if (pQuantity)
+            {
+                *pQuantity = pEntry->quantity;
+            }
+        }
+        OSSemPost(pInventoryLock);
+    }
+
+    return bFound;
+} // inventoryLookup
+
+/*****************************************************************************/
+
+/**
+ * @brief      Apply a delta sync response from the server. The body is
+ *             expected to look like
+ *
+ *             {"version": 42, "items": [{"title": "apple", "quantity": 3,
+ *               "timeAdded": 1487568006, "timeExpired": 1488172806}, ...]}
+ *
+ *             where items holds every item changed since the token the
+ *             request was made with. Server quantities are authoritative.
+ *             On success the sync token is advanced to "version".
+ *
+ * @param[in]  pBody  Response body, NUL terminated
+ * @param[in]  pSkip  Optional filter; items it returns true for are left
+ *                    alone (eg. items with local changes still in flight)
+ *
+ * @return     OS_NO_ERR if applied, OS_ERR_PDATA_NULL if the body is not a
+ *             sync response
+ */
+INT8U
+inventoryApplySync(const char *pBody, bool (*pSkip)(const char *pItemName))
+{
+    INT8U           status      = OS_NO_ERR;
+    const char     *pEnd        = NULL;
+    const char     *pItem       = NULL;
+    const char     *pItemEnd    = NULL;
+    const char     *pValue      = NULL;
+    const char     *pToken      = NULL;
+    InventoryEntry *pEntry      = NULL;
+    char            pName[INVENTORY_NAME_LENGTH];
+    INT32S          quantity    = 0;
+    INT32U          timeAdded   = 0;
+    INT32U          timeExpired = 0;
+
+    if ((pInventoryLock == NULL) || (pBody == NULL))
+    {
+        return OS_ERR_PDATA_NULL;
+    }
+
+    pEnd   = pBody + strlen(pBody);
+    pToken = findValue(pBody, pEnd, "version");
+    pItem  = findValue(pBody, pEnd, "items");
+    if ((pToken == NULL) || (pItem == NULL) || (*pItem != '['))
+    {
+        return OS_ERR_PDATA_NULL;
+    }
+
+    // Items are flat objects, so each one ends at the next closing brace
+    while ((status == OS_NO_ERR) &&
+           ((pItem = strchr(pItem, '{')) != NULL) &&
+           ((pItemEnd = strchr(pItem, '}')) != NULL))
+    {
+        pValue = findValue(pItem, pItemEnd, "title");
+        if ((pValue != NULL) && copyString(pValue, pName, sizeof(pName)))
+        {
+            pValue      = findValue(pItem, pItemEnd, "quantity");
+            quantity    = pValue ? strtol(pValue, NULL, 10) : 0;
+            pValue      = findValue(pItem, pItemEnd, "timeAdded");
+            timeAdded   = pValue ? strtoul(pValue, NULL, 10) : 0;
+            pValue      = findValue(pItem, pItemEnd, "timeExpired");
+            timeExpired = pValue ? strtoul(pValue, NULL, 10) : 0;
+
+            if ((pSkip == NULL) || !pSkip(pName))
+            {
+                OSSemPend(pInventoryLock, 0, &status);
+                if (status == OS_NO_ERR)
+                {
+                    pEntry = findEntry(pName, true);
+                    if ((pEntry != NULL) &&
+                        ((pEntry->quantity    != quantity)  ||
+                         (pEntry->timeAdded   != timeAdded) ||
+                         (pEntry->timeExpired != timeExpired)))
+                    {
+                        pEntry->quantity    = (quantity < 0) ? 0 : quantity;
+                        pEntry->timeAdded   = timeAdded;
+                        pEntry->timeExpired = timeExpired;
+                        pEntry->version     = ++inventoryVersion;
+                    }
+                    OSSemPost(pInventoryLock);
+                }
+            }
+        }
+        pItem = pItemEnd + 1;
+    }
+
+    if (status == OS_NO_ERR)
+    {
+        inventorySyncToken = strtoul(pToken, NULL, 10);
+    }
+
+    return status;
+} // inventoryApplySync
+
+/*****************************************************************************/
+
+/**
+ * @brief      Get the server since-token of the last applied sync.
+ *
+ * @return     Sync token, 0 before the first sync (ask for everything)
+ */
+INT32U
+inventoryGetSyncToken()
+{
+    return inventorySyncToken;
+} // inventoryGetSyncToken
+
+/*****************************************************************************/
+
+/**
+ * @brief      Copy out every entry changed after a given mirror version.
+ *
+ * @param[inout]  pEntries    Buffer for the entries, pre-allocated by caller
+ * @param[in]     maxEntries  Number of entries pEntries can hold
+ * @param[in]     since       Mirror version the reader already has, 0 for all
+ * @param[inout]  pVersion    Current mirror version, may be NULL
+ *
+ * @return     Number of entries copied, -1 on error
+ */
+int
+inventorySnapshot(InventoryEntry *pEntries,
+                  int             maxEntries,
+                  INT32U          since,
+                  INT32U         *pVersion)
+{
+    INT8U   status  = OS_NO_ERR;
+    int     count   = 0;
+    int     index   = 0;
+
+    if ((pInventoryLock == NULL) || (pEntries == NULL))
+    {
+        return -1;
+    }
+
+    OSSemPend(pInventoryLock, 0, &status);
+    if (status != OS_NO_ERR)
+    {
+        return -1;
+    }
+
+    for (index = 0; (index < INVENTORY_TABLE_SIZE) && (count < maxEntries); index++)
+    {
+        if (pInventoryTable[index].bUsed &&
+            (pInventoryTable[index].version > since))
+        {
+            pEntries[count++] = pInventoryTable[index];
+        }
+    }
+
+    if (pVersion)
+    {
+        *pVersion = inventoryVersion;
+    }
+    OSSemPost(pInventoryLock);
+
+    return count;
+} // inventorySnapshot
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      FNV-1a hash of an item name.
+ *
+ * @param[in]  pItemName  Item name
+ *
+ * @return     32 bit hash
+ */
+static INT32U
+hashName(const char *pItemName)
+{
+    INT32U hash = 2166136261u;
+
+    while (*pItemName)
+    {
+        hash ^= (unsigned char) *pItemName++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+} // hashName
+
+/*****************************************************************************/
+
+/**
+ * @brief      Linear probe for an item. Entries are never removed, so the
+ *             first unused slot ends the probe. Names longer than
+ *             INVENTORY_NAME_LENGTH are compared on their prefix. Caller must
+ *             hold pInventoryLock.
+ *
+ * @param[in]  pItemName  Item to find
+ * @param[in]  bCreate    Claim the first unused slot if the item is missing
+ *
+ * @return     Matching (or new) entry, NULL if missing and not created or the
+ *             table is full
+ */
+static InventoryEntry*
+findEntry(const char *pItemName, bool bCreate)
+{
+    INT32U          index   = hashName(pItemName) & INVENTORY_TABLE_MASK;
+    INT32U          probes  = 0;
+    InventoryEntry *pEntry  = NULL;
+
+    for (probes = 0; probes < INVENTORY_TABLE_SIZE; probes++)
+    {
+        pEntry = &pInventoryTable[(index + probes) & INVENTORY_TABLE_MASK];
+
+        if (!pEntry->bUsed)
+        {
+            if (bCreate)
+            {
+                strncpy(pEntry->pName, pItemName, INVENTORY_NAME_LENGTH - 1);
+                pEntry->pName[INVENTORY_NAME_LENGTH - 1] = '\0';
+                pEntry->quantity = 0;
+                pEntry->bUsed    = true;
+                return pEntry;
+            }
+            return NULL;
+        }
+
+        if (strncmp(pEntry->pName, pItemName, INVENTORY_NAME_LENGTH - 1) == 0)
+        {
+            return pEntry;
+        }
+    }
+
+    return NULL;
+} // findEntry
+
+/*****************************************************************************/
+
+/**
+ * @brief      Find the value of a JSON key between two points of a body.
+ *
+ * @param[in]  pStart  Where to start looking
+ * @param[in]  pEnd    Where to stop looking
+ * @param[in]  pKey    Key to find, without quotes
+ *
+ * @return     First character of the value, NULL if the key is not found
+ */
+static const char*
+findValue(const char *pStart, const char *pEnd, const char *pKey)
+{
+    size_t      keyLength   = strlen(pKey);
+    const char *pPosition   = pStart;
+
+    while ((pPosition = strchr(pPosition, '"')) != NULL)
+    {
+        if ((pPosition + keyLength + 2) > pEnd)
+        {
+            break;
+        }
+
+        if ((strncmp(pPosition + 1, pKey, keyLength) == 0) &&
+            (pPosition[keyLength + 1] == '"'))
+        {
+            pPosition += keyLength + 2;
+            while ((pPosition < pEnd) && (isspace((unsigned char) *pPosition) ||
+                                          (*pPosition == ':')))
+            {
+                pPosition++;
+            }
+            return (pPosition < pEnd) ? pPosition : NULL;
+        }
+        pPosition++;
+    }
+
+    return NULL;
+} // findValue
+
+/*****************************************************************************/
+
+/**
+ * @brief      Copy a JSON string value, dropping escape backslashes.
+ *
+ * @param[in]     pValue   Value, starting at its opening quote
+ * @param[inout]  pString  Buffer for the string, pre-allocated by caller
+ * @param[in]     length   Size of pString
+ *
+ * @return     True if a complete string was copied, False otherwise
+ */
+static bool
+copyString(const char *pValue, char *pString, int length)
+{
+    int count = 0;
+
+    if (*pValue++ != '"')
+    {
+        return false;
+    }
+
+    while (*pValue && (*pValue != '"') && (count < (length - 1)))
+    {
+        if ((*pValue == '\\') && pValue[1])
+        {
+            pValue++;
+        }
+        pString[count++] = *pValue++;
+    }
+    pString[count] = '\0';
+
+    return (*pValue == '"');
+} // copyString
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,68 @@
+/** @file   inventory.h
+ *  @brief  Declarations, Structure, and Constant definitions for the local
+ *          inventory mirror.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. The mirror is a fixed size hash table of item name to quantity
+ *  which is updated locally before the server confirms a change, and kept in
+ *  step with the server through incremental (since-token) syncs.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __INVENTORY_H
+#define __INVENTORY_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdbool.h>
+#include "includes.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define INVENTORY_TABLE_SIZE    256 // Must be a power of two
+#define INVENTORY_TABLE_MASK    (INVENTORY_TABLE_SIZE - 1)
+#define INVENTORY_NAME_LENGTH   128
+#define INVENTORY_SYNC_TICKS    (30 * OS_TICKS_PER_SEC)
+#define INVENTORY_SYNC_SIZE     16384   // Largest delta sync body accepted
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _InventoryEntry;
+
+typedef struct _InventoryEntry
+{
+    char            pName[INVENTORY_NAME_LENGTH];
+    INT32S          quantity;
+    INT32U          timeAdded;      // Server time, seconds since epoch
+    INT32U          timeExpired;    // Server time, seconds since epoch
+    INT32U          version;        // Mirror version of the last change
+    bool            bUsed;
+} InventoryEntry;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+INT8U   inventoryInit();
+INT8U   inventoryApply(const char *pItemName, int delta, INT32S *pQuantity, int *pApplied);
+bool    inventoryLookup(const char *pItemName, INT32S *pQuantity);
+INT8U   inventoryApplySync(const char *pBody,
+                           bool      (*pSkip)(const char *pItemName));
+INT32U  inventoryGetSyncToken();
+int     inventorySnapshot(InventoryEntry *pEntries,
+                          int             maxEntries,
+                          INT32U          since,
+                          INT32U         *pVersion);
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __INVENTORY_H
@@ -0,0 +1,479 @@
+/** @file   lcd_display.c
+ *  @brief  Source for public and private routines used by the character LCD
+ *          display service.
+ *
+ *  The display service task is the only code that touches the character
+ *  LCD. It keeps a shadow copy of the 2x16 glass and only writes the cells
+ *  that differ from what is already shown, rows longer than the display are
+ *  scrolled by the task. Text lives on two layers: the base layer, and a
+ *  timed overlay that hides the base layer until it expires. Callers submit
+ *  updates through a queue so they never block on the (slow) LCD controller.
+ *  All non-static functions are effectively part of the public API, those
+ *  that are static should be considered private.
+ *
+ *  @author Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "lcd_display.h"
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static INT8U   submitUpdate(LCDLayer    layer,
+                            const char *pTopRow,
+                            const char *pBottomRow,
+                            INT32U      durationTicks);
+static void    lcdDisplayTask(void *pData);
+static void    applyUpdate(LCDUpdate *pUpdate);
+static LCDRow* activeRows();
+static INT16U  nextWakeTicks();
+static bool    advanceScroll();
+static void    render();
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static alt_up_character_lcd_dev    *pLCD                = NULL;
+static OS_EVENT                    *pUpdateQueue        = NULL;
+static void                        *pUpdateQueueData[LCD_DISPLAY_QUEUE_SIZE];
+static OS_MEM                      *pUpdatePartition    = NULL;
+static LCDUpdate                    pUpdateBlocks[LCD_DISPLAY_QUEUE_SIZE];
+static LCDRow                       pBaseRows[LCD_DISPLAY_ROWS];
+static LCDRow                       pOverlayRows[LCD_DISPLAY_ROWS];
+static bool                         bOverlayActive      = false;
+static INT32U                       overlayExpiryTick   = 0;
+static char                         pShadow[LCD_DISPLAY_ROWS][LCD_DISPLAY_COLUMNS];
+static OS_STK                       pLCDDisplayTaskStack[LCD_DISPLAY_TASK_STACKSIZE];
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Open the LCD, clear it, and start the display service task. This
+ *             must be called once before any other lcdDisplay routine.
+ *
+ * @param[in]  pName     Name of the character LCD device
+ * @param[in]  priority  Priority of the display service task
+ *
+ * @return     OS_NO_ERR if no error, OS_ERR_PDATA_NULL if the device could not
+ *             be opened, otherwise the failing uC/OS-II error code
+ */
+INT8U
+lcdDisplayInit(const char *pName, INT8U priority)
+{
+    INT8U status = OS_NO_ERR;
+
+    if ((pLCD = alt_up_character_lcd_open_dev(pName)) == NULL)
+    {
+        status = OS_ERR_PDATA_NULL;
+    }
+
+    // Clear the glass, the shadow buffer starts out matching it
+    if (status == OS_NO_ERR)
+    {
+        alt_up_character_lcd_init(pLCD);
+        alt_up_character_lcd_cursor_off(pLCD);
+        memset(pShadow, ' ', sizeof(pShadow));
+        memset(pBaseRows, 0, sizeof(pBaseRows));
+        memset(pOverlayRows, 0, sizeof(pOverlayRows));
+    }
+
+    // Fixed pool of update blocks, callers never touch the heap
+    if (status == OS_NO_ERR)
+    {
+        pUpdatePartition = OSMemCreate(pUpdateBlocks,
+                                       LCD_DISPLAY_QUEUE_SIZE,
+                                       sizeof(LCDUpdate),
+                                       &status);
+    }
+
+    if (status == OS_NO_ERR)
+    {
+        pUpdateQueue = OSQCreate(pUpdateQueueData, LCD_DISPLAY_QUEUE_SIZE);
+        if (pUpdateQueue == NULL)
+        {
+            status = OS_ERR_PDATA_NULL;
+        }
+    }
+
+    if (status == OS_NO_ERR)
+    {
+        status = OSTaskCreateExt(lcdDisplayTask,
+                                 NULL,
+                                 &pLCDDisplayTaskStack[LCD_DISPLAY_TASK_STACKSIZE-1],
+                                 priority,
+                                 priority,
+                                 pLCDDisplayTaskStack,
+                                 LCD_DISPLAY_TASK_STACKSIZE,
+                                 NULL,
+                                 0);
+    }
+
+    if (status != OS_NO_ERR)
+    {
+        printf("LCD display setup failed.\n");
+    }
+
+    return status;
+} // lcdDisplayInit
+
+/*****************************************************************************/
+
+/**
+ * @brief      Replace the base text on both rows of the display. This never
+ *             blocks; the display service task draws the change later. While
+ *             an overlay is up the new text is kept and shown once it ends.
+ *
+ * @param[in]  pTopRow     Text for the top row, NULL for blank
+ * @param[in]  pBottomRow  Text for the bottom row, NULL for blank
+ *
+ * @return     OS_NO_ERR if queued, OS_ERR_PDATA_NULL if the service is not
+ *             running, otherwise the failing uC/OS-II error code
+ */
+INT8U
+lcdDisplaySetText(const char *pTopRow, const char *pBottomRow)
+{
+    return submitUpdate(LCDLayerBase, pTopRow, pBottomRow, 0);
+} // lcdDisplaySetText
+
+/*****************************************************************************/
+
+/**
+ * @brief      Show text over the base layer for a fixed time, after which the
+ *             base text comes back on its own. A new overlay replaces the one
+ *             currently shown. The caller does not wait for the timeout.
+ *
+ * @param[in]  pTopRow        Text for the top row, NULL for blank
+ * @param[in]  pBottomRow     Text for the bottom row, NULL for blank
+ * @param[in]  durationTicks  How long the overlay stays up
+ *
+ * @return     OS_NO_ERR if queued, OS_ERR_PDATA_NULL if the service is not
+ *             running, otherwise the failing uC/OS-II error code
+ */
+INT8U
+lcdDisplayShowOverlay(const char *pTopRow,
+                      const char *pBottomRow,
+                      INT32U      durationTicks)
+{
+    return submitUpdate(LCDLayerOverlay, pTopRow, pBottomRow, durationTicks);
+} // lcdDisplayShowOverlay
+
+/*****************************************************************************/
+
+/**
+ * @brief      Remove any overlay early so the base text is visible again.
+ *
+ * @return     OS_NO_ERR if queued, OS_ERR_PDATA_NULL if the service is not
+ *             running, otherwise the failing uC/OS-II error code
+ */
+INT8U
+lcdDisplayClearOverlay()
+{
+    return submitUpdate(LCDLayerOverlay, NULL, NULL, 0);
+} // lcdDisplayClearOverlay
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Copy text into a block from the update pool and queue it for
+ *             the display service task.
+ *
+ * @param[in]  layer          Layer the text belongs to
+ * @param[in]  pTopRow        Text for the top row, NULL for blank
+ * @param[in]  pBottomRow     Text for the bottom row, NULL for blank
+ * @param[in]  durationTicks  Overlay lifetime, ignored for the base layer
+ *
+ * @return     OS_NO_ERR if queued, OS_ERR_PDATA_NULL if the service is not
+ *             running, otherwise the failing uC/OS-II error code
+ */
+static INT8U
+submitUpdate(LCDLayer    layer,
+             const char *pTopRow,
+             const char *pBottomRow,
+             INT32U      durationTicks)
+{
+    INT8U       status  = OS_NO_ERR;
+    LCDUpdate  *pUpdate = NULL;
+
+    if ((pUpdatePartition == NULL) || (pUpdateQueue == NULL))
+    {
+        status = OS_ERR_PDATA_NULL;
+    }
+
+    if (status == OS_NO_ERR)
+    {
+        pUpdate = (LCDUpdate *) OSMemGet(pUpdatePartition, &status);
+    }
+
+    if (status == OS_NO_ERR)
+    {
+        pUpdate->layer         = layer;
+        pUpdate->durationTicks = durationTicks;
+        strncpy(pUpdate->pText[0], pTopRow ? pTopRow : "", LCD_DISPLAY_TEXT_LENGTH - 1);
+        strncpy(pUpdate->pText[1], pBottomRow ? pBottomRow : "", LCD_DISPLAY_TEXT_LENGTH - 1);
+        pUpdate->pText[0][LCD_DISPLAY_TEXT_LENGTH - 1] = '\0';
+        pUpdate->pText[1][LCD_DISPLAY_TEXT_LENGTH - 1] = '\0';
+
+        status = OSQPost(pUpdateQueue, pUpdate);
+        if (status != OS_NO_ERR)
+        {
+            OSMemPut(pUpdatePartition, pUpdate);
+        }
+    }
+
+    return status;
+} // submitUpdate
+
+/*****************************************************************************/
+
+/**
+ * @brief      Display service task. Waits for updates, the next scroll step,
+ *             or the end of the current overlay, then redraws the cells that
+ *             changed. Updates which pile up while drawing are applied in
+ *             order and drawn once.
+ *
+ * @param[in]  pData  UNUSED_PARAMETER
+ */
+static void
+lcdDisplayTask(void *pData)
+{
+    INT8U       status  = OS_NO_ERR;
+    LCDUpdate  *pUpdate = NULL;
+    bool        bDirty  = false;
+
+    while (1)
+    {
+        pUpdate = (LCDUpdate *) OSQPend(pUpdateQueue, nextWakeTicks(), &status);
+        bDirty = false;
+
+        while ((status == OS_NO_ERR) && (pUpdate != NULL))
+        {
+            applyUpdate(pUpdate);
+            OSMemPut(pUpdatePartition, pUpdate);
+            bDirty = true;
+
+            pUpdate = (LCDUpdate *) OSQAccept(pUpdateQueue, &status);
+        }
+
+        // Drop an overlay whose time is up
+        if (bOverlayActive && ((INT32S) (OSTimeGet() - overlayExpiryTick) >= 0))
+        {
+            bOverlayActive = false;
+            bDirty = true;
+        }
+
+        if (!bDirty)
+        {
+            bDirty = advanceScroll();
+        }
+
+        if (bDirty)
+        {
+            render();
+        }
+    }
+} // lcdDisplayTask
+
+/*****************************************************************************/
+
+/**
+ * @brief      Copy submitted text into the row state of its layer and restart
+ *             scrolling.
+ *
+ * @param[in]  pUpdate  Update taken off the queue
+ */
+static void
+applyUpdate(LCDUpdate *pUpdate)
+{
+    unsigned int    row     = 0;
+    LCDRow         *pRows   = pBaseRows;
+
+    if (pUpdate->layer == LCDLayerOverlay)
+    {
+        pRows             = pOverlayRows;
+        bOverlayActive    = (pUpdate->durationTicks > 0);
+        overlayExpiryTick = OSTimeGet() + pUpdate->durationTicks;
+    }
+
+    for (row = 0; row < LCD_DISPLAY_ROWS; row++)
+    {
+        strcpy(pRows[row].pText, pUpdate->pText[row]);
+        pRows[row].length       = strlen(pRows[row].pText);
+        pRows[row].scrollOffset = 0;
+        pRows[row].scrollHold   = LCD_DISPLAY_SCROLL_HOLD;
+    }
+} // applyUpdate
+
+/*****************************************************************************/
+
+/**
+ * @brief      Rows of the layer that is currently visible.
+ *
+ * @return     Overlay rows while an overlay is up, base rows otherwise
+ */
+static LCDRow*
+activeRows()
+{
+    return bOverlayActive ? pOverlayRows : pBaseRows;
+} // activeRows
+
+/*****************************************************************************/
+
+/**
+ * @brief      Work out how long the task may sleep: until the next scroll
+ *             step if a visible row is too long, and no later than the end
+ *             of the current overlay.
+ *
+ * @return     Ticks to pend for, 0 to wait for the next update forever
+ */
+static INT16U
+nextWakeTicks()
+{
+    INT32U          ticks   = 0;
+    INT32S          remain  = 0;
+    unsigned int    row     = 0;
+    LCDRow         *pRows   = activeRows();
+
+    for (row = 0; row < LCD_DISPLAY_ROWS; row++)
+    {
+        if (pRows[row].length > LCD_DISPLAY_COLUMNS)
+        {
+            ticks = LCD_DISPLAY_SCROLL_TICKS;
+        }
+    }
+
+    if (bOverlayActive)
+    {
+        remain = (INT32S) (overlayExpiryTick - OSTimeGet());
+        if (remain <= 0)
+        {
+            remain = 1;
+        }
+        if ((ticks == 0) || ((INT32U) remain < ticks))
+        {
+            ticks = (INT32U) remain;
+        }
+    }
+
+    // OSQPend takes 16 bits of ticks, waking early is harmless
+    return (ticks > 0xFFFF) ? 0xFFFF : (INT16U) ticks;
+} // nextWakeTicks
+
+/*****************************************************************************/
+
+/**
+ * @brief      Step every over-long visible row one character. Rows rest at
+ *             the start and end for LCD_DISPLAY_SCROLL_HOLD steps so they can
+ *             be read.
+ *
+ * @return     True if any row moved and needs to be redrawn
+ */
+static bool
+advanceScroll()
+{
+    unsigned int    row     = 0;
+    bool            bMoved  = false;
+    LCDRow         *pRow    = NULL;
+
+    for (row = 0; row < LCD_DISPLAY_ROWS; row++)
+    {
+        pRow = &activeRows()[row];
+        if (pRow->length <= LCD_DISPLAY_COLUMNS)
+        {
+            continue;
+        }
+
+        if (pRow->scrollHold > 0)
+        {
+            pRow->scrollHold--;
+        }
+        else if (pRow->scrollOffset < (pRow->length - LCD_DISPLAY_COLUMNS))
+        {
+            pRow->scrollOffset++;
+            bMoved = true;
+
+            if (pRow->scrollOffset == (pRow->length - LCD_DISPLAY_COLUMNS))
+            {
+                pRow->scrollHold = LCD_DISPLAY_SCROLL_HOLD;
+            }
+        }
+        else
+        {
+            pRow->scrollOffset = 0;
+            pRow->scrollHold   = LCD_DISPLAY_SCROLL_HOLD;
+            bMoved = true;
+        }
+    }
+
+    return bMoved;
+} // advanceScroll
+
+/*****************************************************************************/
+
+/**
+ * @brief      Compose the visible window of each row and write only the runs
+ *             of cells that differ from the shadow buffer. One cursor move is
+ *             issued per run rather than per character.
+ */
+static void
+render()
+{
+    char            pFrame[LCD_DISPLAY_COLUMNS];
+    unsigned int    row     = 0;
+    unsigned int    column  = 0;
+    unsigned int    start   = 0;
+    LCDRow         *pRow    = NULL;
+
+    for (row = 0; row < LCD_DISPLAY_ROWS; row++)
+    {
+        pRow = &activeRows()[row];
+
+        // Build the visible window, space padded
+        memset(pFrame, ' ', sizeof(pFrame));
+        for (column = 0; column < LCD_DISPLAY_COLUMNS; column++)
+        {
+            if ((pRow->scrollOffset + column) >= pRow->length)
+            {
+                break;
+            }
+            pFrame[column] = pRow->pText[pRow->scrollOffset + column];
+        }
+
+        // Write each run of changed cells
+        column = 0;
+        while (column < LCD_DISPLAY_COLUMNS)
+        {
+            if (pFrame[column] == pShadow[row][column])
+            {
+                column++;
+                continue;
+            }
+
+            start = column;
+            while ((column < LCD_DISPLAY_COLUMNS) &&
+                   (pFrame[column] != pShadow[row][column]))
+            {
+                pShadow[row][column] = pFrame[column];
+                column++;
+            }
+
+            alt_up_character_lcd_set_cursor_pos(pLCD, start, row);
+            alt_up_character_lcd_write(pLCD, &pFrame[start], column - start);
+        }
+    }
+} // render
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
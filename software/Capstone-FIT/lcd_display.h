@@ -0,0 +1,82 @@
+/** @file   lcd_display.h
+ *  @brief  Declarations, Structure, and Constant definitions for the
+ *          character LCD display service.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. The display service owns the 2x16 character LCD; callers submit
+ *  text and a dedicated task writes only the cells that changed.
+ *
+ *  @author Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __LCD_DISPLAY_H
+#define __LCD_DISPLAY_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdbool.h>
+#include "includes.h"
+#include "altera_up_avalon_character_lcd.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define LCD_DISPLAY_ROWS            2
+#define LCD_DISPLAY_COLUMNS         16
+#define LCD_DISPLAY_TEXT_LENGTH     64  // Longer text is truncated
+#define LCD_DISPLAY_QUEUE_SIZE      8
+#define LCD_DISPLAY_TASK_STACKSIZE  2048
+#define LCD_DISPLAY_SCROLL_TICKS    (OS_TICKS_PER_SEC / 3)
+#define LCD_DISPLAY_SCROLL_HOLD     4   // Scroll steps to rest at either end
+
+/*****************************************************************************/
+/* Enumerations                                                              */
+/*****************************************************************************/
+
+typedef enum _LCDLayer
+{
+    LCDLayerBase,       // Persistent text, shown whenever no overlay is up
+    LCDLayerOverlay     // Timed text drawn over the base layer
+} LCDLayer;
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _LCDUpdate;
+struct _LCDRow;
+
+typedef struct _LCDUpdate
+{
+    LCDLayer        layer;
+    INT32U          durationTicks;  // Overlay only, 0 removes the overlay
+    char            pText[LCD_DISPLAY_ROWS][LCD_DISPLAY_TEXT_LENGTH];
+} LCDUpdate;
+
+typedef struct _LCDRow
+{
+    char            pText[LCD_DISPLAY_TEXT_LENGTH];
+    unsigned int    length;
+    unsigned int    scrollOffset;
+    unsigned int    scrollHold;
+} LCDRow;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+INT8U   lcdDisplayInit(const char *pName, INT8U priority);
+INT8U   lcdDisplaySetText(const char *pTopRow, const char *pBottomRow);
+INT8U   lcdDisplayShowOverlay(const char *pTopRow,
+                              const char *pBottomRow,
+                              INT32U      durationTicks);
+INT8U   lcdDisplayClearOverlay();
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __LCD_DISPLAY_H
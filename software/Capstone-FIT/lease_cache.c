@@ -0,0 +1,254 @@
+/** @file   lease_cache.c
+ *  @brief  Routines for keeping the DHCP lease across reboots
+ *
+ *  A cold start used to go through DHCP discovery every time, several
+ *  seconds before the first request could reach the server. Instead:
+ *
+ *  - Once bound, the lease (address, mask, gateway, name servers, server
+ *    ID and time left) is written to flash next to the network settings,
+ *    from task context (leaseCacheSave) since a sector erase takes a while.
+ *    It is written again on any change, and at most once every
+ *    LEASE_CACHE_RESAVE_SECONDS to keep the time left current.
+ *  - On boot get_ip_addr() hands the cached address to the stack, which then
+ *    starts in INIT-REBOOT and broadcasts a REQUEST for it. An ACK binds it
+ *    straight away and a NAK falls back to discovery.
+ *  - If no server answers at all, the DHCP client keeps the cached lease
+ *    for the time it had left (RFC 2131, 3.2) and renews it with the server
+ *    that granted it.
+ *
+ *  The board keeps no time while it is off, so the time left is as of the
+ *  last save. A server that answers always has the final word.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/param.h>
+#include "ipport.h"
+#include "tcpport.h"
+#include "dhcpclnt.h"
+#include "alt_types.h"
+#include "io.h"
+#include "system.h"
+#include "web_server.h"
+#include "lease_cache.h"
+
+#ifndef DHCP_CLIENT
+#error "lease_cache.c needs DHCP_CLIENT enabled in ipport.h"
+#endif
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static int      leaseCacheState(int iface, int state);
+static INT32U   leaseCacheCheck(const LeaseRecord *pRecord);
+
+// Prints the new address, see misclib/dhcsetup.c
+extern int      dhc_main_ipset(int iface, int state);
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+// Location of the network settings sector, found by get_board_mac_addr
+extern alt_u32          last_flash_sector;
+
+static int              leaseIface          = 0;
+static LeaseRecord      leaseSaved;
+static u_long           leaseSavedTick      = 0;
+static volatile bool    bLeaseSavePending   = false;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Take the last lease from flash for an interface about to start
+ *             DHCP, and watch for it binding so the lease can be saved. Must
+ *             be called from get_ip_addr(), before the DHCP client starts.
+ *
+ * @param[in]   iface     Interface doing DHCP
+ * @param[out]  pAddress  Cached address, left alone if there is none
+ * @param[out]  pNetmask  Cached subnet mask, left alone if there is none
+ * @param[out]  pGateway  Cached gateway, left alone if there is none
+ *
+ * @return     True if a lease with time left was found
+ */
+bool
+leaseCacheLoad(int iface, ip_addr *pAddress, ip_addr *pNetmask, ip_addr *pGateway)
+{
+    LeaseRecord record;
+    INT32U     *pWords  = (INT32U *) &record;
+    int         index   = 0;
+
+    leaseIface = iface;
+    memset(&leaseSaved, 0, sizeof(leaseSaved));
+
+    // dhc_setup() leaves a callback that is already set in place
+    dhc_set_callback(iface, leaseCacheState);
+
+    if ((last_flash_sector == 0) ||
+        (IORD_32DIRECT(last_flash_sector, 0) != 0x00005afe))
+    {
+        return false;
+    }
+
+    for (index = 0; index < sizeof(record) / sizeof(INT32U); index++)
+    {
+        pWords[index] = IORD_32DIRECT(last_flash_sector,
+                                      LEASE_CACHE_FLASH_OFFSET + index * sizeof(INT32U));
+    }
+
+    if ((record.signature != LEASE_CACHE_FLASH_SIGNATURE) ||
+        (record.check != leaseCacheCheck(&record)) ||
+        (record.address == 0))
+    {
+        return false;
+    }
+    leaseSaved = record;
+
+    if (record.expiry < LEASE_CACHE_MIN_SECONDS)
+    {
+        return false;
+    }
+
+    *pAddress = record.address;
+    *pNetmask = record.netmask;
+    *pGateway = record.gateway;
+
+    // The DHCP client only resets its state, not these; they go with the
+    // REQUEST and are kept if no server answers it
+    dhc_states[iface].srv_ipaddr = record.server;
+    dhc_states[iface].lease      = record.expiry;
+    memcpy(dhc_states[iface].dnsrv,
+           record.pDnsServers,
+           MIN(sizeof(dhc_states[iface].dnsrv), sizeof(record.pDnsServers)));
+
+    return true;
+} // leaseCacheLoad
+
+/*****************************************************************************/
+
+/**
+ * @brief      Persist the lease once bound. Meant to be called periodically
+ *             from a low priority task; does nothing unless the lease changed
+ *             or the time left saved is LEASE_CACHE_RESAVE_SECONDS old.
+ */
+void
+leaseCacheSave()
+{
+    struct dhc_state   *pState  = &dhc_states[leaseIface];
+    LeaseRecord         record;
+    u_long              elapsed = 0;
+
+    if (pState->state != DHCS_BOUND)
+    {
+        return;
+    }
+
+    // Nothing new since the last save, and the time left on flash is
+    // recent enough
+    if (!bLeaseSavePending &&
+        ((pState->lease == LEASE_CACHE_INFINITE) ||
+         ((cticks - leaseSavedTick) < LEASE_CACHE_RESAVE_SECONDS * TPS)))
+    {
+        return;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.signature = LEASE_CACHE_FLASH_SIGNATURE;
+    record.address   = nets[leaseIface]->n_ipaddr;
+    record.netmask   = nets[leaseIface]->snmask;
+    record.gateway   = nets[leaseIface]->n_defgw;
+    record.server    = pState->srv_ipaddr;
+    memcpy(record.pDnsServers,
+           pState->dnsrv,
+           MIN(sizeof(pState->dnsrv), sizeof(record.pDnsServers)));
+
+    record.expiry = pState->lease;
+    if (record.expiry != LEASE_CACHE_INFINITE)
+    {
+        elapsed = (cticks - pState->lease_start) / TPS;
+        record.expiry = (elapsed < record.expiry) ? (record.expiry - elapsed) : 0;
+    }
+    record.check = leaseCacheCheck(&record);
+
+    // Same lease, and the time left on flash is recent enough
+    if ((record.address == leaseSaved.address) &&
+        (record.netmask == leaseSaved.netmask) &&
+        (record.gateway == leaseSaved.gateway) &&
+        (record.server == leaseSaved.server) &&
+        (memcmp(record.pDnsServers, leaseSaved.pDnsServers, sizeof(record.pDnsServers)) == 0) &&
+        ((record.expiry == LEASE_CACHE_INFINITE) ||
+         ((cticks - leaseSavedTick) < LEASE_CACHE_RESAVE_SECONDS * TPS)))
+    {
+        bLeaseSavePending = false;
+        return;
+    }
+
+    if (SaveFlashRecord(LEASE_CACHE_FLASH_OFFSET, &record, sizeof(record)) == 0)
+    {
+        leaseSaved        = record;
+        leaseSavedTick    = cticks;
+        bLeaseSavePending = false;
+    }
+} // leaseCacheSave
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      DHCP client state callback, from the stack's tasks. Must not
+ *             block.
+ *
+ * @param[in]  iface  Interface that changed state
+ * @param[in]  state  New DHCS_ state
+ *
+ * @return     0
+ */
+static int
+leaseCacheState(int iface, int state)
+{
+    if (state == DHCS_BOUND)
+    {
+        bLeaseSavePending = true;
+    }
+
+    return dhc_main_ipset(iface, state);
+} // leaseCacheState
+
+/*****************************************************************************/
+
+/**
+ * @brief      Check word of a lease record
+ *
+ * @param[in]  pRecord  Record to check, its check word is not included
+ *
+ * @return     Inverted XOR of every other word
+ */
+static INT32U
+leaseCacheCheck(const LeaseRecord *pRecord)
+{
+    const INT32U   *pWords  = (const INT32U *) pRecord;
+    INT32U          check   = 0;
+    int             index   = 0;
+
+    for (index = 0; index < offsetof(LeaseRecord, check) / sizeof(INT32U); index++)
+    {
+        check ^= pWords[index];
+    }
+
+    return ~check;
+} // leaseCacheCheck
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,63 @@
+/** @file   lease_cache.h
+ *  @brief  Declarations and Constant definitions for the DHCP lease cache.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. The last DHCP lease is kept in flash next to the network settings
+ *  so that after a reboot the client asks for the same address again
+ *  (INIT-REBOOT) instead of going through discovery.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __LEASE_CACHE_H
+#define __LEASE_CACHE_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdbool.h>
+#include "includes.h"
+#include "ipport.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define LEASE_CACHE_DNS_SERVERS     2
+#define LEASE_CACHE_INFINITE        0xFFFFFFFF  // Lease that never expires
+#define LEASE_CACHE_MIN_SECONDS     60          // Less left than this isn't worth reclaiming
+#define LEASE_CACHE_RESAVE_SECONDS  3600        // Refresh the time left at most this often
+#define LEASE_CACHE_FLASH_OFFSET    48          // After the resolver's record, see resolver.h
+#define LEASE_CACHE_FLASH_SIGNATURE 0x44484331  // "DHC1"
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _LeaseRecord;
+
+typedef struct _LeaseRecord
+{
+    INT32U  signature;                          // LEASE_CACHE_FLASH_SIGNATURE
+    INT32U  address;                            // Addresses in network byte order
+    INT32U  netmask;
+    INT32U  gateway;
+    INT32U  pDnsServers[LEASE_CACHE_DNS_SERVERS];
+    INT32U  server;                             // DHCP server identifier
+    INT32U  expiry;                             // Seconds of the lease left when saved
+    INT32U  check;                              // ~ of the other fields XORed together
+} LeaseRecord;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+bool    leaseCacheLoad(int iface, ip_addr *pAddress, ip_addr *pNetmask, ip_addr *pGateway);
+void    leaseCacheSave();
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __LEASE_CACHE_H
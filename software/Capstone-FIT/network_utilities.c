@@ -30,6 +30,9 @@
 #include "includes.h"
 #include "io.h"
 #include "web_server.h"
+#ifdef DHCP_CLIENT
+#include "lease_cache.h"
+#endif
 
 #define EXT_FLASH_NAME TRISTATE_CONTROLLER_NAME
 #define EXT_FLASH_BASE TRISTATE_CONTROLLER_BASE
@@ -364,7 +367,8 @@ int get_mac_addr(NET net, unsigned char mac_addr[6])
  * 
  * In our system, we are either attempting DHCP auto-negotiation of IP address,
  * or we are setting our own static IP, Gateway, and Subnet Mask addresses our
- * self. This routine is where that happens.
+ * self. This routine is where that happens. For DHCP the compiled in
+ * addresses are replaced by the last lease, if flash holds one.
  */
 int get_ip_addr(alt_iniche_dev *p_dev,
                 ip_addr* ipaddr,
@@ -379,6 +383,18 @@ int get_ip_addr(alt_iniche_dev *p_dev,
 
 #ifdef DHCP_CLIENT
     *use_dhcp = 1;
+
+    /* With the last lease in hand DHCP starts in INIT-REBOOT and asks for
+     * the same address again, rather than going through discovery.
+     */
+    if (leaseCacheLoad(p_dev->if_num, ipaddr, netmask, gw))
+    {
+        printf("Reclaiming DHCP lease on %d.%d.%d.%d\n",
+            ip4_addr1(*ipaddr),
+            ip4_addr2(*ipaddr),
+            ip4_addr3(*ipaddr),
+            ip4_addr4(*ipaddr));
+    }
 #else /* not DHCP_CLIENT */
     *use_dhcp = 0;
 
@@ -452,6 +468,60 @@ int FindLastFlashSectorOffset(
     return (error);
 }
 
+/*
+ * SaveFlashRecord
+ *
+ *   --> offset                 Offset of the record in the last sector.
+ *   --> pRecord                Record to write.
+ *   --> length                 Length of the record in bytes.
+ *
+ *   Writing flash erases the whole sector, so the network settings and every
+ * record saved after them, up to FLASH_RECORDS_END, are read back and written
+ * again along with the new record. Only records next to valid network
+ * settings are written. The erase takes a while, call from task context.
+ * Returns 0 on success.
+ */
+
+int SaveFlashRecord(
+    int                         offset,
+    const void                  *pRecord,
+    int                         length)
+{
+    alt_u8                      sector[FLASH_RECORDS_END];
+    alt_flash_fd                *fd;
+    int                         n;
+    int                         error = 0;
+
+    if ((last_flash_sector == 0) ||
+        (IORD_32DIRECT(last_flash_sector, 0) != 0x00005afe) ||
+        (offset < 32) ||
+        (offset + length > FLASH_RECORDS_END))
+        error = -1;
+
+    /* Keep the rest of the start of the sector. */
+    if (!error)
+    {
+        for (n = 0; n < FLASH_RECORDS_END; n++)
+            sector[n] = IORD_8DIRECT(last_flash_sector, n);
+        memcpy(sector + offset, pRecord, length);
+
+        fd = alt_flash_open_dev(EXT_FLASH_NAME);
+        if (fd <= 0)
+            error = -1;
+    }
+
+    if (!error)
+    {
+        error = alt_write_flash(fd,
+                                last_flash_sector_offset,
+                                sector,
+                                FLASH_RECORDS_END);
+        alt_flash_close_dev(fd);
+    }
+
+    return (error);
+}
+
 /******************************************************************************
 *                                                                             *
 * License Agreement                                                           *
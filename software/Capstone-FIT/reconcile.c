@@ -0,0 +1,472 @@
+/** @file   reconcile.c
+ *  @brief  Routines for background server reconciliation
+ *
+ *  Item changes are acknowledged to the user as soon as they are applied to
+ *  the local inventory mirror. The change is then queued here and a low
+ *  priority task replays the queue against the server in order, up to
+ *  RECONCILE_BATCH_SIZE changes at a time pipelined on one connection, so a
+ *  backlog built up during an outage drains in about one round trip:
+ *
+ *  - 2xx: the change is confirmed and dropped from the queue.
+ *  - 4xx, or a 3xx or unreadable status: the server won't take the change
+ *         as sent; the mirror is rolled back and the conflict indicator is
+ *         lit.
+ *  - No response or 5xx: the change stays in the queue, ahead of the ones
+ *         queued after it, and is retried with exponential backoff; the
+ *         failure indicator is lit until it goes through. Later changes in
+ *         the same batch that the server did take are not sent again. A
+ *         change still answered 5xx after RECONCILE_MAX_ATTEMPTS is rolled
+ *         back as a conflict.
+ *
+ *  Changes to an item that is already queued (but not in flight) are merged
+ *  into the queued entry so a burst of scans costs one request.
+ *
+ *  Whenever the queue is empty and INVENTORY_SYNC_TICKS have passed, the task
+ *  also pulls the items changed on the server since the last sync token into
+ *  the mirror. Items with changes still queued keep their local quantity
+ *  until those changes have been delivered.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "buttons.h"
+#include "client.h"
+#include "input_tasks.h"
+#include "reconcile.h"
+#include "resolver.h"
+#include "lease_cache.h"
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static void ReconcileTask(void *pData);
+static bool syncHead(INT32U *pRetryTicks);
+static void syncInventory();
+static bool isQueued(const char *pItemName);
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static OS_EVENT    *pReconcileLock      = NULL;
+static OS_EVENT    *pReconcileWake      = NULL;
+static ReconcileOp  pReconcileOps[RECONCILE_QUEUE_SIZE];
+static INT32U       reconcileHead       = 0;
+static INT32U       reconcileTail       = 0;
+static INT32U       reconcileInFlight   = 0;    // Entries from the head being sent
+static ReconcileOp  pBatchOps[RECONCILE_BATCH_SIZE];
+static FITBatchItem pBatchItems[RECONCILE_BATCH_SIZE];
+static OS_STK       pReconcileTaskStack[RECONCILE_TASK_STACKSIZE];
+static char         pSyncBody[INVENTORY_SYNC_SIZE];
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Create the reconciliation queue. Changes can be submitted from
+ *             here on; they wait in the queue until reconcileStart. The
+ *             inventory mirror must already be initialized.
+ *
+ * @return     OS_NO_ERR if no error, error code otherwise
+ */
+INT8U
+reconcileInit()
+{
+    INT8U status = OS_NO_ERR;
+
+    reconcileHead = 0;
+    reconcileTail = 0;
+    reconcileInFlight = 0;
+
+    pReconcileLock = OSSemCreate(1);
+    pReconcileWake = OSSemCreate(0);
+    if ((pReconcileLock == NULL) || (pReconcileWake == NULL))
+    {
+        status = OS_ERR_PDATA_NULL;
+        printf("Reconcile queue setup failed.\n");
+    }
+
+    return status;
+} // reconcileInit
+
+/*****************************************************************************/
+
+/**
+ * @brief      Start the task that delivers the queue to the server. Must be
+ *             called after reconcileInit, once the network stack is up.
+ *
+ * @param[in]  priority  Priority of the reconciliation task, should be lower
+ *                       than every input task
+ *
+ * @return     OS_NO_ERR if no error, error code otherwise
+ */
+INT8U
+reconcileStart(INT8U priority)
+{
+    INT8U status = OS_NO_ERR;
+
+    if (pReconcileLock == NULL)
+    {
+        return OS_ERR_PDATA_NULL;
+    }
+
+    status = OSTaskCreateExt(ReconcileTask,
+                             NULL,
+                             &pReconcileTaskStack[RECONCILE_TASK_STACKSIZE-1],
+                             priority,
+                             priority,
+                             pReconcileTaskStack,
+                             RECONCILE_TASK_STACKSIZE,
+                             NULL,
+                             0);
+    if (status != OS_NO_ERR)
+    {
+        printf("ReconcileTask setup failed.\n");
+    }
+
+    return status;
+} // reconcileStart
+
+/*****************************************************************************/
+
+/**
+ * @brief      Queue a change that has already been applied to the inventory
+ *             mirror for delivery to the server.
+ *
+ * @param[in]  pItemName  Item that changed
+ * @param[in]  amount     Quantity added, negative if removed
+ * @param[in]  applied    Change inventoryApply reported making to the mirror
+ *
+ * @return     OS_NO_ERR if queued, OS_Q_FULL if the queue is full (the caller
+ *             should fall back to a synchronous update), OS_ERR_PDATA_NULL if
+ *             the queue has not been created
+ */
+INT8U
+reconcileSubmit(const char *pItemName, int amount, int applied)
+{
+    INT8U   status  = OS_NO_ERR;
+    INT32U  index   = 0;
+    bool    bMerged = false;
+
+    if ((pReconcileLock == NULL) || (pItemName == NULL))
+    {
+        return OS_ERR_PDATA_NULL;
+    }
+
+    OSSemPend(pReconcileLock, 0, &status);
+    if (status == OS_NO_ERR)
+    {
+        // Entries being sent can't absorb further changes
+        index = reconcileHead + reconcileInFlight;
+        for (; index != reconcileTail; index++)
+        {
+            ReconcileOp *pOp = &pReconcileOps[index & RECONCILE_QUEUE_MASK];
+            if (strncmp(pOp->pName, pItemName, INVENTORY_NAME_LENGTH - 1) == 0)
+            {
+                pOp->amount  += amount;
+                pOp->applied += applied;
+                bMerged = true;
+                break;
+            }
+        }
+
+        if (!bMerged)
+        {
+            if ((reconcileTail - reconcileHead) < RECONCILE_QUEUE_SIZE)
+            {
+                ReconcileOp *pOp = &pReconcileOps[reconcileTail & RECONCILE_QUEUE_MASK];
+                strncpy(pOp->pName, pItemName, INVENTORY_NAME_LENGTH - 1);
+                pOp->pName[INVENTORY_NAME_LENGTH - 1] = '\0';
+                pOp->amount   = amount;
+                pOp->applied  = applied;
+                pOp->attempts = 0;
+                reconcileTail++;
+            }
+            else
+            {
+                status = OS_Q_FULL;
+            }
+        }
+        OSSemPost(pReconcileLock);
+    }
+
+    if (status == OS_NO_ERR)
+    {
+        displayIndicator(FITIndicatorSyncPending, true);
+        OSSemPost(pReconcileWake);
+    }
+
+    return status;
+} // reconcileSubmit
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Reconciliation task; drains the queue whenever a change is
+ *             queued, backing off while the server is unreachable, and
+ *             periodically pulls server side changes into the mirror.
+ *
+ * @param[in]  pData  Unused
+ */
+static void
+ReconcileTask(void *pData)
+{
+    INT8U   status      = OS_NO_ERR;
+    INT32U  retryTicks  = 0;
+    INT32U  retryTick   = 0;
+    INT32U  syncTick    = OSTimeGet();
+    INT32S  remaining   = 0;
+
+    while (1)
+    {
+        // Drain everything queued, stopping if the server stops answering
+        while (syncHead(&retryTicks) && (retryTicks == 0))
+        {
+        }
+
+        // Only pull once local changes are out, the server view includes them
+        if ((retryTicks == 0) && ((INT32S) (OSTimeGet() - syncTick) >= 0))
+        {
+            syncInventory();
+            syncTick = OSTimeGet() + INVENTORY_SYNC_TICKS;
+        }
+
+        // Pre-connections the input tasks never used shouldn't linger
+        client_expire_preconnect();
+
+        // Flash writes are slow, so a new server address and DHCP lease are
+        // saved from here
+        resolverSave();
+        leaseCacheSave();
+
+        if (retryTicks)
+        {
+            // Submissions post the wake semaphore, but must not cut the
+            // backoff short, so wait out the rest of it.
+            retryTick = OSTimeGet() + retryTicks;
+            do
+            {
+                remaining = (INT32S) (retryTick - OSTimeGet());
+                if (remaining > 0)
+                {
+                    OSSemPend(pReconcileWake, (INT16U) MIN(remaining, 0xFFFF), &status);
+                }
+            } while (remaining > 0);
+            retryTicks = 0;
+        }
+        else
+        {
+            OSSemPend(pReconcileWake, INVENTORY_SYNC_TICKS, &status);
+        }
+    }
+} // ReconcileTask
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send the changes at the head of the queue to the server as one
+ *             pipelined batch and act on the responses in order.
+ *
+ * @param[inout]  pRetryTicks  Set to the backoff delay if a change must be
+ *                             retried, otherwise left untouched
+ *
+ * @return     True if the queue still has changes in it, False if it is empty
+ */
+static bool
+syncHead(INT32U *pRetryTicks)
+{
+    static INT32U   backoffTicks    = RECONCILE_RETRY_MIN_TICKS;
+    INT8U           status          = OS_NO_ERR;
+    INT32U          first           = 0;
+    INT32U          count           = 0;
+    INT32U          sent            = 0;
+    INT32U          index           = 0;
+    int             httpStatus      = 0;
+    ReconcileOp    *pOp             = NULL;
+    bool            pConflict[RECONCILE_BATCH_SIZE];
+    bool            bFailed         = false;
+    bool            bPending        = false;
+
+    OSSemPend(pReconcileLock, 0, &status);
+    if (reconcileHead == reconcileTail)
+    {
+        OSSemPost(pReconcileLock);
+        displayIndicator(FITIndicatorSyncPending, false);
+        return false;
+    }
+    first = reconcileHead;
+    count = MIN(reconcileTail - first, RECONCILE_BATCH_SIZE);
+    for (index = 0; index < count; index++)
+    {
+        pBatchOps[index] = pReconcileOps[(first + index) & RECONCILE_QUEUE_MASK];
+    }
+    reconcileInFlight = count;
+    OSSemPost(pReconcileLock);
+
+    // Changes that cancelled out while queued need no request
+    for (index = 0; index < count; index++)
+    {
+        pConflict[index] = false;
+        if (pBatchOps[index].amount != 0)
+        {
+            pBatchItems[sent].pItemString = pBatchOps[index].pName;
+            pBatchItems[sent].amount      = pBatchOps[index].amount;
+            sent++;
+        }
+    }
+    if (sent > 0)
+    {
+        add_items(pBatchItems, sent);
+    }
+
+    // Every change in the batch reached the server, so each response is
+    // acted on even after one fails; only those to retry stay queued
+    OSSemPend(pReconcileLock, 0, &status);
+    reconcileInFlight = 0;
+    for (index = 0, sent = 0; index < count; index++)
+    {
+        pOp        = &pReconcileOps[(first + index) & RECONCILE_QUEUE_MASK];
+        httpStatus = (pBatchOps[index].amount != 0) ? pBatchItems[sent++].httpStatus : 200;
+
+        if ((httpStatus < 0) ||
+            ((httpStatus >= 500) && (pOp->attempts + 1 < RECONCILE_MAX_ATTEMPTS)))
+        {
+            // No answer or a server error; this change and the ones behind
+            // it that didn't go through wait for the next attempt
+            pOp->attempts++;
+            if (!bFailed)
+            {
+                *pRetryTicks = backoffTicks;
+                printf("Sync failed (%d), retrying in %lu ticks: %s\n",
+                       httpStatus,
+                       (unsigned long) backoffTicks,
+                       pBatchOps[index].pName);
+            }
+            bFailed = true;
+            continue;
+        }
+
+        if ((httpStatus < 200) || (httpStatus >= 300))
+        {
+            // Rejected, redirected, no status line or the server keeps
+            // failing on it: sending it again won't change the answer
+            pConflict[index] = true;
+            displayIndicator(FITIndicatorSyncConflict, true);
+            printf("Sync conflict (%d): %s %d\n",
+                   httpStatus,
+                   pBatchOps[index].pName,
+                   pBatchOps[index].amount);
+        }
+
+        // Done with this change. Behind a failed one it must keep its place
+        // in the queue, but there is nothing left of it to send
+        if (!bFailed)
+        {
+            reconcileHead++;
+        }
+        else
+        {
+            pOp->amount  -= pBatchOps[index].amount;
+            pOp->applied -= pBatchOps[index].applied;
+        }
+    }
+
+    if (bFailed)
+    {
+        backoffTicks = MIN(backoffTicks * 2, RECONCILE_RETRY_MAX_TICKS);
+        displayIndicator(FITIndicatorSyncFailed, true);
+    }
+    else
+    {
+        backoffTicks = RECONCILE_RETRY_MIN_TICKS;
+        displayIndicator(FITIndicatorSyncFailed, false);
+    }
+    bPending = (reconcileHead != reconcileTail);
+    OSSemPost(pReconcileLock);
+
+    // Server refused these changes, undo them locally (outside the queue lock)
+    for (index = 0; index < count; index++)
+    {
+        if (pConflict[index])
+        {
+            inventoryApply(pBatchOps[index].pName, -pBatchOps[index].applied, NULL, NULL);
+        }
+    }
+
+    if (!bPending)
+    {
+        displayIndicator(FITIndicatorSyncPending, false);
+    }
+
+    return bPending;
+} // syncHead
+
+/*****************************************************************************/
+
+/**
+ * @brief      Pull the items changed on the server since the last sync into
+ *             the inventory mirror.
+ */
+static void
+syncInventory()
+{
+    INT32U since = inventoryGetSyncToken();
+
+    if (get_inventory_changes(since, pSyncBody, sizeof(pSyncBody)))
+    {
+        if (inventoryApplySync(pSyncBody, isQueued) == OS_NO_ERR)
+        {
+            printf("Inventory synced, token %lu -> %lu\n",
+                   (unsigned long) since,
+                   (unsigned long) inventoryGetSyncToken());
+        }
+    }
+} // syncInventory
+
+/*****************************************************************************/
+
+/**
+ * @brief      Check whether an item has local changes the server has not
+ *             acknowledged yet.
+ *
+ * @param[in]  pItemName  Item to check
+ *
+ * @return     True if the item is queued or in flight, False otherwise
+ */
+static bool
+isQueued(const char *pItemName)
+{
+    INT8U   status  = OS_NO_ERR;
+    INT32U  index   = 0;
+    bool    bQueued = false;
+
+    OSSemPend(pReconcileLock, 0, &status);
+    for (index = reconcileHead; index != reconcileTail; index++)
+    {
+        if (strncmp(pReconcileOps[index & RECONCILE_QUEUE_MASK].pName,
+                    pItemName,
+                    INVENTORY_NAME_LENGTH - 1) == 0)
+        {
+            bQueued = true;
+            break;
+        }
+    }
+    OSSemPost(pReconcileLock);
+
+    return bQueued;
+} // isQueued
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
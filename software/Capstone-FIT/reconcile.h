@@ -0,0 +1,61 @@
+/** @file   reconcile.h
+ *  @brief  Declarations, Structure, and Constant definitions for background
+ *          server reconciliation.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. Item changes are committed to the local inventory mirror first and
+ *  queued here; a background task replays them against the server.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __RECONCILE_H
+#define __RECONCILE_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdbool.h>
+#include "includes.h"
+#include "inventory.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define RECONCILE_QUEUE_SIZE        16  // Must be a power of two
+#define RECONCILE_QUEUE_MASK        (RECONCILE_QUEUE_SIZE - 1)
+#define RECONCILE_TASK_STACKSIZE    2048
+#define RECONCILE_RETRY_MIN_TICKS   (OS_TICKS_PER_SEC)
+#define RECONCILE_RETRY_MAX_TICKS   (30 * OS_TICKS_PER_SEC)
+#define RECONCILE_BATCH_SIZE        8   // Changes sent per pipelined batch, see add_items
+#define RECONCILE_MAX_ATTEMPTS      8   // Server errors before a change is dropped
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _ReconcileOp;
+
+typedef struct _ReconcileOp
+{
+    char            pName[INVENTORY_NAME_LENGTH];
+    int             amount;
+    int             applied;        // Change made to the mirror, undone on a conflict
+    INT32U          attempts;
+} ReconcileOp;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+INT8U   reconcileInit();
+INT8U   reconcileStart(INT8U priority);
+INT8U   reconcileSubmit(const char *pItemName, int amount, int applied);
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __RECONCILE_H
@@ -0,0 +1,273 @@
+/** @file   resolver.c
+ *  @brief  Routines for background server name resolution
+ *
+ *  The server is addressed by host name. Resolution runs once a second off
+ *  the stack's own timer (port_1s_callout) using the non-blocking DNS client
+ *  calls, so it never holds up a request:
+ *
+ *  - The cached address is always returned at once, even past its TTL, so
+ *    a slow or dead name server only means a stale address, never a wait.
+ *  - A refresh is started once RESOLVER_REFRESH_PERCENT of the TTL has gone
+ *    by, and retried every RESOLVER_RETRY_SECONDS until it succeeds.
+ *  - The TTL is tracked here rather than in the DNS client's cache; its copy
+ *    of each answer is expired straight away so every refresh reaches the
+ *    name server.
+ *  - A new address is written to flash next to the network settings, from
+ *    task context (resolverSave) since a sector erase takes a while. After a
+ *    reboot that address is used until DNS answers, and the compiled in
+ *    fallback only if flash holds nothing valid.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "ipport.h"
+#include "tcpport.h"
+#include "dns.h"
+#ifdef DHCP_CLIENT
+#include "dhcpclnt.h"
+#endif
+#include "alt_types.h"
+#include "io.h"
+#include "system.h"
+#include "web_server.h"
+#include "resolver.h"
+
+#ifndef DNS_CLIENT
+#error "resolver.c needs DNS_CLIENT enabled in ipport.h"
+#endif
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static void resolverTick(void);
+static bool resolverHaveNameServer();
+static void resolverLoad();
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+// Location of the network settings sector, found by get_board_mac_addr
+extern alt_u32      last_flash_sector;
+
+// Called once a second by the stack's timer, see allports/timeouts.c
+extern void       (*port_1s_callout)(void);
+
+static char             pResolverName[RESOLVER_NAME_LENGTH];
+static volatile INT32U  resolverAddress     = 0;
+static INT32U           resolverSaved       = 0;
+static u_long           resolverRefreshTick = 0;
+static bool             bResolverPending    = false;
+static volatile bool    bResolverSavePending = false;
+static void           (*pPreviousCallout)(void) = NULL;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Start resolving the server name in the background. Must be
+ *             called once the network stack is up.
+ *
+ * @param[in]  pHostName         Server host name
+ * @param[in]  pFallbackAddress  Dotted decimal address used until the name
+ *                               first resolves, if flash holds none
+ *
+ * @return     OS_NO_ERR if no error, error code otherwise
+ */
+INT8U
+resolverInit(const char *pHostName, const char *pFallbackAddress)
+{
+#if OS_CRITICAL_METHOD == 3
+    OS_CPU_SR cpu_sr = 0;
+#endif
+
+    if ((pHostName == NULL) || (pFallbackAddress == NULL))
+    {
+        return OS_ERR_PDATA_NULL;
+    }
+
+    strncpy(pResolverName, pHostName, RESOLVER_NAME_LENGTH - 1);
+    pResolverName[RESOLVER_NAME_LENGTH - 1] = '\0';
+    resolverAddress = inet_addr((char *) pFallbackAddress);
+    resolverLoad();
+
+    OS_ENTER_CRITICAL();
+    resolverRefreshTick = cticks;
+    pPreviousCallout    = port_1s_callout;
+    port_1s_callout     = resolverTick;
+    OS_EXIT_CRITICAL();
+
+    return OS_NO_ERR;
+} // resolverInit
+
+/*****************************************************************************/
+
+/**
+ * @brief      Get the server address. Never blocks.
+ *
+ * @return     Server IPv4 address in network byte order
+ */
+INT32U
+resolverGetAddress()
+{
+    return resolverAddress;
+} // resolverGetAddress
+
+/*****************************************************************************/
+
+/**
+ * @brief      Persist a newly resolved address to flash. Meant to be called
+ *             periodically from a low priority task; does nothing unless the
+ *             address changed.
+ */
+void
+resolverSave()
+{
+    ResolverRecord  record;
+
+    if (!bResolverSavePending)
+    {
+        return;
+    }
+    bResolverSavePending = false;
+
+    record.signature = RESOLVER_FLASH_SIGNATURE;
+    record.address   = resolverAddress;
+    record.check     = ~record.address;
+
+    // Only write on a change
+    if (record.address == resolverSaved)
+    {
+        return;
+    }
+
+    if (SaveFlashRecord(RESOLVER_FLASH_OFFSET, &record, sizeof(record)) == 0)
+    {
+        resolverSaved = record.address;
+    }
+} // resolverSave
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Once a second from the stack's timer; starts and polls refresh
+ *             queries. Must not block.
+ */
+static void
+resolverTick(void)
+{
+    struct dns_querys  *pEntry  = NULL;
+    u_long              ttl     = 0;
+    int                 error   = 0;
+
+    if (pPreviousCallout)
+    {
+        pPreviousCallout();
+    }
+
+    if ((!bResolverPending && ((long) (cticks - resolverRefreshTick) < 0)) ||
+        !resolverHaveNameServer())
+    {
+        return;
+    }
+
+    // Starts a query, or reports on the one in flight
+    error = dns_query_type(pResolverName, DNS_TYPE_IPADDR, 0, 0, &pEntry);
+    if (error == ENP_SEND_PENDING)
+    {
+        bResolverPending = true;
+        return;
+    }
+    bResolverPending = false;
+
+    if ((error != 0) || (pEntry == NULL) || (pEntry->ipaddrs == 0))
+    {
+        resolverRefreshTick = cticks + RESOLVER_RETRY_SECONDS * TPS;
+        return;
+    }
+
+    resolverAddress = pEntry->ipaddr_list[0];
+    if (resolverAddress != resolverSaved)
+    {
+        bResolverSavePending = true;
+    }
+
+    ttl = MAX(pEntry->expire_time, RESOLVER_MIN_TTL_SECONDS);
+    resolverRefreshTick = cticks + ((ttl * RESOLVER_REFRESH_PERCENT) / 100) * TPS;
+
+    // The TTL is tracked here from now on; let the DNS client age its copy
+    // out so the next refresh goes to the name server
+    pEntry->expire_time = 0;
+} // resolverTick
+
+/*****************************************************************************/
+
+/**
+ * @brief      Make sure the DNS client has a name server, taking the ones
+ *             DHCP handed out.
+ *
+ * @return     True if a name server is set
+ */
+static bool
+resolverHaveNameServer()
+{
+    if (dns_servers[0] != 0)
+    {
+        return true;
+    }
+
+#ifdef DHCP_CLIENT
+    if ((dhc_states[0].state == DHCS_BOUND) && (dhc_states[0].dnsrv[0] != 0))
+    {
+        memcpy(dns_servers,
+               dhc_states[0].dnsrv,
+               MIN(sizeof(dns_servers), sizeof(dhc_states[0].dnsrv)));
+    }
+#endif
+
+    return (dns_servers[0] != 0);
+} // resolverHaveNameServer
+
+/*****************************************************************************/
+
+/**
+ * @brief      Take the last known good address from flash, if there is one.
+ */
+static void
+resolverLoad()
+{
+    ResolverRecord record;
+
+    if ((last_flash_sector == 0) ||
+        (IORD_32DIRECT(last_flash_sector, 0) != 0x00005afe))
+    {
+        return;
+    }
+
+    record.signature = IORD_32DIRECT(last_flash_sector, RESOLVER_FLASH_OFFSET);
+    record.address   = IORD_32DIRECT(last_flash_sector, RESOLVER_FLASH_OFFSET + 4);
+    record.check     = IORD_32DIRECT(last_flash_sector, RESOLVER_FLASH_OFFSET + 8);
+
+    if ((record.signature == RESOLVER_FLASH_SIGNATURE) &&
+        (record.check == ~record.address) &&
+        (record.address != 0))
+    {
+        resolverAddress = record.address;
+        resolverSaved   = record.address;
+    }
+} // resolverLoad
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
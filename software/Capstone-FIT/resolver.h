@@ -0,0 +1,59 @@
+/** @file   resolver.h
+ *  @brief  Declarations and Constant definitions for server name resolution.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. The server's host name is resolved with the stack's DNS client in
+ *  the background and cached for its TTL, so looking up the server address
+ *  never blocks. The last address that resolved is kept in flash and used
+ *  until DNS answers after a reboot.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __RESOLVER_H
+#define __RESOLVER_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdbool.h>
+#include "includes.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define RESOLVER_NAME_LENGTH        64
+#define RESOLVER_REFRESH_PERCENT    75  // Refresh once this much of the TTL is gone
+#define RESOLVER_MIN_TTL_SECONDS    30
+#define RESOLVER_RETRY_SECONDS      15
+#define RESOLVER_FLASH_OFFSET       32  // After the network settings, see network_utilities.c
+#define RESOLVER_FLASH_SIGNATURE    0x444e5331  // "DNS1"
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _ResolverRecord;
+
+typedef struct _ResolverRecord
+{
+    INT32U  signature;  // RESOLVER_FLASH_SIGNATURE
+    INT32U  address;    // Network byte order
+    INT32U  check;      // ~address
+} ResolverRecord;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+INT8U   resolverInit(const char *pHostName, const char *pFallbackAddress);
+INT32U  resolverGetAddress();
+void    resolverSave();
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __RESOLVER_H
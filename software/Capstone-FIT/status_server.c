@@ -0,0 +1,419 @@
+/** @file   status_server.c
+ *  @brief  Routines for the on-board status web server
+ *
+ *  A single low priority task accepts one connection at a time, reads the
+ *  request head, and dispatches GET requests on their path through
+ *  pStatusRoutes. Responses are HTTP/1.0 and delimited by closing the
+ *  connection, so handlers can stream output without knowing its length.
+ *  Each connection gets STATUS_SERVER_TIMEOUT_MS to send its request and
+ *  take the response, so a client that stalls can't hold the server.
+ *
+ *  GET /inventory[?since=<version>]
+ *      Inventory mirror as JSON. With since, only the items that changed
+ *      after that mirror version are listed; pass back the returned
+ *      "version" to poll for deltas.
+ *
+ *  GET /stats
+ *      DM9000A driver counters and ISR duration histogram as JSON, the
+ *      same figures the stack's stats menu shows for the interface.
+ *
+ *  @author Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ipport.h"
+#include "libport.h"
+#include "osport.h"
+#include "tcpport.h"
+#include "transport.h"
+#include "inventory.h"
+#include "dm9000a.h"
+#include "status_server.h"
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static void StatusServerTask(void *pData);
+static void handleConnection(int fd);
+static int  sendString(int fd, const char *pString);
+static int  sendJsonString(int fd, const char *pString);
+static void sendHeader(int fd, const char *pStatus, const char *pContentType);
+static void serveInventory(int fd, const char *pQuery);
+static void serveStats(int fd, const char *pQuery);
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static OS_STK           pStatusServerStack[STATUS_SERVER_STACKSIZE];
+static InventoryEntry   pInventorySnapshot[INVENTORY_TABLE_SIZE];
+static INT32U           connectionDeadline  = 0;
+
+static const StatusRoute pStatusRoutes[] =
+{
+    { "/inventory", serveInventory },
+    { "/stats",     serveStats },
+};
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Start the status server task. Must be called once the network
+ *             stack is up.
+ *
+ * @param[in]  priority  Priority of the server task, should be lower than
+ *                       every input task
+ *
+ * @return     OS_NO_ERR if no error, error code otherwise
+ */
+INT8U
+statusServerInit(INT8U priority)
+{
+    INT8U status = OS_NO_ERR;
+
+    status = OSTaskCreateExt(StatusServerTask,
+                             NULL,
+                             &pStatusServerStack[STATUS_SERVER_STACKSIZE-1],
+                             priority,
+                             priority,
+                             pStatusServerStack,
+                             STATUS_SERVER_STACKSIZE,
+                             NULL,
+                             0);
+    if (status != OS_NO_ERR)
+    {
+        printf("StatusServerTask setup failed.\n");
+    }
+
+    return status;
+} // statusServerInit
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Status server task; listens for and serves connections one at
+ *             a time.
+ *
+ * @param[in]  pData  Unused
+ */
+static void
+StatusServerTask(void *pData)
+{
+    int                 listen_fd   = -1;
+    int                 fd          = -1;
+    struct sockaddr_in  addr;
+
+    if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("Status server couldn't open socket");
+        OSTaskDel(OS_PRIO_SELF);
+    }
+
+    bzero(&addr, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(STATUS_SERVER_PORT);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    if ((bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) ||
+        (listen(listen_fd, 1) < 0))
+    {
+        perror("Status server couldn't listen");
+        close(listen_fd);
+        OSTaskDel(OS_PRIO_SELF);
+    }
+
+    while (1)
+    {
+        fd = accept(listen_fd, NULL, NULL);
+        if (fd >= 0)
+        {
+            handleConnection(fd);
+            close(fd);
+        }
+    }
+} // StatusServerTask
+
+/*****************************************************************************/
+
+/**
+ * @brief      Read a request head and dispatch it to its route.
+ *
+ * @param[in]  fd  Connected socket
+ */
+static void
+handleConnection(int fd)
+{
+    char        pRequest[STATUS_SERVER_REQUEST_SIZE];
+    char       *pPath           = NULL;
+    char       *pQuery          = NULL;
+    char       *pEnd            = NULL;
+    FITError    error           = FITErrorNone;
+    long        total_bytes     = 0;
+    long        bytes_received  = 0;
+    unsigned    route           = 0;
+
+    setsockopt(fd, SOL_SOCKET, SO_NBIO, NULL, 0);
+    connectionDeadline = transport_deadline(STATUS_SERVER_TIMEOUT_MS);
+    pRequest[0] = '\0';
+
+    // Only the request line matters, read until the end of the head
+    do
+    {
+        error = transport_receive_some(fd,
+                                       pRequest + total_bytes,
+                                       sizeof(pRequest) - 1 - total_bytes,
+                                       connectionDeadline,
+                                       &bytes_received);
+        total_bytes += bytes_received;
+        pRequest[total_bytes] = '\0';
+    } while ((error == FITErrorNone) &&
+             (bytes_received > 0) &&
+             (total_bytes < (long) sizeof(pRequest) - 1) &&
+             (strstr(pRequest, "\r\n\r\n") == NULL));
+
+    if (error != FITErrorNone)
+    {
+        // Timed out or reset; the caller closes the connection
+        return;
+    }
+
+    if ((total_bytes == 0) || (strncmp(pRequest, "GET ", 4) != 0))
+    {
+        sendHeader(fd, "405 Method Not Allowed", "text/plain");
+        return;
+    }
+
+    // Split "GET /path?query HTTP/1.x"
+    pPath = pRequest + 4;
+    pEnd  = strpbrk(pPath, " \r\n");
+    if (pEnd)
+    {
+        *pEnd = '\0';
+    }
+    pQuery = strchr(pPath, '?');
+    if (pQuery)
+    {
+        *pQuery++ = '\0';
+    }
+
+    for (route = 0; route < sizeof(pStatusRoutes) / sizeof(pStatusRoutes[0]); route++)
+    {
+        if (strcmp(pPath, pStatusRoutes[route].pPath) == 0)
+        {
+            pStatusRoutes[route].pHandler(fd, pQuery ? pQuery : "");
+            return;
+        }
+    }
+
+    sendHeader(fd, "404 Not Found", "text/plain");
+} // handleConnection
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send a whole string before the connection's deadline.
+ *
+ * @param[in]  fd       Connected socket
+ * @param[in]  pString  String to send
+ *
+ * @return     0 if sent, -1 if the connection failed or timed out
+ */
+static int
+sendString(int fd, const char *pString)
+{
+    if (transport_send(fd, pString, strlen(pString), connectionDeadline) != FITErrorNone)
+    {
+        return -1;
+    }
+
+    return 0;
+} // sendString
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send a string as a quoted JSON string.
+ *
+ * @param[in]  fd       Connected socket
+ * @param[in]  pString  String to send
+ *
+ * @return     0 if sent, -1 if the connection failed
+ */
+static int
+sendJsonString(int fd, const char *pString)
+{
+    char    pLine[STATUS_SERVER_LINE_SIZE];
+    int     count   = 0;
+
+    pLine[count++] = '"';
+    while (*pString && (count < (int) sizeof(pLine) - 3))
+    {
+        if ((*pString == '"') || (*pString == '\\'))
+        {
+            pLine[count++] = '\\';
+        }
+        pLine[count++] = *pString++;
+    }
+    pLine[count++] = '"';
+    pLine[count]   = '\0';
+
+    return sendString(fd, pLine);
+} // sendJsonString
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send a response status line and headers.
+ *
+ * @param[in]  fd            Connected socket
+ * @param[in]  pStatus       Status code and reason, eg. "200 OK"
+ * @param[in]  pContentType  Content-Type of the body
+ */
+static void
+sendHeader(int fd, const char *pStatus, const char *pContentType)
+{
+    char pLine[STATUS_SERVER_LINE_SIZE];
+
+    snprintf(pLine,
+             sizeof(pLine),
+             "HTTP/1.0 %s\r\nContent-Type: %s\r\nConnection: close\r\n\r\n",
+             pStatus,
+             pContentType);
+    sendString(fd, pLine);
+} // sendHeader
+
+/*****************************************************************************/
+
+/**
+ * @brief      Serve the inventory mirror, or the part of it changed after
+ *             the "since" mirror version given in the query.
+ *
+ * @param[in]  fd      Connected socket
+ * @param[in]  pQuery  Query string, without the '?'
+ */
+static void
+serveInventory(int fd, const char *pQuery)
+{
+    char        pLine[STATUS_SERVER_LINE_SIZE];
+    const char *pSince  = strstr(pQuery, "since=");
+    INT32U      since   = pSince ? strtoul(pSince + 6, NULL, 10) : 0;
+    INT32U      version = 0;
+    int         count   = 0;
+    int         index   = 0;
+
+    count = inventorySnapshot(pInventorySnapshot,
+                              INVENTORY_TABLE_SIZE,
+                              since,
+                              &version);
+    if (count < 0)
+    {
+        sendHeader(fd, "503 Service Unavailable", "text/plain");
+        return;
+    }
+
+    sendHeader(fd, "200 OK", "application/json");
+    snprintf(pLine, sizeof(pLine), "{\"version\": %lu, \"items\": [", (unsigned long) version);
+    sendString(fd, pLine);
+
+    for (index = 0; index < count; index++)
+    {
+        InventoryEntry *pEntry = &pInventorySnapshot[index];
+
+        if ((sendString(fd, index ? ", {\"title\": " : "{\"title\": ") < 0) ||
+            (sendJsonString(fd, pEntry->pName) < 0))
+        {
+            return;
+        }
+
+        snprintf(pLine,
+                 sizeof(pLine),
+                 ", \"quantity\": %ld, \"timeAdded\": %lu, \"timeExpired\": %lu}",
+                 (long) pEntry->quantity,
+                 (unsigned long) pEntry->timeAdded,
+                 (unsigned long) pEntry->timeExpired);
+        if (sendString(fd, pLine) < 0)
+        {
+            return;
+        }
+    }
+
+    sendString(fd, "]}\n");
+} // serveInventory
+
+/*****************************************************************************/
+
+/**
+ * @brief      Serve the network driver counters.
+ *
+ * @param[in]  fd      Connected socket
+ * @param[in]  pQuery  Query string, unused
+ */
+static void
+serveStats(int fd, const char *pQuery)
+{
+    char            pLine[STATUS_SERVER_LINE_SIZE];
+    dm9000a_stats   stats;
+    int             bin     = 0;
+
+    dm9000a_get_stats(&stats);
+
+    sendHeader(fd, "200 OK", "application/json");
+    snprintf(pLine,
+             sizeof(pLine),
+             "{\"rxInterrupts\": %lu, \"txInterrupts\": %lu, "
+             "\"rxFrames\": %lu, \"rxBytes\": %lu, "
+             "\"txFrames\": %lu, \"txBytes\": %lu, ",
+             stats.rx_ints,
+             stats.tx_ints,
+             stats.rx_frames,
+             stats.rx_bytes,
+             stats.tx_frames,
+             stats.tx_bytes);
+    if (sendString(fd, pLine) < 0)
+    {
+        return;
+    }
+
+    snprintf(pLine,
+             sizeof(pLine),
+             "\"rxDiscards\": %lu, \"rxBad\": %lu, \"autoResets\": %lu, "
+             "\"txQueued\": %lu, \"txCopyCycles\": %lu, "
+             "\"isrMaxCycles\": %lu, \"isrHistogramUs\": [",
+             stats.rx_discards,
+             stats.rx_bad,
+             stats.auto_resets,
+             stats.tx_queued,
+             stats.tx_copy_cycles,
+             stats.isr_max_cycles);
+    if (sendString(fd, pLine) < 0)
+    {
+        return;
+    }
+
+    // Bin n counts ISRs under 2^(n+1) microseconds, the last one the rest
+    for (bin = 0; bin < DM9000A_ISR_HIST_BINS; bin++)
+    {
+        snprintf(pLine, sizeof(pLine), bin ? ", %lu" : "%lu", stats.isr_hist[bin]);
+        if (sendString(fd, pLine) < 0)
+        {
+            return;
+        }
+    }
+
+    sendString(fd, "]}\n");
+} // serveStats
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,53 @@
+/** @file   status_server.h
+ *  @brief  Declarations, Structure, and Constant definitions for the
+ *          on-board status web server.
+ *
+ *  Functions in the public API can be found under the *Functions* header
+ *  below. The status server answers small read-only HTTP GET requests from
+ *  the local network, eg. the inventory mirror at /inventory.
+ *
+ *  @author Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __STATUS_SERVER_H
+#define __STATUS_SERVER_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include "includes.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define STATUS_SERVER_PORT          80
+#define STATUS_SERVER_STACKSIZE     2048
+#define STATUS_SERVER_REQUEST_SIZE  512     // Longer request heads are cut
+#define STATUS_SERVER_LINE_SIZE     256
+#define STATUS_SERVER_TIMEOUT_MS    5000    // Per connection, request and response
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct _StatusRoute;
+
+typedef struct _StatusRoute
+{
+    const char     *pPath;
+    void          (*pHandler)(int fd, const char *pQuery);
+} StatusRoute;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+INT8U   statusServerInit(INT8U priority);
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __STATUS_SERVER_H
@@ -0,0 +1,394 @@
+/** @file   transport.c
+ *  @brief  Routines for deadline bounded socket transfers
+ *
+ *  The stack's blocking calls wait on its own (long) timeouts, so an
+ *  unreachable server could hold an input task for many seconds. Every
+ *  socket opened here is non-blocking; each call waits in select() for at
+ *  most the time left before the caller's deadline and reports which phase
+ *  ran out of time.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "ipport.h"
+#include "libport.h"
+#include "osport.h"
+#include "tcpport.h"
+#include "transport.h"
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static FITError wait_ready(int fd, int for_write, INT32U deadline, FITError timeoutError);
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Convert a timeout into an absolute deadline
+ *
+ * @param[in]  timeout_ms  Time allowed from now
+ *
+ * @return     Deadline in OS ticks
+ */
+INT32U
+transport_deadline(long timeout_ms)
+{
+    return OSTimeGet() + (INT32U) ((timeout_ms * OS_TICKS_PER_SEC) / 1000);
+} // transport_deadline
+
+/*****************************************************************************/
+
+/**
+ * @brief      Open a non-blocking socket and start connecting. Never blocks.
+ *
+ * @param[in]     address   Server IPv4 address, network byte order
+ * @param[in]     port      Server port
+ * @param[inout]  pFd       Socket with the connection in progress
+ *
+ * @return     FITErrorNone if the connection is underway, error otherwise
+ */
+FITError
+transport_start_connect(INT32U address, unsigned short port, int *pFd)
+{
+    int                 fd = -1;
+    struct sockaddr_in  server_info;
+
+    *pFd = -1;
+
+    // Input tasks run from boot, before the stack can take a socket call
+    if (!iniche_net_ready)
+    {
+        return FITErrorNoNetwork;
+    }
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("Couldn't open socket");
+        return FITErrorSocket;
+    }
+
+    bzero(&server_info, sizeof(server_info));
+    server_info.sin_family      = AF_INET;
+    server_info.sin_port        = htons(port);
+    server_info.sin_addr.s_addr = address;
+
+    setsockopt(fd, SOL_SOCKET, SO_NBIO, NULL, 0);
+    if ((connect(fd, (struct sockaddr *) &server_info, sizeof(server_info)) != 0) &&
+        (t_errno(fd) != EINPROGRESS))
+    {
+        perror("Couldn't connect to server");
+        close(fd);
+        return FITErrorConnectFailed;
+    }
+
+    *pFd = fd;
+    return FITErrorNone;
+} // transport_start_connect
+
+/*****************************************************************************/
+
+/**
+ * @brief      Wait for a connection started by transport_start_connect
+ *
+ * @param[in]  fd        Socket with the connection in progress
+ * @param[in]  deadline  Give up at this tick
+ *
+ * @return     FITErrorNone if connected, error otherwise
+ */
+FITError
+transport_finish_connect(int fd, INT32U deadline)
+{
+    FITError    ready       = FITErrorNone;
+    int         error       = 0;
+    int         error_len   = sizeof(error);
+
+    ready = wait_ready(fd, 1, deadline, FITErrorConnectTimeout);
+    if (ready != FITErrorNone)
+    {
+        return ready;
+    }
+
+    if ((bsd_getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0) ||
+        (error != 0))
+    {
+        return FITErrorConnectFailed;
+    }
+
+    return FITErrorNone;
+} // transport_finish_connect
+
+/*****************************************************************************/
+
+/**
+ * @brief      Connect to a server before a deadline
+ *
+ * @param[in]     address   Server IPv4 address, network byte order
+ * @param[in]     port      Server port
+ * @param[in]     deadline  Give up at this tick
+ * @param[inout]  pFd       Connected socket, -1 on error
+ *
+ * @return     FITErrorNone if connected, error otherwise
+ */
+FITError
+transport_connect(INT32U          address,
+                  unsigned short  port,
+                  INT32U          deadline,
+                  int            *pFd)
+{
+    FITError error = transport_start_connect(address, port, pFd);
+
+    if (error == FITErrorNone)
+    {
+        error = transport_finish_connect(*pFd, deadline);
+        if (error != FITErrorNone)
+        {
+            close(*pFd);
+            *pFd = -1;
+        }
+    }
+
+    return error;
+} // transport_connect
+
+/*****************************************************************************/
+
+/**
+ * @brief      Send a whole buffer before a deadline
+ *
+ * @param[in]  fd        Connected socket
+ * @param[in]  pData     Data to send
+ * @param[in]  length    Number of bytes to send
+ * @param[in]  deadline  Give up at this tick
+ *
+ * @return     FITErrorNone if everything was sent, error otherwise
+ */
+FITError
+transport_send(int fd, const char *pData, long length, INT32U deadline)
+{
+    FITError    error       = FITErrorNone;
+    int         sent_bytes  = 0;
+
+    while (length > 0)
+    {
+        error = wait_ready(fd, 1, deadline, FITErrorSendStall);
+        if (error != FITErrorNone)
+        {
+            return error;
+        }
+
+        sent_bytes = send(fd, (char *) pData, length, 0);
+        if (sent_bytes > 0)
+        {
+            pData  += sent_bytes;
+            length -= sent_bytes;
+        }
+        else if ((sent_bytes < 0) && (t_errno(fd) != EWOULDBLOCK))
+        {
+            perror("Error while sending");
+            return FITErrorSendFailed;
+        }
+    }
+
+    return FITErrorNone;
+} // transport_send
+
+/*****************************************************************************/
+
+/**
+ * @brief      Receive until the server closes the connection, before a
+ *             deadline. The buffer is always NUL terminated.
+ *
+ * @param[in]     fd          Connected socket
+ * @param[inout]  pBuffer     Buffer for the response, pre-allocated by caller
+ * @param[in]     bufferSize  Size of pBuffer
+ * @param[in]     deadline    Give up at this tick
+ * @param[inout]  pReceived   Number of bytes received, even on error
+ *
+ * @return     FITErrorNone if the whole response arrived, error otherwise
+ */
+FITError
+transport_receive(int     fd,
+                  char   *pBuffer,
+                  long    bufferSize,
+                  INT32U  deadline,
+                  long   *pReceived)
+{
+    FITError    error           = FITErrorNone;
+    long        total_bytes     = 0;
+    int         bytes_received  = 0;
+
+    while (1)
+    {
+        if (total_bytes >= (bufferSize - 1))
+        {
+            error = FITErrorResponseTooLarge;
+            break;
+        }
+
+        error = wait_ready(fd, 0, deadline, FITErrorSlowResponse);
+        if (error != FITErrorNone)
+        {
+            break;
+        }
+
+        bytes_received = recv(fd, pBuffer + total_bytes, bufferSize - 1 - total_bytes, 0);
+        if (bytes_received > 0)
+        {
+            total_bytes += bytes_received;
+        }
+        else if (bytes_received == 0)
+        {
+            break;
+        }
+        else if (t_errno(fd) != EWOULDBLOCK)
+        {
+            perror("Error while receiving");
+            error = FITErrorReceiveFailed;
+            break;
+        }
+    }
+
+    pBuffer[total_bytes] = '\0';
+    *pReceived = total_bytes;
+    return error;
+} // transport_receive
+
+/*****************************************************************************/
+
+/**
+ * @brief      Receive whatever is available, waiting until the deadline for
+ *             at least one byte. For callers that parse as data arrives.
+ *
+ * @param[in]     fd          Connected socket
+ * @param[inout]  pBuffer     Buffer for the data, pre-allocated by caller
+ * @param[in]     bufferSize  Size of pBuffer
+ * @param[in]     deadline    Give up at this tick
+ * @param[inout]  pReceived   Number of bytes received, 0 if the server
+ *                            closed the connection
+ *
+ * @return     FITErrorNone if data arrived or the connection closed, error
+ *             otherwise
+ */
+FITError
+transport_receive_some(int     fd,
+                       char   *pBuffer,
+                       long    bufferSize,
+                       INT32U  deadline,
+                       long   *pReceived)
+{
+    FITError    error           = FITErrorNone;
+    int         bytes_received  = 0;
+
+    *pReceived = 0;
+
+    while (1)
+    {
+        error = wait_ready(fd, 0, deadline, FITErrorSlowResponse);
+        if (error != FITErrorNone)
+        {
+            return error;
+        }
+
+        bytes_received = recv(fd, pBuffer, bufferSize, 0);
+        if (bytes_received >= 0)
+        {
+            *pReceived = bytes_received;
+            return FITErrorNone;
+        }
+        else if (t_errno(fd) != EWOULDBLOCK)
+        {
+            perror("Error while receiving");
+            return FITErrorReceiveFailed;
+        }
+    }
+} // transport_receive_some
+
+/*****************************************************************************/
+
+/**
+ * @brief      Short description of an error, fit for the LCD
+ *
+ * @param[in]  error  Error to describe
+ *
+ * @return     Description
+ */
+const char*
+transport_error_string(FITError error)
+{
+    switch (error)
+    {
+    case FITErrorNone:              return "OK";
+    case FITErrorConnectTimeout:    return "Connect timeout";
+    case FITErrorSendStall:         return "Send stalled";
+    case FITErrorSlowResponse:      return "Server too slow";
+    case FITErrorResponseTooLarge:  return "Response too big";
+    case FITErrorNotSent:           return "Not sent";
+    case FITErrorNoNetwork:         return "Network starting";
+    case FITErrorSelectFailed:      return "Socket error";
+    default:                        return "Could not connect to internet.";
+    }
+} // transport_error_string
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Wait for a socket to become readable or writable
+ *
+ * @param[in]  fd            Socket to wait on
+ * @param[in]  for_write     1 to wait until writable, 0 until readable
+ * @param[in]  deadline      Give up at this tick
+ * @param[in]  timeoutError  Error to report if the deadline passes
+ *
+ * @return     FITErrorNone if ready, timeoutError if the deadline passed,
+ *             FITErrorSelectFailed if select() failed
+ */
+static FITError
+wait_ready(int fd, int for_write, INT32U deadline, FITError timeoutError)
+{
+    fd_set          fds;
+    struct timeval  timeout;
+    INT32S          remaining = (INT32S) (deadline - OSTimeGet());
+    int             ready     = 0;
+
+    if (remaining <= 0)
+    {
+        return timeoutError;
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    timeout.tv_sec  = remaining / OS_TICKS_PER_SEC;
+    timeout.tv_usec = (((remaining % OS_TICKS_PER_SEC) * 1000) / OS_TICKS_PER_SEC) * 1000;
+
+    if (for_write)
+    {
+        ready = select(fd + 1, NULL, &fds, NULL, &timeout);
+    }
+    else
+    {
+        ready = select(fd + 1, &fds, NULL, NULL, &timeout);
+    }
+
+    if (ready < 0)
+    {
+        perror("Error while waiting on socket");
+        return FITErrorSelectFailed;
+    }
+
+    return (ready > 0) ? FITErrorNone : timeoutError;
+} // wait_ready
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,70 @@
+/** @file   transport.h
+ *  @brief  Public facing routines for deadline bounded socket transfers
+ *
+ *  Sockets are kept in non-blocking mode and driven with select() against
+ *  an absolute deadline (in OS ticks), so a request can never stall longer
+ *  than its caller allows. Each phase of a request fails with its own error.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __TRANSPORT_H
+#define __TRANSPORT_H
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include "includes.h"
+
+/*****************************************************************************/
+/* Enumerations                                                              */
+/*****************************************************************************/
+
+typedef enum _FITError
+{
+    FITErrorNone                =  0,
+    FITErrorSocket              = -1,   // Out of sockets or memory
+    FITErrorConnectFailed       = -2,   // Refused, reset or unreachable
+    FITErrorConnectTimeout      = -3,   // No handshake before the deadline
+    FITErrorSendFailed          = -4,
+    FITErrorSendStall           = -5,   // Server stopped taking the request
+    FITErrorReceiveFailed       = -6,
+    FITErrorSlowResponse        = -7,   // Response not complete in time
+    FITErrorResponseTooLarge    = -8,
+    FITErrorNotSent             = -9,   // Skipped, an earlier request in its batch failed
+    FITErrorNoNetwork           = -10,  // Stack still coming up, see FITSetup
+    FITErrorSelectFailed        = -11   // Socket broke while waiting on it
+} FITError;
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+INT32U      transport_deadline(long timeout_ms);
+FITError    transport_start_connect(INT32U          address,
+                                    unsigned short  port,
+                                    int            *pFd);
+FITError    transport_finish_connect(int fd, INT32U deadline);
+FITError    transport_connect(INT32U          address,
+                              unsigned short  port,
+                              INT32U          deadline,
+                              int            *pFd);
+FITError    transport_send(int fd, const char *pData, long length, INT32U deadline);
+FITError    transport_receive(int     fd,
+                              char   *pBuffer,
+                              long    bufferSize,
+                              INT32U  deadline,
+                              long   *pReceived);
+FITError    transport_receive_some(int     fd,
+                                   char   *pBuffer,
+                                   long    bufferSize,
+                                   INT32U  deadline,
+                                   long   *pReceived);
+const char* transport_error_string(FITError error);
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
+
+#endif // __TRANSPORT_H
@@ -44,6 +44,9 @@
 #include "alt_error_handler.h"
 #include "web_server.h"
 #include "dm9000a.h"
+#include "boot_timeline.h"
+#include "buttons.h"
+#include "input_tasks.h"
 
 /* Nichestack definitions */
 #include "ipport.h"
@@ -125,6 +128,8 @@ void WSInitialTask(void* pdata)
 {
   INT8U error_code = OS_NO_ERR;
 
+  bootTimelineMark("Tasks started");
+
   /*
   * Initialize Altera NicheStack TCP/IP Stack - Nios II Edition specific code.
   * NicheStack is initialized from a task, so that RTOS will have started, and
@@ -137,12 +142,21 @@ void WSInitialTask(void* pdata)
    * devices.
    */
   netmain();
-  /* Wait for the network stack to be ready before proceeding. */
+
+  /* The net task sleeps while the PHY negotiates and DHCP runs, so the
+   * input devices and their tasks come up meanwhile. Scans are taken from
+   * here on; lookups fail until the network is ready.
+   */
+  FITSetup();
+
+  /* Wait for the network stack to be ready before starting the tasks that
+   * talk to the server.
+   */
   while (!iniche_net_ready)
     TK_SLEEP(1);
+  bootTimelineMark("Network ready");
 
-  /* Create the main tasks for food inventory tracking. */
-  FITSetup();
+  FITNetworkSetup();
 
   /* Application specific code starts here... */
 
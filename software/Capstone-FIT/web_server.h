@@ -31,6 +31,19 @@
  */
 void die_with_error(char err_msg[]);
 
+/*
+ *  SaveFlashRecord() - Writes a record kept after the network settings in
+ *                      the last flash sector, keeping the settings and the
+ *                      other records.
+ */
+int SaveFlashRecord(int offset, const void *pRecord, int length);
+
+/*
+ * The network settings take the first 32 bytes of the last flash sector, the
+ * records saved after them must end here.
+ */
+#define FLASH_RECORDS_END       128
+
 /*
  * Mailbox to control board features
  *
@@ -0,0 +1,398 @@
+/** @file   coap_server.c
+ *  @brief  Local stand-in for the FIT server's CoAP endpoint
+ *
+ *  Serves the same resources the board uses over CoAP from an in-memory
+ *  inventory and a fixed barcode table, so the UDP transport can be tested
+ *  without the real server. Like a real CoAP server it remembers recent
+ *  responses by Message ID and peer and resends them for duplicates, so a
+ *  retransmitted add is only applied once.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../Capstone-FIT/coap.h"
+#include "coap_server.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define SERVER_ITEMS        32
+#define SERVER_NAME_SIZE    128
+#define SERVER_CACHE_SIZE   16
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+typedef struct _ServerItem
+{
+    char    pName[SERVER_NAME_SIZE];
+    int     quantity;
+} ServerItem;
+
+typedef struct _CachedResponse
+{
+    int                 bUsed;
+    unsigned short      messageId;
+    struct sockaddr_in  peer;
+    unsigned char       pDatagram[COAP_MAX_MESSAGE_SIZE];
+    int                 length;
+} CachedResponse;
+
+/*****************************************************************************/
+/* Declarations                                                              */
+/*****************************************************************************/
+
+static void             serve(int fd, int flags);
+static unsigned char    handle(const CoapMessage *pRequest, char *pBody, int bodySize);
+static ServerItem*      find_item(const char *pName, int create);
+static CachedResponse*  find_cached(unsigned short messageId, const struct sockaddr_in *pPeer);
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+static ServerItem       items[SERVER_ITEMS];
+static CachedResponse   cache[SERVER_CACHE_SIZE];
+static int              cache_next = 0;
+
+static const char *barcodes[][2] =
+{
+    { "028000521455", "Fruit Punch Juice Box,  8 - 6.75 fl oz boxes" },
+    { "068100084245", "Kraft Dinner Original" },
+};
+
+/*****************************************************************************/
+/* Functions                                                                 */
+/*****************************************************************************/
+
+/**
+ * @brief      Start the stand-in server in a child process
+ *
+ * @param[in]  port   UDP port to listen on, on localhost
+ * @param[in]  flags  COAP_SERVER_* behaviour flags
+ *
+ * @return     Process id of the server, -1 on error
+ */
+pid_t
+coap_server_spawn(unsigned short port, int flags)
+{
+    int                 fd  = -1;
+    pid_t               pid = -1;
+    struct sockaddr_in  addr;
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        perror("Couldn't open socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    // Bind before forking so the caller can send as soon as this returns
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        perror("Couldn't bind");
+        close(fd);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == 0)
+    {
+        serve(fd, flags);
+        _exit(0);
+    }
+
+    close(fd);
+    return pid;
+} // coap_server_spawn
+
+/*****************************************************************************/
+
+/**
+ * @brief      Stop a server started by coap_server_spawn
+ *
+ * @param[in]  pid  Process id of the server
+ */
+void
+coap_server_stop(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+} // coap_server_stop
+
+/*****************************************************************************/
+/* Static Functions                                                          */
+/*****************************************************************************/
+
+/**
+ * @brief      Answer requests forever
+ *
+ * @param[in]  fd     Bound UDP socket
+ * @param[in]  flags  COAP_SERVER_* behaviour flags
+ */
+static void
+serve(int fd, int flags)
+{
+    unsigned char       pDatagram[COAP_MAX_MESSAGE_SIZE];
+    char                pBody[COAP_MAX_MESSAGE_SIZE / 2];
+    unsigned short      message_id = 0x4000;
+    int                 received   = 0;
+    struct sockaddr_in  peer;
+    socklen_t           peer_length;
+    CoapMessage         request;
+    CoapMessage         response;
+    CachedResponse     *pCached    = NULL;
+
+    while (1)
+    {
+        peer_length = sizeof(peer);
+        received = recvfrom(fd, pDatagram, sizeof(pDatagram), 0, (struct sockaddr *) &peer, &peer_length);
+        if ((received <= 0) ||
+            (coap_decode(pDatagram, received, &request) != 0) ||
+            (request.type != CoapTypeConfirmable))
+        {
+            continue;   // ACKs of separate responses need no answer here
+        }
+
+        // Duplicate, send the same answer again without redoing the work
+        pCached = find_cached(request.messageId, &peer);
+        if (pCached)
+        {
+            sendto(fd, pCached->pDatagram, pCached->length, 0, (struct sockaddr *) &peer, peer_length);
+            continue;
+        }
+
+        coap_init_message(&response, CoapTypeAcknowledgement, 0);
+        response.messageId   = request.messageId;
+        response.tokenLength = request.tokenLength;
+        memcpy(response.pToken, request.pToken, request.tokenLength);
+
+        if (flags & COAP_SERVER_SEPARATE)
+        {
+            // Empty ACK now, the response follows as its own confirmable message
+            response.tokenLength = 0;
+            pCached = &cache[cache_next++ % SERVER_CACHE_SIZE];
+            pCached->length = coap_encode(&response, pCached->pDatagram, sizeof(pCached->pDatagram));
+            sendto(fd, pCached->pDatagram, pCached->length, 0, (struct sockaddr *) &peer, peer_length);
+
+            response.type        = CoapTypeConfirmable;
+            response.messageId   = message_id++;
+            response.tokenLength = request.tokenLength;
+        }
+        else
+        {
+            pCached = &cache[cache_next++ % SERVER_CACHE_SIZE];
+        }
+
+        response.code = handle(&request, pBody, sizeof(pBody));
+        if (pBody[0])
+        {
+            response.contentFormat = COAP_FORMAT_TEXT;
+            response.pPayload      = (const unsigned char *) pBody;
+            response.payloadLength = strlen(pBody);
+        }
+
+        pCached->bUsed     = 1;
+        pCached->messageId = request.messageId;
+        pCached->peer      = peer;
+        if (!(flags & COAP_SERVER_SEPARATE))
+        {
+            pCached->length = coap_encode(&response, pCached->pDatagram, sizeof(pCached->pDatagram));
+            memcpy(pDatagram, pCached->pDatagram, pCached->length);
+            received = pCached->length;
+        }
+        else
+        {
+            received = coap_encode(&response, pDatagram, sizeof(pDatagram));
+        }
+
+        if (flags & COAP_SERVER_DROP_FIRST_RESPONSE)
+        {
+            flags &= ~COAP_SERVER_DROP_FIRST_RESPONSE;
+            continue;
+        }
+        if (flags & COAP_SERVER_STALE_ACK)
+        {
+            // Same Message ID, as if from an older exchange that reused it
+            unsigned char pStale[COAP_MAX_MESSAGE_SIZE];
+            CoapMessage   stale;
+            int           length;
+
+            coap_init_message(&stale, CoapTypeAcknowledgement, COAP_CODE(4, 4));
+            stale.messageId   = request.messageId;
+            stale.tokenLength = request.tokenLength;
+            memcpy(stale.pToken, request.pToken, request.tokenLength);
+            stale.pToken[0] ^= 0xFF;
+            length = coap_encode(&stale, pStale, sizeof(pStale));
+            sendto(fd, pStale, length, 0, (struct sockaddr *) &peer, peer_length);
+        }
+        sendto(fd, pDatagram, received, 0, (struct sockaddr *) &peer, peer_length);
+    }
+} // serve
+
+/*****************************************************************************/
+
+/**
+ * @brief      Carry out a request
+ *
+ * @param[in]     pRequest  Request to carry out
+ * @param[inout]  pBody     Response payload, empty for none
+ * @param[in]     bodySize  Size of pBody
+ *
+ * @return     Response code
+ */
+static unsigned char
+handle(const CoapMessage *pRequest, char *pBody, int bodySize)
+{
+    char        pName[SERVER_NAME_SIZE];
+    char        pPayload[COAP_MAX_MESSAGE_SIZE + 1];
+    const char *pPosition = NULL;
+    ServerItem *pItem     = NULL;
+    unsigned    index     = 0;
+
+    pBody[0] = '\0';
+
+    if ((pRequest->code == COAP_GET) && (strncmp(pRequest->pUriPath, "barcode/", 8) == 0))
+    {
+        for (index = 0; index < sizeof(barcodes) / sizeof(barcodes[0]); index++)
+        {
+            if (strcmp(pRequest->pUriPath + 8, barcodes[index][0]) == 0)
+            {
+                snprintf(pBody, bodySize, "%s", barcodes[index][1]);
+                return COAP_CODE(2, 5);
+            }
+        }
+        return COAP_CODE(4, 4);
+    }
+
+    if ((pRequest->code == COAP_PUT) && (strcmp(pRequest->pUriPath, "1/inventory") == 0))
+    {
+        // Just enough JSON for the add body: "title": "...", "quantity": N
+        memcpy(pPayload, pRequest->pPayload, pRequest->payloadLength);
+        pPayload[pRequest->payloadLength] = '\0';
+        if ((pPosition = strstr(pPayload, "\"title\": \"")) == NULL ||
+            (sscanf(pPosition + 10, "%127[^\"]", pName) != 1) ||
+            (pPosition = strstr(pPayload, "\"quantity\": ")) == NULL ||
+            ((pItem = find_item(pName, 1)) == NULL))
+        {
+            return COAP_CODE(4, 0);
+        }
+        pItem->quantity += atoi(pPosition + 12);
+        if (pItem->quantity < 0)
+        {
+            pItem->quantity = 0;
+        }
+        return COAP_CODE(2, 4);
+    }
+
+    if (strncmp(pRequest->pUriPath, "1/inventory/title/", 18) == 0)
+    {
+        pItem = find_item(pRequest->pUriPath + 18, 0);
+        if (pItem == NULL)
+        {
+            return COAP_CODE(4, 4);
+        }
+        if (pRequest->code == COAP_GET)
+        {
+            snprintf(pBody, bodySize, "%d", pItem->quantity);
+            return COAP_CODE(2, 5);
+        }
+        if (pRequest->code == COAP_DELETE)
+        {
+            pItem->pName[0] = '\0';
+            return COAP_CODE(2, 2);
+        }
+    }
+
+    return COAP_CODE(4, 5);
+} // handle
+
+/*****************************************************************************/
+
+/**
+ * @brief      Find an item in the inventory
+ *
+ * @param[in]  pName   Item name
+ * @param[in]  create  Add the item if it is missing
+ *
+ * @return     Item, NULL if missing and not created
+ */
+static ServerItem*
+find_item(const char *pName, int create)
+{
+    ServerItem *pFree = NULL;
+    int         index = 0;
+
+    for (index = 0; index < SERVER_ITEMS; index++)
+    {
+        if (strcmp(items[index].pName, pName) == 0 && items[index].pName[0])
+        {
+            return &items[index];
+        }
+        if ((pFree == NULL) && (items[index].pName[0] == '\0'))
+        {
+            pFree = &items[index];
+        }
+    }
+
+    if (create && pFree)
+    {
+        snprintf(pFree->pName, SERVER_NAME_SIZE, "%s", pName);
+        pFree->quantity = 0;
+        return pFree;
+    }
+
+    return NULL;
+} // find_item
+
+/*****************************************************************************/
+
+/**
+ * @brief      Find the response already sent for a request
+ *
+ * @param[in]  messageId  Message ID of the request
+ * @param[in]  pPeer      Where the request came from
+ *
+ * @return     Cached response, NULL if the request is new
+ */
+static CachedResponse*
+find_cached(unsigned short messageId, const struct sockaddr_in *pPeer)
+{
+    int index = 0;
+
+    for (index = 0; index < SERVER_CACHE_SIZE; index++)
+    {
+        if (cache[index].bUsed &&
+            (cache[index].messageId == messageId) &&
+            (cache[index].peer.sin_port == pPeer->sin_port) &&
+            (cache[index].peer.sin_addr.s_addr == pPeer->sin_addr.s_addr))
+        {
+            return &cache[index];
+        }
+    }
+
+    return NULL;
+} // find_cached
+
+/*****************************************************************************/
+/* End of File                                                               */
+/*****************************************************************************/
@@ -0,0 +1,14 @@
+#ifndef __COAP_SERVER_H
+#define __COAP_SERVER_H
+
+#include <sys/types.h>
+
+// Stand-in for the FIT server's CoAP endpoint, for tests only
+#define COAP_SERVER_DROP_FIRST_RESPONSE 0x1 // Lose the first response sent
+#define COAP_SERVER_SEPARATE            0x2 // Empty ACK, then a separate response
+#define COAP_SERVER_STALE_ACK           0x4 // ACK with the right Message ID but another token first
+
+pid_t coap_server_spawn(unsigned short port, int flags);
+void  coap_server_stop(pid_t pid);
+
+#endif
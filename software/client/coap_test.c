@@ -0,0 +1,167 @@
+#include "../Capstone-FIT/coap.h"
+#include "coap_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define TEST_PORT   56830
+
+struct sockaddr_in server;
+unsigned char      buffer[COAP_MAX_MESSAGE_SIZE];
+char               body[COAP_MAX_MESSAGE_SIZE];
+
+// Make one request to the stand-in, returns the response code as HTTP style status
+int request(int fd, unsigned char method, const char *path, const char *json) {
+    CoapMessage req;
+    CoapMessage resp;
+
+    coap_init_message(&req, CoapTypeConfirmable, method);
+    strcpy(req.pUriPath, path);
+    if (json) {
+        req.contentFormat = COAP_FORMAT_JSON;
+        req.pPayload = (const unsigned char *)json;
+        req.payloadLength = strlen(json);
+    }
+
+    int result = coap_exchange(fd, &server, sizeof(server), &req, buffer, sizeof(buffer), &resp, 10000);
+    if (result != COAP_OK) {
+        return result;
+    }
+    memcpy(body, resp.pPayload, resp.payloadLength);
+    body[resp.payloadLength] = '\0';
+    return COAP_CODE_TO_HTTP(resp.code);
+}
+
+int open_socket() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    return fd;
+}
+
+// Test the CoAP transport against a local stand-in server
+int main() {
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(TEST_PORT);
+    server.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    // Encode and decode, including options long enough for extended lengths
+    CoapMessage msg, decoded;
+    char long_name[400];
+    memset(long_name, 'x', sizeof(long_name) - 1);
+    long_name[sizeof(long_name) - 1] = '\0';
+    coap_init_message(&msg, CoapTypeConfirmable, COAP_PUT);
+    msg.messageId = 0x1234;
+    msg.tokenLength = 2;
+    msg.pToken[0] = 0xAB;
+    msg.pToken[1] = 0xCD;
+    strcpy(msg.pUriPath, "1/inventory/title/salad dressing");
+    strcpy(msg.pUriQuery, "since=5&x=1");
+    msg.contentFormat = COAP_FORMAT_JSON;
+    msg.pPayload = (const unsigned char *)"{}";
+    msg.payloadLength = 2;
+    int length = coap_encode(&msg, buffer, sizeof(buffer));
+    assert(length > 0);
+    assert(coap_decode(buffer, length, &decoded) == 0);
+    assert(decoded.type == CoapTypeConfirmable);
+    assert(decoded.code == COAP_PUT);
+    assert(decoded.messageId == 0x1234);
+    assert(decoded.tokenLength == 2 && decoded.pToken[1] == 0xCD);
+    assert(strcmp(decoded.pUriPath, "1/inventory/title/salad dressing") == 0);
+    assert(strcmp(decoded.pUriQuery, "since=5&x=1") == 0);
+    assert(decoded.contentFormat == COAP_FORMAT_JSON);
+    assert(decoded.payloadLength == 2 && memcmp(decoded.pPayload, "{}", 2) == 0);
+
+    strcpy(msg.pUriQuery, "");
+    memcpy(msg.pUriPath, long_name, 200);
+    msg.pUriPath[200] = '\0';
+    msg.contentFormat = COAP_FORMAT_TEXT;
+    msg.pPayload = (const unsigned char *)long_name;
+    msg.payloadLength = strlen(long_name);
+    length = coap_encode(&msg, buffer, sizeof(buffer));
+    assert(length > 0);
+    assert(coap_decode(buffer, length, &decoded) == 0);
+    assert(strcmp(decoded.pUriPath, msg.pUriPath) == 0);
+    assert(decoded.contentFormat == COAP_FORMAT_TEXT);
+    assert(decoded.payloadLength == (int)strlen(long_name));
+    assert(coap_encode(&msg, buffer, 100) == -1);
+    assert(coap_decode(buffer, 3, &decoded) == -1);
+
+    // Lookups, adds and removes, one round trip each
+    pid_t pid = coap_server_spawn(TEST_PORT, 0);
+    assert(pid > 0);
+    int fd = open_socket();
+    assert(request(fd, COAP_GET, "barcode/028000521455", NULL) == 205);
+    assert(strcmp(body, "Fruit Punch Juice Box,  8 - 6.75 fl oz boxes") == 0);
+    printf("%s\n", body);
+    assert(request(fd, COAP_GET, "barcode/000000000000", NULL) == 404);
+    assert(request(fd, COAP_PUT, "1/inventory", "{\"title\": \"test\",\"quantity\": 2}") == 204);
+    assert(request(fd, COAP_GET, "1/inventory/title/test", NULL) == 205);
+    assert(strcmp(body, "2") == 0);
+    assert(request(fd, COAP_DELETE, "1/inventory/title/test", NULL) == 202);
+    assert(request(fd, COAP_GET, "1/inventory/title/test", NULL) == 404);
+
+    // The same Message ID twice is only applied once
+    coap_init_message(&msg, CoapTypeConfirmable, COAP_PUT);
+    msg.messageId = 0x7777;
+    strcpy(msg.pUriPath, "1/inventory");
+    msg.pPayload = (const unsigned char *)"{\"title\": \"dup\",\"quantity\": 1}";
+    msg.payloadLength = strlen((const char *)msg.pPayload);
+    length = coap_encode(&msg, buffer, sizeof(buffer));
+    for (int i = 0; i < 2; i++) {
+        assert(sendto(fd, buffer, length, 0, (struct sockaddr *)&server, sizeof(server)) == length);
+        unsigned char reply[COAP_MAX_MESSAGE_SIZE];
+        int received = recvfrom(fd, reply, sizeof(reply), 0, NULL, NULL);
+        assert(coap_decode(reply, received, &decoded) == 0);
+        assert(decoded.type == CoapTypeAcknowledgement);
+        assert(decoded.messageId == 0x7777);
+        assert(decoded.code == COAP_CODE(2, 4));
+    }
+    assert(request(fd, COAP_GET, "1/inventory/title/dup", NULL) == 205);
+    assert(strcmp(body, "1") == 0);
+    close(fd);
+    coap_server_stop(pid);
+
+    // A lost response is recovered by retransmitting, the add still counts once
+    pid = coap_server_spawn(TEST_PORT, COAP_SERVER_DROP_FIRST_RESPONSE);
+    assert(pid > 0);
+    fd = open_socket();
+    assert(request(fd, COAP_PUT, "1/inventory", "{\"title\": \"lost\",\"quantity\": 1}") == 204);
+    assert(request(fd, COAP_GET, "1/inventory/title/lost", NULL) == 205);
+    assert(strcmp(body, "1") == 0);
+    close(fd);
+    coap_server_stop(pid);
+
+    // Empty ACK followed by a separate response
+    pid = coap_server_spawn(TEST_PORT, COAP_SERVER_SEPARATE);
+    assert(pid > 0);
+    fd = open_socket();
+    assert(request(fd, COAP_GET, "barcode/028000521455", NULL) == 205);
+    assert(strcmp(body, "Fruit Punch Juice Box,  8 - 6.75 fl oz boxes") == 0);
+    close(fd);
+    coap_server_stop(pid);
+
+    // A piggybacked ACK with the right Message ID but another token is ignored
+    pid = coap_server_spawn(TEST_PORT, COAP_SERVER_STALE_ACK);
+    assert(pid > 0);
+    fd = open_socket();
+    assert(request(fd, COAP_GET, "barcode/028000521455", NULL) == 205);
+    assert(strcmp(body, "Fruit Punch Juice Box,  8 - 6.75 fl oz boxes") == 0);
+    close(fd);
+    coap_server_stop(pid);
+
+    // Nobody listening, gives up at the deadline
+    fd = open_socket();
+    coap_init_message(&msg, CoapTypeConfirmable, COAP_GET);
+    strcpy(msg.pUriPath, "barcode/028000521455");
+    assert(coap_exchange(fd, &server, sizeof(server), &msg, buffer, sizeof(buffer), &decoded, 500) == COAP_ERR_TIMEOUT);
+    close(fd);
+
+    printf("%s\n", "All CoAP tests passed!");
+    return 0;
+}
@@ -0,0 +1,797 @@
+/** @file   dm9000a_emu.c
+ *  @brief  Host model of the DM9000A and the parts of the HAL, uC/OS-II
+ *          and the InterNiche stack the driver uses
+ *
+ *  See dm9000a_emu.h for what is modelled. SRAM layout and register
+ *  behaviour follow the DM9000A datasheet: TX SRAM is 0000H~0BFFH, RX SRAM
+ *  0C00H~3FFFH, ISR and NSR status bits clear by writing 1. The PHY answers
+ *  at once with its ID and a link that is already up.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include "dm9000a_host/dm9000a_host.h"
+#include "dm9000a_emu.h"
+
+#undef usleep
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+#define EMU_SRAM_SIZE       0x4000
+#define EMU_TX_END          0x0C00      // TX SRAM is 0000H up to here
+#define EMU_RX_START        0x0C00      // RX SRAM from here to the end
+#define EMU_RX_SIZE         (EMU_SRAM_SIZE - EMU_RX_START)
+
+#define EMU_REG_NCR         0x00
+#define EMU_REG_NSR         0x01
+#define EMU_REG_TCR         0x02
+#define EMU_REG_RCR         0x05
+#define EMU_REG_EPCR        0x0B
+#define EMU_REG_EPAR        0x0C
+#define EMU_REG_EPDRL       0x0D
+#define EMU_REG_EPDRH       0x0E
+#define EMU_REG_PAR         0x10
+#define EMU_REG_MAR         0x16
+#define EMU_REG_RCSCSR      0x32
+#define EMU_REG_MRCMDX      0xF0
+#define EMU_REG_MRCMD       0xF2
+#define EMU_REG_MWCMD       0xF8
+#define EMU_REG_TXPLL       0xFC
+#define EMU_REG_TXPLH       0xFD
+#define EMU_REG_ISR         0xFE
+#define EMU_REG_IMR         0xFF
+
+#define EMU_PACKETS         64          // Stack buffers, each a full frame
+#define EMU_PACKET_SIZE     1536
+
+/*****************************************************************************/
+/* Structures                                                                */
+/*****************************************************************************/
+
+struct os_event
+{
+    int             count;
+    int             waiting;
+    pthread_cond_t  cond;
+};
+
+typedef struct _EmuTask
+{
+    void          (*pTask)(void *);
+    void           *pData;
+} EmuTask;
+
+/*****************************************************************************/
+/* Globals                                                                   */
+/*****************************************************************************/
+
+// Chip
+static unsigned char    pRegs[256];
+static unsigned char    pSram[EMU_SRAM_SIZE];
+static unsigned short   pPhyRegs[32];
+static int              indexReg    = 0;
+static unsigned int     txWrite     = 0;
+static unsigned int     txRead      = 0;
+static unsigned int     rxWrite     = EMU_RX_START;
+static unsigned int     rxRead      = EMU_RX_START;
+static int              txSlot      = 0;
+static EmuStats         stats;
+
+// HAL and uC/OS-II
+static pthread_mutex_t  cpu         = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   idleCond    = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   tickCond    = PTHREAD_COND_INITIALIZER;
+static int              runningTasks = 0;
+static int              delayedTasks = 0;
+static unsigned long    tickGeneration = 0;
+static void           (*pIrqHandler)(void *, unsigned long) = NULL;
+static void            *pIrqContext = NULL;
+static int              bIrqEnabled = 0;
+static struct timespec  startTime;
+static unsigned long long tickNs    = 0;
+
+// Stack
+static struct net       net0;
+NET                     nets[1]     = { &net0 };
+queue                   rcvdq;
+unsigned long           cticks      = 0;
+static queue            freeq;
+static unsigned char    pMacAddr[6];
+static EmuFrameHandler  rxHandler   = NULL;
+static void            *pRxContext  = NULL;
+static EmuFrameHandler  txHandler   = NULL;
+static void            *pTxContext  = NULL;
+
+extern error_t dm9000a_init(alt_iniche_dev *p_dev);
+
+/*****************************************************************************/
+/* Chip                                                                      */
+/*****************************************************************************/
+
+// Folded one's complement sum, not complemented
+static unsigned int
+emu_sum(const unsigned char *pData, int length, unsigned int sum)
+{
+    int index;
+
+    for (index = 0; index + 1 < length; index += 2) {
+        sum += (pData[index] << 8) | pData[index + 1];
+    }
+    if (length & 1) {
+        sum += pData[length - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+// Checksum status bits of the first RX header byte: IP, TCP, UDP packet at
+// bits 2..4 and the matching checksum failed bits three places up
+static unsigned char
+emu_rx_checksum(const unsigned char *pFrame, int length)
+{
+    const unsigned char *pIp = pFrame + 14;
+    unsigned char        status = 0x04;
+    unsigned int         headerLength, totalLength, sum;
+
+    if ((length < 34) || (pFrame[12] != 0x08) || (pFrame[13] != 0x00) || ((pIp[0] >> 4) != 4)) {
+        return 0;
+    }
+    headerLength = (pIp[0] & 0x0F) * 4;
+    totalLength  = (pIp[2] << 8) | pIp[3];
+    if ((headerLength < 20) || (totalLength < headerLength) || (14 + totalLength > (unsigned) length)) {
+        return 0x04 | 0x20;
+    }
+    if (emu_sum(pIp, headerLength, 0) != 0xFFFF) {
+        status |= 0x20;
+    }
+    if (((pIp[6] & 0x3F) | pIp[7]) != 0) {
+        return status;      // Fragments are not summed
+    }
+
+    // Pseudo header, then the segment
+    sum = emu_sum(pIp + 12, 8, 0) + pIp[9] + (totalLength - headerLength);
+    sum = emu_sum(pIp + headerLength, totalLength - headerLength, sum);
+    if (pIp[9] == 6) {
+        status |= (sum == 0xFFFF) ? 0x08 : (0x08 | 0x40);
+    } else if (pIp[9] == 17) {
+        int unsummed = (pIp[headerLength + 6] | pIp[headerLength + 7]) == 0;
+        status |= (unsummed || (sum == 0xFFFF)) ? 0x10 : (0x10 | 0x80);
+    }
+    return status;
+}
+
+// Would the RX filter take a frame for this destination
+static int
+emu_rx_filter(const unsigned char *pDest)
+{
+    unsigned long crc = 0xFFFFFFFF;
+    int           index, bit;
+
+    if (pRegs[EMU_REG_RCR] & 0x02) {
+        return 1;           // Promiscuous
+    }
+    if (!(pDest[0] & 0x01)) {
+        return memcmp(pDest, &pRegs[EMU_REG_PAR], 6) == 0;
+    }
+    if (pRegs[EMU_REG_RCR] & 0x08) {
+        return 1;           // Pass all multicast
+    }
+
+    // Broadcast and multicast go through the 64 bit hash in MAR
+    for (index = 0; index < 6; index++) {
+        crc ^= pDest[index];
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+    crc &= 0x3F;
+    return (pRegs[EMU_REG_MAR + (crc >> 3)] >> (crc & 7)) & 1;
+}
+
+static void
+emu_rx_put(unsigned char byte)
+{
+    pSram[rxWrite++] = byte;
+    if (rxWrite == EMU_SRAM_SIZE) {
+        rxWrite = EMU_RX_START;
+    }
+}
+
+static unsigned int
+emu_rx_word(int advance)
+{
+    unsigned int next = rxRead + 1;
+    unsigned int word;
+
+    if (next == EMU_SRAM_SIZE) {
+        next = EMU_RX_START;
+    }
+    word = pSram[rxRead] | (pSram[next] << 8);
+    if (advance) {
+        rxRead = (next + 1 == EMU_SRAM_SIZE) ? EMU_RX_START : next + 1;
+    }
+    return word;
+}
+
+static void
+emu_transmit()
+{
+    unsigned char   pFrame[EMU_TX_END];
+    unsigned int    length = pRegs[EMU_REG_TXPLL] | (pRegs[EMU_REG_TXPLH] << 8);
+    unsigned int    index;
+
+    if (length > sizeof(pFrame)) {
+        length = sizeof(pFrame);
+    }
+    for (index = 0; index < length; index++) {
+        pFrame[index] = pSram[(txRead + index) % EMU_TX_END];
+    }
+    txRead = (txRead + ((length + 1) & ~1)) % EMU_TX_END;
+
+    stats.txFrames++;
+    stats.txBytes += length;
+    if (txHandler) {
+        txHandler(pFrame, length, pTxContext);
+    }
+
+    pRegs[EMU_REG_NSR] |= txSlot ? 0x08 : 0x04;    // TX2END/TX1END
+    txSlot = !txSlot;
+    pRegs[EMU_REG_ISR] |= 0x02;                     // PTS
+}
+
+static void
+emu_chip_reset()
+{
+    unsigned char pPar[6];
+
+    memcpy(pPar, &pRegs[EMU_REG_PAR], sizeof(pPar));
+    memset(pRegs, 0, sizeof(pRegs));
+    memcpy(&pRegs[EMU_REG_PAR], pPar, sizeof(pPar));
+    pRegs[0x2D] = 0x80;
+    pRegs[EMU_REG_NSR] = 0x40;                      // LINKST
+    memset(pPhyRegs, 0, sizeof(pPhyRegs));
+    pPhyRegs[1] = 0x786D;                           // linked, autoneg done
+    pPhyRegs[2] = 0x0181;                           // PHYID1
+    txWrite = txRead = 0;
+    rxWrite = rxRead = EMU_RX_START;
+    txSlot  = 0;
+}
+
+static void
+emu_write_reg(int reg, unsigned char data)
+{
+    switch (reg) {
+    case EMU_REG_NCR:
+        if (data & 0x01) {
+            emu_chip_reset();
+        } else {
+            pRegs[reg] = data;
+        }
+        break;
+    case EMU_REG_NSR:
+        pRegs[reg] &= ~(data & 0x2C);
+        break;
+    case EMU_REG_EPCR:
+        // PHY commands complete at once, ERRE is never seen set
+        pRegs[reg] = data & ~0x01;
+        if ((data & 0x08) && (data & 0x04)) {
+            pRegs[EMU_REG_EPDRL] = pPhyRegs[pRegs[EMU_REG_EPAR] & 0x1F] & 0xFF;
+            pRegs[EMU_REG_EPDRH] = pPhyRegs[pRegs[EMU_REG_EPAR] & 0x1F] >> 8;
+        } else if ((data & 0x08) && (data & 0x02)) {
+            pPhyRegs[pRegs[EMU_REG_EPAR] & 0x1F] =
+                pRegs[EMU_REG_EPDRL] | (pRegs[EMU_REG_EPDRH] << 8);
+            pPhyRegs[0] &= ~0x8200;                 // reset, restart self-clear
+        }
+        break;
+    case EMU_REG_ISR:
+        pRegs[reg] &= ~(data & 0x3F);
+        break;
+    case EMU_REG_TCR:
+        pRegs[reg] = data & ~0x01;
+        if (data & 0x01) {
+            emu_transmit();
+        }
+        break;
+    default:
+        pRegs[reg] = data;
+        break;
+    }
+}
+
+unsigned int
+emu_iord(unsigned long base, int reg)
+{
+    if (base != DM9000A_IF_ETHERNET_BASE) {
+        return 0;
+    }
+    stats.dataAccesses++;
+    if (reg == 0) {
+        return indexReg;
+    }
+
+    switch (indexReg) {
+    case EMU_REG_MRCMDX:
+        return (rxRead == rxWrite) ? 0 : emu_rx_word(0);
+    case EMU_REG_MRCMD:
+        return emu_rx_word(1);
+    default:
+        return pRegs[indexReg];
+    }
+}
+
+void
+emu_iowr(unsigned long base, int reg, unsigned int data)
+{
+    if (base != DM9000A_IF_ETHERNET_BASE) {
+        return;
+    }
+    if (reg == 0) {
+        stats.indexWrites++;
+        indexReg = data & 0xFF;
+        return;
+    }
+
+    stats.dataAccesses++;
+    if (indexReg == EMU_REG_MWCMD) {
+        pSram[txWrite]     = data & 0xFF;
+        pSram[txWrite + 1] = (data >> 8) & 0xFF;
+        txWrite = (txWrite + 2) % EMU_TX_END;
+    } else {
+        emu_write_reg(indexReg, data & 0xFF);
+    }
+}
+
+/**
+ * @brief      Put a frame on the wire towards the chip.
+ *
+ * @param[in]  pFrame  Frame from the destination address on, without FCS
+ * @param[in]  length  Frame length
+ *
+ * @return     1 if it went into RX SRAM, 0 if filtered or out of room
+ */
+int
+emu_receive(const unsigned char *pFrame, int length)
+{
+    unsigned int used, needed, status, index;
+
+    stats.rxFrames++;
+    if (!(pRegs[EMU_REG_RCR] & 0x01) || (length < 14) || !emu_rx_filter(pFrame)) {
+        stats.rxFiltered++;
+        return 0;
+    }
+
+    // Header and frame with its 4 byte FCS, whole words, one word kept free
+    used   = (rxWrite + EMU_RX_SIZE - rxRead) % EMU_RX_SIZE;
+    needed = (4 + length + 4 + 1) & ~1;
+    if (used + needed + 2 > EMU_RX_SIZE) {
+        stats.rxOverflows++;
+        pRegs[EMU_REG_ISR] |= 0x04;     // ROS
+        return 0;
+    }
+
+    status = 0x01;
+    if (pRegs[EMU_REG_RCSCSR] & 0x02) {
+        status |= emu_rx_checksum(pFrame, length);
+    }
+    emu_rx_put(status);
+    emu_rx_put(0);
+    emu_rx_put((length + 4) & 0xFF);
+    emu_rx_put((length + 4) >> 8);
+    for (index = 0; index < (unsigned) length; index++) {
+        emu_rx_put(pFrame[index]);
+    }
+    for (index = 0; index < 4 + (length & 1); index++) {
+        emu_rx_put(0);
+    }
+
+    stats.rxAccepted++;
+    pRegs[EMU_REG_ISR] |= 0x01;     // PRS
+    return 1;
+}
+
+/*****************************************************************************/
+/* Scheduling                                                                */
+/*****************************************************************************/
+
+static void *
+emu_task_thread(void *pArg)
+{
+    EmuTask task = *(EmuTask *) pArg;
+
+    free(pArg);
+    pthread_mutex_lock(&cpu);
+    task.pTask(task.pData);
+    pthread_mutex_unlock(&cpu);
+    return NULL;
+}
+
+/**
+ * @brief      Let the driver run: take the interrupt while it is raised and
+ *             enabled, run tasks until all of them block, and hand what was
+ *             received to the RX handler. Returns once nothing is left to do.
+ */
+void
+emu_service(void)
+{
+    PACKET pkt;
+
+    while (1) {
+        if (bIrqEnabled && pIrqHandler &&
+            (pRegs[EMU_REG_ISR] & pRegs[EMU_REG_IMR] & 0x0F)) {
+            stats.interrupts++;
+            pIrqHandler(pIrqContext, DM9000A_IF_ETHERNET_IRQ);
+        }
+
+        while (runningTasks > 0) {
+            pthread_cond_wait(&idleCond, &cpu);
+        }
+
+        while ((pkt = (PACKET) getq(&rcvdq)) != NULL) {
+            stats.rxDelivered++;
+            if (rxHandler) {
+                // nb_plen covers the FCS the chip leaves on, pass the frame without it
+                rxHandler((unsigned char *) pkt->nb_buff + ETHHDR_BIAS, pkt->nb_plen + 14 - 4, pRxContext);
+            }
+            pk_free(pkt);
+        }
+
+        if (delayedTasks > 0) {
+            runningTasks += delayedTasks;
+            delayedTasks  = 0;
+            tickGeneration++;
+            pthread_cond_broadcast(&tickCond);
+        } else if (!(bIrqEnabled && (pRegs[EMU_REG_ISR] & pRegs[EMU_REG_IMR] & 0x0F))) {
+            return;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* Setup                                                                     */
+/*****************************************************************************/
+
+/**
+ * @brief      Reset the model, bring the driver up as the stack would and
+ *             take the CPU for the calling thread.
+ *
+ * @param[in]  pMac  MAC address the driver gets from get_mac_addr
+ */
+void
+emu_start(unsigned char *pMac)
+{
+    static struct netbuf    pPackets[EMU_PACKETS];
+    static char             pBuffers[EMU_PACKETS][EMU_PACKET_SIZE];
+    alt_iniche_dev          dev;
+    int                     index;
+
+    pthread_mutex_lock(&cpu);
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    memcpy(pMacAddr, pMac, sizeof(pMacAddr));
+    emu_chip_reset();
+    memset(&stats, 0, sizeof(stats));
+    for (index = 0; index < EMU_PACKETS; index++) {
+        pPackets[index].nb_buff = pBuffers[index];
+        pPackets[index].length  = EMU_PACKET_SIZE;
+        putq(&freeq, &pPackets[index]);
+    }
+
+    memset(&net0, 0, sizeof(net0));
+    net0.n_mib = &net0.mib;
+    memset(&dev, 0, sizeof(dev));
+    dev.if_num = 0;
+    dm9000a_init(&dev);
+    if (net0.n_init(0) != 0) {
+        fprintf(stderr, "dm9ka_init failed\n");
+        exit(1);
+    }
+}
+
+void
+emu_set_rx_handler(EmuFrameHandler handler, void *pContext)
+{
+    rxHandler  = handler;
+    pRxContext = pContext;
+}
+
+void
+emu_set_tx_handler(EmuFrameHandler handler, void *pContext)
+{
+    txHandler  = handler;
+    pTxContext = pContext;
+}
+
+void
+emu_get_stats(EmuStats *pStats)
+{
+    *pStats = stats;
+}
+
+void
+emu_clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/*****************************************************************************/
+/* HAL                                                                       */
+/*****************************************************************************/
+
+static unsigned long long
+emu_elapsed_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - startTime.tv_sec) * 1000000000ull + now.tv_nsec - startTime.tv_nsec;
+}
+
+int
+emu_usleep(unsigned int us)
+{
+    stats.delayUs += us;
+    return 0;
+}
+
+// System clock timer counting down once a millisecond at 50MHz, in real
+// time. The snapshot is of the moment alt_nticks was last read, so the two
+// always agree and the timeout bit never needs checking.
+unsigned int
+emu_timer_snap(int high)
+{
+    unsigned long count = TIMER_LOAD_VALUE - (tickNs / 20) % (TIMER_LOAD_VALUE + 1);
+
+    return high ? (count >> 16) : (count & 0xFFFF);
+}
+
+alt_u32
+alt_nticks(void)
+{
+    tickNs = emu_elapsed_ns();
+    cticks = tickNs / 1000000;
+    return cticks;
+}
+
+alt_u32
+alt_ticks_per_second(void)
+{
+    return 1000;
+}
+
+int
+alt_irq_register(alt_u32 id, void *context, void (*handler)(void *, unsigned long))
+{
+    pIrqHandler = handler;
+    pIrqContext = context;
+    bIrqEnabled = (handler != NULL);
+    return 0;
+}
+
+int
+alt_irq_enable(alt_u32 id)
+{
+    bIrqEnabled = (pIrqHandler != NULL);
+    return 0;
+}
+
+int
+alt_irq_disable(alt_u32 id)
+{
+    bIrqEnabled = 0;
+    return 0;
+}
+
+// Tasks never run at the same time, see emu_service
+alt_irq_context
+alt_irq_disable_all(void)
+{
+    return 0;
+}
+
+void
+alt_irq_enable_all(alt_irq_context context)
+{
+}
+
+/*****************************************************************************/
+/* uC/OS-II                                                                  */
+/*****************************************************************************/
+
+OS_EVENT *
+OSSemCreate(INT16U count)
+{
+    OS_EVENT *pEvent = calloc(1, sizeof(OS_EVENT));
+
+    if (pEvent) {
+        pEvent->count = count;
+        pthread_cond_init(&pEvent->cond, NULL);
+    }
+    return pEvent;
+}
+
+void
+OSSemPend(OS_EVENT *pEvent, INT16U timeout, INT8U *err)
+{
+    if (pEvent->count == 0) {
+        pEvent->waiting++;
+        runningTasks--;
+        pthread_cond_broadcast(&idleCond);
+        while (pEvent->count == 0) {
+            pthread_cond_wait(&pEvent->cond, &cpu);
+        }
+    }
+    pEvent->count--;
+    *err = OS_NO_ERR;
+}
+
+INT8U
+OSSemPost(OS_EVENT *pEvent)
+{
+    pEvent->count++;
+    if (pEvent->waiting) {
+        pEvent->waiting--;
+        runningTasks++;
+        pthread_cond_signal(&pEvent->cond);
+    }
+    return OS_NO_ERR;
+}
+
+// Yields until emu_service has handed what was received to the stack
+void
+OSTimeDly(INT16U ticks)
+{
+    unsigned long generation = tickGeneration;
+
+    delayedTasks++;
+    runningTasks--;
+    pthread_cond_broadcast(&idleCond);
+    while (generation == tickGeneration) {
+        pthread_cond_wait(&tickCond, &cpu);
+    }
+}
+
+INT8U
+OSTaskCreateExt(void (*task)(void *), void *pdata, OS_STK *ptos, INT8U prio, INT16U id,
+                OS_STK *pbos, INT32U stk_size, void *pext, INT16U opt)
+{
+    EmuTask    *pTask = malloc(sizeof(EmuTask));
+    pthread_t   thread;
+
+    if (pTask == NULL) {
+        return OS_PRIO_EXIST;
+    }
+    pTask->pTask = task;
+    pTask->pData = pdata;
+    runningTasks++;
+    if (pthread_create(&thread, NULL, emu_task_thread, pTask) != 0) {
+        runningTasks--;
+        free(pTask);
+        return OS_PRIO_EXIST;
+    }
+    pthread_detach(thread);
+    return OS_NO_ERR;
+}
+
+/*****************************************************************************/
+/* Stack                                                                     */
+/*****************************************************************************/
+
+PACKET
+pk_alloc(unsigned len)
+{
+    PACKET pkt;
+
+    if (len > EMU_PACKET_SIZE) {
+        return NULL;
+    }
+    pkt = (PACKET) getq(&freeq);
+    if (pkt) {
+        pkt->nb_prot = pkt->nb_buff;
+        pkt->nb_plen = 0;
+        pkt->net     = NULL;
+        pkt->flags   = 0;
+    }
+    return pkt;
+}
+
+void
+pk_free(PACKET pkt)
+{
+    putq(&freeq, pkt);
+}
+
+PACKET
+pk_cache_alloc(struct pk_cache *pCache, unsigned len)
+{
+    PACKET pkt;
+
+    if ((len > EMU_PACKET_SIZE) || (pCache->count == 0)) {
+        return pk_alloc(len);
+    }
+    pkt = pCache->stash[--pCache->count];
+    pkt->nb_prot = pkt->nb_buff;
+    pkt->nb_plen = 0;
+    pkt->net     = NULL;
+    pkt->flags   = 0;
+    return pkt;
+}
+
+void
+pk_cache_fill(struct pk_cache *pCache)
+{
+    PACKET pkt;
+
+    while ((pCache->count < PK_CACHE_DEPTH) && (freeq.q_len > PK_CACHE_DEPTH)) {
+        if ((pkt = (PACKET) getq(&freeq)) == NULL) {
+            break;
+        }
+        pCache->stash[pCache->count++] = pkt;
+    }
+}
+
+void
+putq(queue *q, void *elt)
+{
+    struct q_elt *pElt = (struct q_elt *) elt;
+
+    pElt->qe_next = NULL;
+    if (q->q_tail) {
+        q->q_tail->qe_next = pElt;
+    } else {
+        q->q_head = pElt;
+    }
+    q->q_tail = pElt;
+    if (++q->q_len > q->q_max) {
+        q->q_max = q->q_len;
+    }
+}
+
+void *
+getq(queue *q)
+{
+    struct q_elt *pElt = q->q_head;
+
+    if (pElt) {
+        q->q_head = pElt->qe_next;
+        if (q->q_head == NULL) {
+            q->q_tail = NULL;
+        }
+        q->q_len--;
+    }
+    return pElt;
+}
+
+void
+SignalPktDemux(void)
+{
+}
+
+int
+get_mac_addr(NET net, char *mac_addr)
+{
+    memcpy(mac_addr, pMacAddr, sizeof(pMacAddr));
+    return 0;
+}
+
+int
+ns_printf(void *pio, char *format, ...)
+{
+    va_list args;
+    int     result;
+
+    va_start(args, format);
+    result = vprintf(format, args);
+    va_end(args);
+    return result;
+}
@@ -0,0 +1,42 @@
+#ifndef __DM9000A_EMU_H
+#define __DM9000A_EMU_H
+
+// Register level model of the DM9000A behind the DE2's DM9000A_IF, for
+// running ../Capstone-FIT/dm9000a.c on a host, see dm9000a_bench.c.
+//
+// The index and data ports follow the chip: MWCMD writes fill TX SRAM,
+// TXREQ sends TXPLL/TXPLH bytes of it, received frames land in the RX SRAM
+// ring behind the 4 byte header the driver parses and are read back with
+// MRCMDX/MRCMD. Frames pass the same unicast, MAR hash and broadcast filter
+// as on the wire, and RX checksum status is reported once RCSCSR enables
+// it. Transmits finish as soon as they are requested.
+//
+// uC/OS-II tasks run on threads but only one at a time, and the interrupt
+// is only taken inside emu_service(), so the driver sees a uniprocessor.
+
+typedef struct _EmuStats
+{
+    unsigned long rxFrames;         // Frames offered by the wire
+    unsigned long rxAccepted;       // Passed the address filter into RX SRAM
+    unsigned long rxFiltered;       // Dropped by the address filter
+    unsigned long rxOverflows;      // Dropped, no room left in RX SRAM
+    unsigned long rxDelivered;      // Handed to the stack by the driver
+    unsigned long txFrames;         // Sent by TXREQ
+    unsigned long txBytes;
+    unsigned long indexWrites;      // Writes to the index port
+    unsigned long dataAccesses;     // Reads and writes of the data port
+    unsigned long delayUs;          // usleep the driver asked for
+    unsigned long interrupts;       // ISR calls
+} EmuStats;
+
+typedef void (*EmuFrameHandler)(const unsigned char *pFrame, int length, void *pContext);
+
+void emu_start(unsigned char *pMac);
+int  emu_receive(const unsigned char *pFrame, int length);
+void emu_service(void);
+void emu_set_rx_handler(EmuFrameHandler handler, void *pContext);
+void emu_set_tx_handler(EmuFrameHandler handler, void *pContext);
+void emu_get_stats(EmuStats *pStats);
+void emu_clear_stats(void);
+
+#endif
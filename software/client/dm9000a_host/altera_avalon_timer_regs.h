@@ -0,0 +1,2 @@
+// Host stand-in, see dm9000a_host.h
+#include "dm9000a_host.h"
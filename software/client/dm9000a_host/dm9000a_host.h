@@ -0,0 +1,222 @@
+/** @file   dm9000a_host.h
+ *  @brief  Just enough of the HAL, uC/OS-II and the InterNiche stack to
+ *          build ../Capstone-FIT/dm9000a.c on a Linux host
+ *
+ *  The other headers in this directory stand in for the ones the driver
+ *  includes and only pull this one in. IORD/IOWR on the DM9000A ports go to
+ *  the chip model in dm9000a_emu.c, usleep is counted rather than slept and
+ *  uC/OS-II tasks run one at a time, see dm9000a_emu.h.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __DM9000A_HOST_H
+#define __DM9000A_HOST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+/*****************************************************************************/
+/* system.h                                                                  */
+/*****************************************************************************/
+
+#define DM9000A_IF_ETHERNET_BASE    0x1909400
+#define DM9000A_IF_ETHERNET_IRQ     2
+#define TIMER_BASE                  0x1909000
+#define TIMER_FREQ                  50000000u
+#define TIMER_LOAD_VALUE            49999ull
+#define ALT_CPU_FREQ                50000000
+
+/*****************************************************************************/
+/* HAL                                                                       */
+/*****************************************************************************/
+
+typedef unsigned char   alt_u8;
+typedef unsigned short  alt_u16;
+typedef unsigned int    alt_u32;
+typedef int             alt_irq_context;
+typedef int             error_t;
+
+#define IORD(base, reg)         emu_iord((base), (reg))
+#define IOWR(base, reg, data)   emu_iowr((base), (reg), (data))
+#define usleep(us)              emu_usleep(us)
+
+#define IORD_ALTERA_AVALON_TIMER_SNAPL(base)        emu_timer_snap(0)
+#define IORD_ALTERA_AVALON_TIMER_SNAPH(base)        emu_timer_snap(1)
+#define IOWR_ALTERA_AVALON_TIMER_SNAPL(base, data)  ((void) 0)
+#define IORD_ALTERA_AVALON_TIMER_STATUS(base)       0
+#define ALTERA_AVALON_TIMER_STATUS_TO_MSK           0x1
+
+unsigned int    emu_iord(unsigned long base, int reg);
+void            emu_iowr(unsigned long base, int reg, unsigned int data);
+int             emu_usleep(unsigned int us);
+unsigned int    emu_timer_snap(int high);
+
+alt_u32         alt_nticks(void);
+alt_u32         alt_ticks_per_second(void);
+int             alt_irq_register(alt_u32 id, void *context,
+                                 void (*handler)(void *, unsigned long));
+int             alt_irq_enable(alt_u32 id);
+int             alt_irq_disable(alt_u32 id);
+alt_irq_context alt_irq_disable_all(void);
+void            alt_irq_enable_all(alt_irq_context context);
+
+/*****************************************************************************/
+/* uC/OS-II                                                                  */
+/*****************************************************************************/
+
+typedef unsigned char   INT8U;
+typedef unsigned short  INT16U;
+typedef unsigned int    INT32U;
+typedef unsigned int    OS_STK;
+typedef struct os_event OS_EVENT;
+
+#define OS_TICKS_PER_SEC 1000
+#define OS_NO_ERR       0
+#define OS_PRIO_EXIST   40
+
+OS_EVENT *OSSemCreate(INT16U count);
+void      OSSemPend(OS_EVENT *pevent, INT16U timeout, INT8U *err);
+INT8U     OSSemPost(OS_EVENT *pevent);
+void      OSTimeDly(INT16U ticks);
+INT8U     OSTaskCreateExt(void (*task)(void *), void *pdata, OS_STK *ptos,
+                          INT8U prio, INT16U id, OS_STK *pbos,
+                          INT32U stk_size, void *pext, INT16U opt);
+
+/*****************************************************************************/
+/* InterNiche                                                                */
+/*****************************************************************************/
+
+typedef unsigned long   u_long;
+typedef unsigned short  unshort;
+typedef unsigned char   u_char;
+typedef unsigned long   ip_addr;
+
+#define IP_MULTICAST    1
+
+#define ETHHDR_SIZE     16
+#define ETHHDR_BIAS     2
+#define ETHERNET        6
+#define MTU             1514
+#define TPS             1000
+#define IP_TYPE         htons(0x0800)
+#define ENP_RESOURCE    -22
+
+#define NF_NBPROT       0x0008
+#define NF_CSUM_TX      0x0800
+#define NF_CSUM_RX      0x1000
+
+#define PKF_IPCSUM_OK   0x80
+#define PKF_L4CSUM_OK   0x100
+
+struct ethhdr
+{
+    u_char  e_dst[6];
+    u_char  e_src[6];
+    unshort e_type;
+};
+
+struct IfMib
+{
+    u_long  ifType;
+    u_long  ifMtu;
+    u_long  ifAdminStatus;
+    u_long  ifOperStatus;
+    u_long  ifLastChange;
+    u_char *ifPhysAddress;
+    u_char *ifDescr;
+    u_long  ifInDiscards;
+    u_long  ifInErrors;
+    u_long  ifOutOctets;
+    u_long  ifOutUcastPkts;
+    u_long  ifOutNUcastPkts;
+};
+
+struct q_elt
+{
+    struct q_elt   *qe_next;
+};
+
+typedef struct queue
+{
+    struct q_elt   *q_head;
+    struct q_elt   *q_tail;
+    int             q_len;
+    int             q_max;
+} queue;
+
+typedef struct net *NET;
+
+struct netbuf
+{
+    struct netbuf  *next;       // Must be first, for the queues
+    char           *nb_buff;
+    char           *nb_prot;
+    unsigned        nb_plen;
+    unsigned long   nb_tstamp;
+    unsigned        flags;
+    NET             net;
+    unshort         type;
+    unsigned        length;     // Size of nb_buff
+};
+typedef struct netbuf *PACKET;
+
+#define PK_CACHE_DEPTH  4
+
+// The emulator has one buffer size, so one stash
+struct pk_cache
+{
+    PACKET          stash[PK_CACHE_DEPTH];
+    int             count;
+};
+
+struct in_multi
+{
+    unsigned long       inm_addr;
+    NET                 inm_netp;
+    struct in_multi    *inm_next;
+};
+
+struct net
+{
+    struct IfMib        mib;
+    struct IfMib       *n_mib;
+    void               *n_local;
+    int                 n_lnh;
+    int                 n_hal;
+    int                 n_mtu;
+    int                 n_flags;
+    int               (*n_init)(int);
+    int               (*pkt_send)(PACKET);
+    int               (*n_close)(int);
+    void              (*n_stats)(void *, int);
+    int               (*n_mcastlist)(struct in_multi *);
+    struct in_multi    *mc_list;
+};
+
+typedef struct alt_iniche_dev
+{
+    void   *llist[2];
+    char   *name;
+    error_t (*init_func)(struct alt_iniche_dev *);
+    int     if_num;
+} alt_iniche_dev;
+
+extern NET              nets[];
+extern queue            rcvdq;
+extern unsigned long    cticks;
+
+PACKET  pk_alloc(unsigned len);
+void    pk_free(PACKET pkt);
+PACKET  pk_cache_alloc(struct pk_cache *pCache, unsigned len);
+void    pk_cache_fill(struct pk_cache *pCache);
+void    putq(queue *q, void *elt);
+void   *getq(queue *q);
+void    SignalPktDemux(void);
+int     get_mac_addr(NET net, char *mac_addr);
+int     ns_printf(void *pio, char *format, ...);
+
+#endif // __DM9000A_HOST_H
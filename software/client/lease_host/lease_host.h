@@ -0,0 +1,67 @@
+/** @file   lease_host.h
+ *  @brief  Just enough of the HAL, uC/OS-II and the InterNiche stack to
+ *          build ../Capstone-FIT/lease_cache.c on a Linux host
+ *
+ *  The other headers in this directory stand in for the ones lease_cache.c
+ *  includes and only pull this one in. Flash reads go to the array
+ *  lease_test.c keeps for the last flash sector, and the DHCP client state
+ *  is whatever the test sets up.
+ *
+ *  @author Andrew Bradshaw (abradsha), Kyle O'Shaughnessy (koshaugh)
+ */
+
+#ifndef __LEASE_HOST_H
+#define __LEASE_HOST_H
+
+#include <stdio.h>
+#include <string.h>
+
+/*****************************************************************************/
+/* HAL and uC/OS-II                                                          */
+/*****************************************************************************/
+
+typedef unsigned char   alt_u8;
+typedef unsigned int    alt_u32;
+typedef unsigned int    INT32U;
+typedef struct os_event OS_EVENT;
+typedef unsigned int    OS_STK;
+
+#define IORD_32DIRECT(base, offset)     host_flash_read((base), (offset))
+
+alt_u32         host_flash_read(alt_u32 base, int offset);
+
+/*****************************************************************************/
+/* InterNiche                                                                */
+/*****************************************************************************/
+
+#define DHCP_CLIENT     1
+#define TPS             20
+#define MAXNETS         1
+#define DHC_MAXDNSRVS   2
+#define DHCS_BOUND      7
+
+typedef unsigned long   u_long;
+typedef unsigned long   ip_addr;
+
+struct net {
+    ip_addr     n_ipaddr;
+    ip_addr     snmask;
+    ip_addr     n_defgw;
+};
+typedef struct net *    NET;
+
+struct dhc_state {
+    unsigned    state;
+    u_long      lease;
+    u_long      lease_start;
+    ip_addr     srv_ipaddr;
+    ip_addr     dnsrv[DHC_MAXDNSRVS];
+};
+
+extern u_long           cticks;
+extern NET              nets[MAXNETS];
+extern struct dhc_state dhc_states[MAXNETS];
+
+void    dhc_set_callback(int iface, int (*routine)(int, int));
+
+#endif // __LEASE_HOST_H
@@ -0,0 +1,111 @@
+#include "lease_host/lease_host.h"
+#include "../Capstone-FIT/lease_cache.h"
+#include "../Capstone-FIT/web_server.h"
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define FLASH_SECTOR    0x10000
+
+// The stack and board stand-ins lease_cache.c links against
+u_long              cticks = 0;
+struct net          net0;
+NET                 nets[MAXNETS] = { &net0 };
+struct dhc_state    dhc_states[MAXNETS];
+alt_u32             last_flash_sector = FLASH_SECTOR;
+
+unsigned char       flash[FLASH_RECORDS_END];
+int                 flash_saves = 0;
+int               (*dhc_callback)(int, int) = NULL;
+
+alt_u32 host_flash_read(alt_u32 base, int offset) {
+    alt_u32 word;
+    assert(base == FLASH_SECTOR);
+    assert(offset >= 0 && offset + sizeof(word) <= sizeof(flash));
+    memcpy(&word, &flash[offset], sizeof(word));
+    return word;
+}
+
+int SaveFlashRecord(int offset, const void *pRecord, int length) {
+    assert(offset >= 0 && offset + length <= FLASH_RECORDS_END);
+    memcpy(&flash[offset], pRecord, length);
+    flash_saves++;
+    return 0;
+}
+
+void dhc_set_callback(int iface, int (*routine)(int, int)) {
+    dhc_callback = routine;
+}
+
+int dhc_main_ipset(int iface, int state) {
+    return 0;
+}
+
+// Time left on the lease as last written to flash
+INT32U saved_expiry() {
+    LeaseRecord record;
+    memcpy(&record, &flash[LEASE_CACHE_FLASH_OFFSET], sizeof(record));
+    assert(record.signature == LEASE_CACHE_FLASH_SIGNATURE);
+    return record.expiry;
+}
+
+// Test saving and reclaiming the DHCP lease against a RAM copy of the flash sector
+int main() {
+    ip_addr address = 0, netmask = 0, gateway = 0;
+    INT32U  expiry;
+
+    // Network settings present, no lease yet
+    flash[0] = 0xfe;
+    flash[1] = 0x5a;
+    assert(!leaseCacheLoad(0, &address, &netmask, &gateway));
+    assert(dhc_callback != NULL);
+
+    // Bound, the lease is saved once
+    cticks = 100 * TPS;
+    net0.n_ipaddr = inet_addr("192.168.0.42");
+    net0.snmask = inet_addr("255.255.255.0");
+    net0.n_defgw = inet_addr("192.168.0.1");
+    dhc_states[0].state = DHCS_BOUND;
+    dhc_states[0].lease = 86400;
+    dhc_states[0].lease_start = cticks;
+    dhc_states[0].srv_ipaddr = inet_addr("192.168.0.1");
+    dhc_callback(0, DHCS_BOUND);
+    leaseCacheSave();
+    assert(flash_saves == 1);
+    assert(saved_expiry() == 86400);
+
+    // Not again until the time left saved is old enough
+    cticks += (LEASE_CACHE_RESAVE_SECONDS - 1) * TPS;
+    leaseCacheSave();
+    assert(flash_saves == 1);
+
+    // Then the time left is refreshed without a state change
+    cticks += TPS;
+    leaseCacheSave();
+    assert(flash_saves == 2);
+    assert(saved_expiry() == 86400 - LEASE_CACHE_RESAVE_SECONDS);
+
+    cticks += 2 * LEASE_CACHE_RESAVE_SECONDS * TPS;
+    leaseCacheSave();
+    assert(flash_saves == 3);
+    expiry = saved_expiry();
+    assert(expiry == 86400 - 3 * LEASE_CACHE_RESAVE_SECONDS);
+
+    // Not bound, nothing is written
+    dhc_states[0].state = DHCS_BOUND + 1;
+    cticks += 2 * LEASE_CACHE_RESAVE_SECONDS * TPS;
+    leaseCacheSave();
+    assert(flash_saves == 3);
+
+    // The next boot gets the address with the time left as last saved
+    memset(&dhc_states[0], 0, sizeof(dhc_states[0]));
+    assert(leaseCacheLoad(0, &address, &netmask, &gateway));
+    assert(address == inet_addr("192.168.0.42"));
+    assert(netmask == inet_addr("255.255.255.0"));
+    assert(gateway == inet_addr("192.168.0.1"));
+    assert(dhc_states[0].lease == expiry);
+
+    printf("%s\n", "All lease cache tests passed!");
+    return 0;
+}
@@ -35,9 +35,24 @@ struct arptabent  {
    u_long   createtime;    /* time entry was created (cticks) */
    u_long   lasttime;      /* time entry was last referenced */
    unshort  flags;         /* mask of the ET flags */
+   struct arptabent * hnext;     /* next in hash bucket, or on free list */
+   struct arptabent * lru_prev;  /* use list, most recently sent to first */
+   struct arptabent * lru_next;
+   struct arptabent * age_prev;  /* age list, oldest createtime first */
+   struct arptabent * age_next;
 };
 
+/* Entries in use are hashed by IP address, so lookups don't scan the
+ * table. make_arp_entry() recycles the least recently used entry when
+ * the table is full; cb_arpent_tmo() expires old ones off the age list.
+ * Both sizes may be set in ipport.h.
+ */
+#ifndef MAXARPS
 #define  MAXARPS        8  /* maximum mumber of arp table entries */
+#endif
+#ifndef ARP_HASHSIZE
+#define  ARP_HASHSIZE   8  /* buckets in the ARP hash, a power of 2 */
+#endif
 extern   struct arptabent  arp_table[MAXARPS];  /* the actual table */
 
 /* arp function prototypes */
@@ -61,6 +76,7 @@ extern   unsigned    arpReqsIn;     /* requests received */
 extern   unsigned    arpReqsOut;    /* requests sent */
 extern   unsigned    arpRepsIn;     /* replys received */
 extern   unsigned    arpRepsOut;    /* replys sent */
+extern   unsigned    arpRecycled;   /* live entries reused for a new IP */
 
 
 /* Plummer's internals. All constants are already byte-swapped. */
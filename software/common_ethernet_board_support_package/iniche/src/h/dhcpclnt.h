@@ -26,9 +26,9 @@
 #define  DHC_MAXDNSRVS  2 
 #endif
 
-#ifdef USE_AUTOIP /* AutoIP requires DNS option */
+#if defined(USE_AUTOIP) || defined(DNS_CLIENT) /* AutoIP and DNS client need DNS option */
 #define  DHC_MAXDNSRVS  2 
-#endif   /* USE_AUTOIP */
+#endif   /* USE_AUTOIP || DNS_CLIENT */
 
 #define  BOOTP_SERVER_PORT    67
 #define  BOOTP_CLIENT_PORT    68
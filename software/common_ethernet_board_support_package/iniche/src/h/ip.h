@@ -184,7 +184,33 @@ struct avl_node * avlv6_access(struct avl_node * n, ip6_addr * key);
 #endif   /* BTREE_ROUTES */
 
 
-extern RTMIB cachedRoute;     /* last route entry used */
+/* iproute() remembers the routes of recently used destinations in a
+ * small direct-mapped cache, along with the ARP entry send_via_arp()
+ * resolved the next hop to. A slot is good only while its rc_gen
+ * matches rt_gen; add_route(), del_route(), route timeouts and changes
+ * to the ARP table bump rt_gen with RT_CHANGED().
+ */
+struct arptabent;
+
+struct rtcache {
+   ip_addr  rc_dest;       /* destination this slot is for */
+   unsigned rc_gen;        /* rt_gen when the slot was filled */
+   RTMIB    rc_route;      /* route table entry used for rc_dest */
+   ip_addr  rc_hop;        /* next hop for rc_dest */
+   struct net *   rc_ifp;  /* net to send on */
+   struct arptabent * rc_arp; /* ARP entry of rc_hop, NULL if not known */
+};
+
+#ifndef RTC_SIZE
+#define  RTC_SIZE    8     /* slots in the route cache, a power of 2 */
+#endif
+
+#define  RTC_SLOT(dest) (&rtcache[(unsigned)((dest) ^ ((dest) >> 8) ^ \
+   ((dest) >> 16) ^ ((dest) >> 24)) & (RTC_SIZE - 1)])
+#define  RT_CHANGED()   (rt_gen++)
+
+extern   struct rtcache rtcache[RTC_SIZE];
+extern   unsigned rt_gen;     /* route and ARP table generation */
 
 extern   queue    bigfreeq;   /* big free buffers */
 extern   queue    lilfreeq;   /* small free buffers */
@@ -267,6 +293,7 @@ int      ip_init(void);
 ip_addr  ip_mymach(ip_addr);
 int      ip_more(void);
 NET      iproute(ip_addr, ip_addr*);
+int      ip_csum_offload(ip_addr host);
 RTMIB    add_route(ip_addr dest, ip_addr mask, ip_addr nexthop, int iface, int type);
 int      del_route(ip_addr dest, ip_addr mask, int iface);
 RTMIB    rt_lookup(ip_addr host);
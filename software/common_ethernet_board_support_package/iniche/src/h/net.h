@@ -324,6 +324,8 @@ extern   unsigned    ifNumber;   /* how many links (number of nets[] used) */
 #define  NF_DHCPC    0x0100   /* Iface uses DHCP Client to obtain IP addr */
 #define  NF_AUTOIP   0x0200   /* Iface uses AutoIP to obtain IP addr */
 #define  NF_6TO4     0x0400   /* Iface is RFC-3056 "6to4" tunnel */
+#define  NF_CSUM_TX  0x0800   /* device fills in TCP checksums on send */
+#define  NF_CSUM_RX  0x1000   /* device verifies checksums, see PKF_IPCSUM_OK */
 
 #ifdef IP_MULTICAST
 /* prototype multicast routines in ipmc.c: */
@@ -118,6 +118,15 @@ struct netbuf
 #define  PKF_IPV6_PREPEND_DONE  0x40  /* mark the prepend of eth data */
                                       /* has been done to the head of */
                                       /* this pkt. */
+#define  PKF_IPCSUM_OK  0x80   /* receiving device verified the IP header checksum */
+#define  PKF_L4CSUM_OK  0x100  /* receiving device verified the TCP/UDP checksum */
+
+/* TRUE if the device the packet came in on checked one of the
+ * PKF_xxCSUM_OK sums, so software need not. Only honoured on ifaces
+ * that set NF_CSUM_RX.
+ */
+#define  PK_CSUM_OK(p, bit)   (((p)->flags & (bit)) && (p)->net && \
+                               ((p)->net->n_flags & NF_CSUM_RX))
                                        
 typedef struct netbuf * PACKET;     /* struct netbuf in netbuf.h */
 
@@ -164,6 +173,34 @@ extern   unsigned lilbufs;    /* number of small bufs to init */
 extern   unsigned lilbufsiz;  /* big enough for average packet */
 extern   unsigned bigbufs;    /* number of big bufs to init */
 extern   unsigned bigbufsiz;  /* big enough for max. ethernet packet */
+extern   unsigned midbufs;    /* number of bufs in the in-between classes */
+
+/* Regular buffers come in PK_CLASSES size classes, smallest first. The
+ * first class is the little buffers (lilfreeq) and the last the big ones
+ * (bigfreeq); ipport.h may add PK_NUMMIDCLASSES in between. pk_alloc()
+ * takes the smallest class that fits and, when that one is empty, the
+ * next bigger class with a free buffer.
+ */
+#ifndef PK_NUMMIDCLASSES
+#define PK_NUMMIDCLASSES   0
+#endif
+#define PK_CLASSES         (PK_NUMMIDCLASSES + 2)
+
+struct pk_class
+{
+   unsigned       size;    /* nb_blen of the buffers in this class */
+   unsigned       count;   /* buffers made by pk_init() */
+   struct queue * freeq;   /* free buffers of this class */
+   int            in_sram; /* buffers were carved from SRAM */
+   u_long         hits;    /* allocs sized for this class and served by it */
+   u_long         misses;  /* allocs sized for it, served by a bigger class */
+   u_long         fails;   /* allocs sized for it which got no buffer */
+};
+
+/* Buffers in use at the high-water mark of a class */
+#define PK_CLASS_HIWAT(pc) ((pc)->count - (unsigned)(pc)->freeq->q_min)
+
+extern   struct pk_class pk_classes[PK_CLASSES];
 
 /* Pack buffer routines, Defined in the new system for each port: */
 PACKET   pk_alloc(unsigned size);      /* allocate a packet for sending */
@@ -172,6 +209,23 @@ int      pk_init(void);    /* call at init time to set up for pk_allocs */
 PACKET   pk_prepend(PACKET pkt, int bigger);    /* prepend new buffer */
 PACKET   pk_gather(PACKET pkt, int headerlen);  /* "gather" a buffer list */
 
+/* Per-context cache of free buffers. Only the context that owns one may
+ * use it; pk_cache_alloc() then takes buffers without a critical section.
+ * pk_cache_fill() tops it up from the free queues between bursts.
+ */
+#ifndef PK_CACHE_DEPTH
+#define PK_CACHE_DEPTH     4     /* buffers of each class a cache holds */
+#endif
+
+struct pk_cache
+{
+   PACKET   stash[PK_CLASSES][PK_CACHE_DEPTH];
+   int      count[PK_CLASSES];
+};
+
+PACKET   pk_cache_alloc(struct pk_cache * cache, unsigned size);
+void     pk_cache_fill(struct pk_cache * cache);
+
 #endif   /*  _NETBUF_H */
 
 
@@ -169,11 +169,11 @@
 #define IP_RAW   1   /* build raw sockets support */
 #define IP_MULTICAST   1   /* support IP multicast capability in stack */
 #define BLOCKING_APPS   1   /* applications block rather than poll */
+#define DNS_CLIENT   1   /* include DNS client code (server name resolution) */
 
 /* Options which are disabled by default */
 #ifdef NOT_USED
 
-#define DNS_CLIENT   1   /* include DNS client code */
 #define BOOTPTAB   1   /* DHCP supports a UNIX-ish bootptab file */
 #define BTREE_ROUTES   1   /* Use binary tree IP route lookup */
 #define NO_UDP_CKSUM   1   /* omit code for UDP checksums */
@@ -565,6 +565,20 @@ void ncpfree(void *ptr);
 #define LB_FREE(ptr)       npfree(ptr)
 #endif /* ALTERA_TRIPLE_SPEED_MAC */
 
+/*
+ * Packet buffer classes whose bit is set in PK_SRAM_CLASSES (bit 0 is
+ * the little buffers, the highest class the big ones) are carved from
+ * the board SRAM rather than the SDRAM heap, which keeps them out of
+ * the way of code and stack fetches. Nothing is placed there by default.
+ */
+#ifdef SRAM_BASE
+char * sramalloc(unsigned size);
+#define SB_ALLOC(size)     sramalloc(size)  /* SRAM packet buffer alloc */
+#ifndef PK_SRAM_CLASSES
+#define PK_SRAM_CLASSES    0
+#endif
+#endif /* SRAM_BASE */
+
 #define UC_ALLOC(size)     npalloc(size)  /* UDP connection block alloc */
 #define UC_FREE(ptr)       npfree(ptr)
 #define TK_ALLOC(size)     npalloc(size)  /* task control block */
@@ -603,10 +617,30 @@ int   prep_ifaces(int firstIface);   /* set up interfaces */
 #define NUMBIGBUFS   30
 #define NUMLILBUFS   30
 
+/*
+ * Size classes between the little and big buffers, smallest first, as
+ * { size, count } pairs. Sizes must be multiples of PK_GRANULE (8) so
+ * pk_alloc() and pk_free() can map a length to its class with one table
+ * lookup; pk_init() fails otherwise.
+ * NUMMIDBUFS is the sum of the counts. The 512 byte class keeps TCP acks
+ * and short CoAP exchanges out of the big buffers once the little ones
+ * run out.
+ */
+#define PK_NUMMIDCLASSES   1
+#define PK_MIDCLASSES      { 512, 16 }
+#define NUMMIDBUFS   16
+
 /* some maximum packet buffer numbers */
 #define MAXBIGPKTS   30
 #define MAXLILPKTS   30
-#define MAXPACKETS (MAXLILPKTS+MAXBIGPKTS)
+#define MAXMIDPKTS   NUMMIDBUFS
+#define MAXPACKETS (MAXLILPKTS+MAXMIDPKTS+MAXBIGPKTS)
+
+/* ARP table entries, and buckets in the ARP hash (a power of 2). The
+ * shop subnet has a few dozen hosts; 8 entries thrashed.
+ */
+#define MAXARPS      64
+#define ARP_HASHSIZE 32
 
 
 /********************* ipport.h_h common ****************************/
@@ -58,6 +58,7 @@ void  np_stripoptions(struct ip * ti, struct mbuf * m);
 int   in_broadcast(u_long ipaddr);     /* TRUE if ipaddr is broadcast */
 
 unshort  tcp_cksum(struct ip * pip);
+unshort  tcp_pseudo_cksum(struct ip * pip);
 
 
 #ifdef TCP_ZEROCOPY  /* zero-copy sockets extensions */
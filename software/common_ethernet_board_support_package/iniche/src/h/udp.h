@@ -35,6 +35,7 @@ struct udp
 struct udp_conn
 {
    struct udp_conn * u_next;
+   struct udp_conn * u_hnext; /* next in its udp_porthash[] bucket */
    unshort  u_flags;    /* flags for this connection */
    unshort  u_lport;    /* local port (host byte order) */
    unshort  u_fport;    /* foreign port (host byte order) */
@@ -86,6 +87,16 @@ struct ph         /* pseudo header for checksumming */
 
 extern   UDPCONN  firstudp;
 
+/* udpdemux() finds connections through a hash on the local port, kept
+ * by udp_open(), udp_close() and udp_rehash(). Connections with no
+ * local port sit in the bucket of port 0, which is searched as well.
+ */
+#define  UDP_HASHSIZE   16    /* a power of 2 */
+#define  UDP_PORTHASH(lport)  \
+   (((unsigned)(lport) ^ ((unsigned)(lport) >> 8)) & (UDP_HASHSIZE - 1))
+
+extern   UDPCONN  udp_porthash[UDP_HASHSIZE];
+
 /* Some reserved UDP ports */
 #define  RIP_PORT    520
 #define  DNS_PORT    53
@@ -128,6 +139,7 @@ void     udp_free(PACKET);
 UDPCONN  udp_open(ip_addr, unshort /*fport*/, unshort /*lport*/,
    int(*)(PACKET, void * /*data*/) , void *  /*data*/);
 void     udp_close(UDPCONN);
+void     udp_rehash(UDPCONN, unshort /*lport*/);
 int      udp_stats(void * pio);
 
 
@@ -27,6 +27,8 @@
  * ROUTINES: arp_send_pending(), send_arp(), find_oldest_arp(), 
  * ROUTINES: make_arp_entry(), arpReply(), arprcv(), 
  * ROUTINES: send_via_arp(), arp_stats(), clear_arp_entries(), 
+ * ROUTINES: arp_tabinit(), arp_hashfind(), arp_listin(), arp_listout(),
+ * ROUTINES: arp_unlink(), arp_touch(), arp_expired(), 
  *
  * PORTABLE: yes
  */
@@ -45,7 +47,7 @@
 
 /* allow override in ipport.h_h */
 #ifndef ARPENT_TMO
-#define ARPENT_TMO      10    /* periodic ARP entry timeout (sec) */
+#define ARPENT_TMO      1     /* periodic ARP entry timeout (sec) */
 #endif
 
 #define arpsize         (ETHHDR_SIZE + sizeof(struct  arp_hdr))
@@ -53,11 +55,31 @@
 static long arp_timer = 0;    /* periodic timer handle */
 void cb_arpent_tmo(long);     /* timer callback function */
 
-                              /* last ARP entry used */
-struct arptabent *arpcache = (struct arptabent *)NULL;
-static u_long cachetime;      /* time we created arpcache entry */
 int arp_ageout = 600 * TPS;   /* APR table refresh age, in ticks */
 
+/* Entries in use are in arp_hash[] by IP address and on two lists: the
+ * use list, most recently sent to first, whose tail make_arp_entry()
+ * recycles when the table is full; and the age list, in createtime
+ * order, which cb_arpent_tmo() walks from the oldest end. Unused
+ * entries are on arp_freelist, chained through hnext.
+ */
+static struct arptabent *  arp_hash[ARP_HASHSIZE];
+static struct arptabent *  arp_freelist;
+static struct arptabent *  arp_lruhead;
+static struct arptabent *  arp_lrutail;
+static struct arptabent *  arp_agehead;
+static struct arptabent *  arp_agetail;
+static int  arp_inited = FALSE;
+
+#define  ARP_HASH(ip)   \
+   ((unsigned)((ip) ^ ((ip) >> 8) ^ ((ip) >> 16) ^ ((ip) >> 24)) & \
+    (ARP_HASHSIZE - 1))
+
+static struct arptabent * arp_hashfind(ip_addr dest_ip);
+static void arp_unlink(struct arptabent * tp);
+static void arp_touch(struct arptabent * tp);
+static int  arp_expired(struct arptabent * tp, unsigned long lticks);
+
 #ifdef USE_AUTOIP
 /* Auto Ip callback */
 extern void AutoIp_arp_response(struct arp_hdr * hdr, NET ifp);
@@ -68,6 +90,7 @@ unsigned    arpReqsIn  = 0;   /* requests received */
 unsigned    arpReqsOut = 0;   /* requests sent */
 unsigned    arpRepsIn  = 0;   /* replys received */
 unsigned    arpRepsOut = 0;   /* replys sent */
+unsigned    arpRecycled = 0;  /* live entries reused for a new IP */
 
 struct arptabent  arp_table[MAXARPS];     /* the actual table */
 
@@ -120,7 +143,7 @@ et_send(PACKET pkt, struct arptabent *tp)
    IFMIB etif = pkt->net->n_mib;    /* mib info for this ethernet interface */
    int err;
 
-   tp->lasttime = cticks;
+   arp_touch(tp);
    pkt->nb_prot -= ETHHDR_SIZE;  /* prepare for prepending ethernet header */
    pkt->nb_plen += ETHHDR_SIZE;
    ethhdr = pkt->nb_prot + ETHHDR_BIAS;
@@ -191,8 +214,8 @@ et_send(PACKET pkt, struct arptabent *tp)
  * RETURNS: none
  *
  * Free all pending packets for the specified ARP table entry.
- * Clear the list (entry->pending) after freeing the packets
- * and mark the entry "unused".
+ * Clear the list (entry->pending) after freeing the packets.
+ * arp_unlink() is what marks the entry "unused".
  */
 
 void
@@ -216,8 +239,6 @@ arp_free_pending(struct arptabent *entry)
       tmppkt = nextpkt;              /* process the next packet */
    }
 
-   entry->t_pro_addr = 0;     /* mark the entry "unused" */
-
    UNLOCK_NET_RESOURCE(FREEQ_RESID);
 }
 
@@ -455,6 +476,225 @@ send_arp(PACKET pkt, ip_addr dest_ip)
 
 
 
+/* FUNCTION: arp_tabinit()
+ *
+ * Put every ARP table entry on the free list
+ *
+ * PARAMS: none
+ *
+ * RETURNS: none
+ */
+
+static void
+arp_tabinit(void)
+{
+   int   i;
+
+   arp_freelist = (struct arptabent *)NULL;
+   for (i = MAXARPS - 1; i >= 0; i--)
+   {
+      arp_table[i].t_pro_addr = 0;
+      arp_table[i].hnext = arp_freelist;
+      arp_freelist = &arp_table[i];
+   }
+   arp_inited = TRUE;
+}
+
+
+
+/* FUNCTION: arp_hashfind()
+ *
+ * Find the ARP table entry for an IP address
+ *
+ * PARAM1: ip_addr            IP address
+ *
+ * RETURNS: arptabent *       entry for dest_ip, or NULL if none
+ *
+ * No aging is done here; send_via_arp() checks arp_expired() on
+ * what it finds.
+ */
+
+static struct arptabent *
+arp_hashfind(ip_addr dest_ip)
+{
+   struct arptabent *tp;
+
+   for (tp = arp_hash[ARP_HASH(dest_ip)]; tp; tp = tp->hnext)
+   {
+      if (tp->t_pro_addr == dest_ip)
+         break;
+   }
+   return tp;
+}
+
+
+
+/* FUNCTION: arp_listin()
+ *
+ * Put an entry at the head of the use list and the tail of the
+ * age list
+ *
+ * PARAM1: arptabent *        ARP table entry
+ *
+ * RETURNS: none
+ */
+
+static void
+arp_listin(struct arptabent * tp)
+{
+   tp->lru_prev = (struct arptabent *)NULL;
+   tp->lru_next = arp_lruhead;
+   if (arp_lruhead)
+      arp_lruhead->lru_prev = tp;
+   else
+      arp_lrutail = tp;
+   arp_lruhead = tp;
+
+   tp->age_next = (struct arptabent *)NULL;
+   tp->age_prev = arp_agetail;
+   if (arp_agetail)
+      arp_agetail->age_next = tp;
+   else
+      arp_agehead = tp;
+   arp_agetail = tp;
+}
+
+
+
+/* FUNCTION: arp_listout()
+ *
+ * Take an entry off the use and age lists
+ *
+ * PARAM1: arptabent *        ARP table entry
+ *
+ * RETURNS: none
+ */
+
+static void
+arp_listout(struct arptabent * tp)
+{
+   if (tp->lru_prev)
+      tp->lru_prev->lru_next = tp->lru_next;
+   else
+      arp_lruhead = tp->lru_next;
+   if (tp->lru_next)
+      tp->lru_next->lru_prev = tp->lru_prev;
+   else
+      arp_lrutail = tp->lru_prev;
+
+   if (tp->age_prev)
+      tp->age_prev->age_next = tp->age_next;
+   else
+      arp_agehead = tp->age_next;
+   if (tp->age_next)
+      tp->age_next->age_prev = tp->age_prev;
+   else
+      arp_agetail = tp->age_prev;
+}
+
+
+
+/* FUNCTION: arp_unlink()
+ *
+ * Return an ARP table entry to the free list
+ *
+ * PARAM1: arptabent *        ARP table entry in use
+ *
+ * RETURNS: none
+ *
+ * Frees any packets pending on the entry, takes it out of its hash
+ * bucket and off the use and age lists, and marks it "unused".
+ */
+
+static void
+arp_unlink(struct arptabent * tp)
+{
+   struct arptabent **prev;
+
+   if (tp->pending)
+      arp_free_pending(tp);
+
+   for (prev = &arp_hash[ARP_HASH(tp->t_pro_addr)]; *prev;
+        prev = &(*prev)->hnext)
+   {
+      if (*prev == tp)
+      {
+         *prev = tp->hnext;
+         break;
+      }
+   }
+   arp_listout(tp);
+#ifdef IP_ROUTING
+   RT_CHANGED();           /* the route cache may point at it */
+#endif   /* IP_ROUTING */
+
+   tp->t_pro_addr = 0;     /* mark the entry "unused" */
+   tp->hnext = arp_freelist;
+   arp_freelist = tp;
+}
+
+
+
+/* FUNCTION: arp_touch()
+ *
+ * Mark an ARP table entry as just used
+ *
+ * PARAM1: arptabent *        ARP table entry in use
+ *
+ * RETURNS: none
+ *
+ * Stamps lasttime and moves the entry to the head of the use list.
+ */
+
+static void
+arp_touch(struct arptabent * tp)
+{
+   tp->lasttime = cticks;
+   if (tp == arp_lruhead)
+      return;
+
+   tp->lru_prev->lru_next = tp->lru_next;
+   if (tp->lru_next)
+      tp->lru_next->lru_prev = tp->lru_prev;
+   else
+      arp_lrutail = tp->lru_prev;
+
+   tp->lru_prev = (struct arptabent *)NULL;
+   tp->lru_next = arp_lruhead;
+   arp_lruhead->lru_prev = tp;
+   arp_lruhead = tp;
+}
+
+
+
+/* FUNCTION: arp_expired()
+ *
+ * Tell if an ARP table entry should be dropped
+ *
+ * PARAM1: arptabent *        ARP table entry in use
+ * PARAM2: unsigned long      current cticks
+ *
+ * RETURNS: int               TRUE if the entry has expired
+ *
+ * An entry expires if its ARP request has been pending for more
+ * than one second, or if it is older than arp_ageout and has not
+ * been referenced in one second. The latter keeps bogus MAC addresses
+ * from getting permanently wedged in the table, as when someone
+ * replaces a PC's MAC adapter but keeps its IP address.
+ */
+
+static int
+arp_expired(struct arptabent * tp, unsigned long lticks)
+{
+   if (tp->pending)
+      return ((lticks - tp->createtime) > TPS);
+
+   return (((int)(lticks - tp->createtime) >= arp_ageout) &&
+           ((int)(lticks - tp->lasttime)   >= TPS));
+}
+
+
+
 /* FUNCTION: find_oldest_arp()
  *
  * Find an ARP table entry or oldest unused table entry
@@ -468,53 +708,25 @@ send_arp(PACKET pkt, ip_addr dest_ip)
  * of new entry so we can recycle a previous entry for that IP,
  * if it exists. 
  *
- * Old entries are removed from the table.
+ * Nothing is removed from the table here; cb_arpent_tmo() does
+ * the aging.
  */
 
 struct arptabent * 
 find_oldest_arp(ip_addr dest_ip)
 {
    struct arptabent *tp;
-   struct arptabent *exact  = (struct arptabent *)NULL;
-   struct arptabent *oldest = (struct arptabent *)NULL;
-   struct arptabent *empty  = (struct arptabent *)NULL;
-   unsigned long lticks = cticks;
 
-   /* find lru (or free) entry */
-   for (tp = &arp_table[0]; tp < &arp_table[MAXARPS]; tp++)
-   {
-      /* age out old, pending entries */
-      if (tp->pending)
-      {
-         /* purge if pending for more than one second */
-         if ((lticks - tp->createtime) > TPS)
-         {
-            arp_free_pending(tp);   /* free pending packets */
-            tp->t_pro_addr = 0;     /* mark entry as "unused" */
-         }
-      }
-      else if ((tp->t_pro_addr != 0) &&
-               ((int)(lticks - tp->createtime) >= arp_ageout) &&
-               ((int)(lticks - tp->lasttime)   >= TPS))
-      {
-         /* entry has "expired" and has not been reference in 1 sec. */
-         tp->t_pro_addr = 0;     /* mark entry as "unused" */
-      }
+   if (!arp_inited)
+      arp_tabinit();
 
-      if (tp->t_pro_addr == dest_ip)   /* ip addr already has entry */
-      {
-         exact = tp;
-      }
-      else if (tp->t_pro_addr != 0)
-      {
-         if (!oldest || (tp->lasttime < oldest->lasttime))
-            oldest = tp;
-      }
-      else if (!empty)
-         empty = tp;          /* grab first empty slot */
-   }
+   if ((tp = arp_hashfind(dest_ip)) != NULL)
+      return tp;           /* ip addr already has entry */
+
+   if (arp_freelist)
+      return arp_freelist;
 
-   return ((exact) ? exact : ((empty) ? empty : oldest));
+   return arp_lrutail;
 }
 
 
@@ -544,31 +756,45 @@ make_arp_entry(ip_addr dest_ip, NET net)
    /* find usable (or existing) ARP table entry */
    oldest = find_oldest_arp(dest_ip);
 
-   /* If recycling entry, don't leak packets which may be stuck here */
-   if (oldest->pending && (oldest->t_pro_addr != dest_ip))
+   if (oldest->t_pro_addr == dest_ip)
    {
-      arp_free_pending(oldest);
+      /* refreshing the entry, it goes to the young end of the lists */
+      arp_listout(oldest);
+   }
+   else
+   {
+      /* If recycling entry, don't leak packets which may be stuck here */
+      if (oldest->t_pro_addr != 0)
+      {
+         arpRecycled++;
+         arp_unlink(oldest);
+      }
+
+      /* take it off the free list and hash it under its new address */
+      arp_freelist = oldest->hnext;
+      oldest->t_pro_addr = dest_ip;
+      oldest->hnext = arp_hash[ARP_HASH(dest_ip)];
+      arp_hash[ARP_HASH(dest_ip)] = oldest;
    }
+   arp_listin(oldest);
+#ifdef IP_ROUTING
+   RT_CHANGED();     /* MAC address is cleared below */
+#endif   /* IP_ROUTING */
 
    /* partially fill in arp entry */
-   oldest->t_pro_addr = dest_ip;
    oldest->net = net;
    oldest->flags = 0;
    MEMSET(oldest->t_phy_addr, '\0', 6);   /* clear mac address */
    oldest->createtime = oldest->lasttime = lticks;
 
-   /* start a ARP timer if there isn't one already */
-   /* update the timeout value if there is a timer */
-   /* time is specified in milliseconds */
+   /* start a ARP timer if there isn't one already. Don't push back
+    * a running one; a steady stream of new entries would keep it
+    * from ever aging the table.
+    */
    if (arp_timer == 0)
    {
       arp_timer = in_timerset(&cb_arpent_tmo, ARPENT_TMO * 1000, 0);
    }
-   else
-   {
-      ((struct intimer *)arp_timer)->tmo =
-              ((struct intimer *)arp_timer)->interval + lticks;
-   }
 
    return oldest;
 }
@@ -761,8 +987,9 @@ arprcv(PACKET pkt)
    {
       arpReqsIn++;   /* count these */
       arpReply(pkt); /* send arp reply */
-      /* make partial ARP table entry */
-      make_arp_entry(arphdr->ar_spa, pkt->net);
+      /* make partial ARP table entry, unless it's a probe from 0.0.0.0 */
+      if (arphdr->ar_spa != 0)
+         make_arp_entry(arphdr->ar_spa, pkt->net);
       /* fall thru to arp reply logic to finish our table entry */
    }
    else     /* ARP reply, count and fall thru to logic to update table */
@@ -770,32 +997,30 @@ arprcv(PACKET pkt)
       arpRepsIn++;
    }
 
-   /* scan table for matching entry */
+   /* look up the sender's entry */
    /* check this for default gateway situations later, JB */
-   for (tp = &arp_table[0]; tp < &arp_table[MAXARPS]; tp++)
+   tp = (arphdr->ar_spa != 0) ? arp_hashfind(arphdr->ar_spa) : NULL;
+   if (tp)     /* we found IP address, update entry */
    {
-      if (tp->t_pro_addr == arphdr->ar_spa)     /* we found IP address, update entry */
-      {
 #ifdef IEEE_802_3
-         /* If it's an IEEE SNAP (802.3) set flag in arp table entry */
-         if (ieee)
-            tp->flags |= ET_SNAP;
-         else
-            tp->flags |= ET_ETH2;      /* else it's ethernet II */
+      /* If it's an IEEE SNAP (802.3) set flag in arp table entry */
+      if (ieee)
+         tp->flags |= ET_SNAP;
+      else
+         tp->flags |= ET_ETH2;      /* else it's ethernet II */
 #endif   /* IEEE_802_3 */
 
-         MEMMOVE(tp->t_phy_addr, arphdr->ar_sha, 6);   /* update MAC adddress */
-         tp->lasttime = cticks;
-         if (tp->pending)     /* packet waiting for this IP entry? */
-         {
-            arp_send_pending(tp);
-         }
-         LOCK_NET_RESOURCE(FREEQ_RESID);
-         pk_free(pkt);
-         UNLOCK_NET_RESOURCE(FREEQ_RESID);
-
-         return (0);
+      MEMMOVE(tp->t_phy_addr, arphdr->ar_sha, 6);   /* update MAC adddress */
+      arp_touch(tp);
+      if (tp->pending)     /* packet waiting for this IP entry? */
+      {
+         arp_send_pending(tp);
       }
+      LOCK_NET_RESOURCE(FREEQ_RESID);
+      pk_free(pkt);
+      UNLOCK_NET_RESOURCE(FREEQ_RESID);
+
+      return (0);
    }
 
 #ifdef IEEE_802_3_ONLY
@@ -823,18 +1048,17 @@ drop:
  *                            SEND_FAILED if error 
  *
  * Send a packet to the target IP address. The IP address may be the
- * packet's dest_ip or a gateway/router. We check the ARP cache (and
- * scan the ARP table if required) for a MAC address matching the
- * passed dest_ip address. If the MAC address is not already known,
- * we broadcast an arp request for the missing IP address and attach
- * the packet to the "pending" pointer. The packet will be sent when
- * the ARP reply comes in, or freed if we time out. 
- *
- * We flush the cache every second to force the regular freeing of any
- * "pending" packets. We flush every entry on the ageout interval so
- * bogus ARP addresses won't get permanently wedged in the table.
- * This happens when someone replaces a PC's MAC adapter but does not
- * change the PC's IP address. 
+ * packet's dest_ip or a gateway/router. We look up the ARP table hash
+ * for a MAC address matching the passed dest_ip address. If the MAC
+ * address is not already known, we broadcast an arp request for the
+ * missing IP address and attach the packet to the "pending" pointer.
+ * The packet will be sent when the ARP reply comes in, or freed if
+ * we time out. 
+ *
+ * An entry found here that has expired but not yet been swept by
+ * cb_arpent_tmo() is dropped and ARPed for again. Resolved entries
+ * are saved in iproute()'s route cache slot for the packet's
+ * destination, so the next packet there skips the hash lookup.
  */
 
 int
@@ -843,6 +1067,9 @@ send_via_arp(PACKET pkt, ip_addr dest_ip)
    struct arptabent *tp;
    unsigned long lticks = cticks;
    int err;
+#ifdef IP_ROUTING
+   struct rtcache *  rc;
+#endif   /* IP_ROUTING */
 
    /* don't allow zero dest */
    if (dest_ip == 0)
@@ -853,20 +1080,27 @@ send_via_arp(PACKET pkt, ip_addr dest_ip)
       return SEND_DROPPED; 
    }
 
-   /* Force refresh of cache once a second */
-   if ((lticks - cachetime) > TPS)
-      arpcache = (struct arptabent *)NULL;
-
-   /* look at the last ARP entry used. Good chance it's ours: */
-   if (arpcache && (arpcache->t_pro_addr == dest_ip))
-      tp = arpcache;
+#ifdef IP_ROUTING
+   /* iproute() has just filled or checked the slot for pkt->fhost */
+   rc = RTC_SLOT(pkt->fhost);
+   if ((rc->rc_dest != pkt->fhost) || (rc->rc_gen != rt_gen) ||
+       (rc->rc_hop != dest_ip))
+   {
+      rc = (struct rtcache *)NULL;     /* not routed by the cache */
+   }
+   if (rc && rc->rc_arp)
+      tp = rc->rc_arp;
    else
+#endif   /* IP_ROUTING */
+      tp = arp_hashfind(dest_ip);
+
+   if (tp && arp_expired(tp, lticks))
    {
-      /* scan arp table for an existing entry */
-      tp = find_oldest_arp(dest_ip);
+      arp_unlink(tp);
+      tp = (struct arptabent *)NULL;
    }
 
-   if (tp->t_pro_addr == dest_ip)   /* we found our entry */
+   if (tp)   /* we found our entry */
    {
       if (tp->pending)  /* arp already pending for this IP? */
       {
@@ -898,8 +1132,10 @@ send_via_arp(PACKET pkt, ip_addr dest_ip)
       }
       else  /* just send it */
       {
-         arpcache = tp;       /* cache this entry */
-         cachetime = lticks;  /* mark time we cached */
+#ifdef IP_ROUTING
+         if (rc)
+            rc->rc_arp = tp;  /* next packet to fhost can skip the hash */
+#endif   /* IP_ROUTING */
          err = et_send(pkt, tp);
       }
    }
@@ -932,6 +1168,8 @@ arp_stats(void *pio)
 
    ns_printf(pio, "arp Requests In: %u,   out: %u\n", arpReqsIn, arpReqsOut);
    ns_printf(pio, "arp Replys   In: %u,   out: %u\n", arpRepsIn, arpRepsOut);
+   ns_printf(pio, "arp table size: %d, entries recycled: %u\n",
+             MAXARPS, arpRecycled);
 
    /* count number of arp entrys in use: */
    for (i = 0; i < MAXARPS; i++)
@@ -1004,14 +1242,12 @@ clear_arp_entries(ip_addr dest_ip, NET ifp)
    /* find and free matching entries */
    for (tp = &arp_table[0]; tp < &arp_table[MAXARPS]; tp++)
    {
+      if (tp->t_pro_addr == 0)
+         continue;
       if ((dest_ip && (tp->t_pro_addr == dest_ip)) ||
           (ifp && (ifp == tp->net)))
       {
-         if (tp->pending)   /* clear any pending sends */
-         {
-            arp_free_pending(tp);
-         }
-         tp->t_pro_addr = 0;  /* clear table entry */
+         arp_unlink(tp);      /* clears any pending sends */
          deleted++;
       }
    }
@@ -1030,43 +1266,32 @@ clear_arp_entries(ip_addr dest_ip, NET ifp)
  *
  * RETURNS: none
  *
- * Check the ARP table for unresolved entries that have been
- * pending too long. Assume these entries will never be resolved,
- * and free their resources.
+ * Walk the age list from its oldest end and drop the entries
+ * arp_expired() says are done: unresolved ones that have been
+ * pending too long, whose packets are freed, and ones past the
+ * ageout time. The walk stops at the first entry created within the
+ * last second, as nothing younger can have expired.
  *
- * If there are no more unresolved entries, cancel the timer.
+ * If the table is empty, cancel the timer.
  */
 void
 cb_arpent_tmo(long arg)
 {
    struct arptabent *tp;
-   int arp_count = 0;
+   struct arptabent *next;
    unsigned long lticks = cticks;
 
-   for (tp = &arp_table[0]; tp < &arp_table[MAXARPS]; tp++)
+   for (tp = arp_agehead; tp; tp = next)
    {
-      if (tp->t_pro_addr != 0)
-      {
-         /* age out old, pending entries */
-         if (tp->pending && ((lticks - tp->createtime) > TPS))
-         {
-            /* purge if pending for more than one second */
-            arp_free_pending(tp);   /* free pending packets */
-            tp->t_pro_addr = 0;     /* mark entry as "unused" */
-         }
-         else if (((int)(lticks - tp->createtime) >= arp_ageout) &&
-                  ((int)(lticks - tp->lasttime)   >= TPS))
-         {
-            /* entry has "expired" and has not been reference in 1 sec. */
-            tp->t_pro_addr = 0;     /* mark entry as "unused" */
-         }
-         else
-            arp_count++;
-      }
+      next = tp->age_next;
+      if ((lticks - tp->createtime) <= TPS)
+         break;
+      if (arp_expired(tp, lticks))
+         arp_unlink(tp);
    }
 
-   /* if there are no more "pending" entries, kill the timer */
-   if (arp_count == 0)
+   /* if there are no more entries, kill the timer */
+   if (arp_agehead == NULL)
    {
       in_timerkill(arp_timer);
       arp_timer = 0;
@@ -1207,6 +1207,7 @@ iproute(ip_addr host, ip_addr * hop1)
    NET      ifp;
 #ifdef IP_ROUTING
    RTMIB    rtp;
+   struct rtcache *  rc;
 #endif   /* IP_ROUTING */
 
    if (host == 0L)      /* Sanity check parameter. */
@@ -1224,21 +1225,24 @@ iproute(ip_addr host, ip_addr * hop1)
       return NULL;
 #endif   /* BTREE_ROUTING */
 
-   /* see if the host matches the cached route */
-   if (cachedRoute)     /* don't test this if route is null  */
+   /* see if the host is in the route cache */
+   rc = RTC_SLOT(host);
+   if ((rc->rc_dest == host) && (rc->rc_gen == rt_gen))
    {
-      if (cachedRoute->ipRouteDest == host)    /* exact match */
-      {
-         *hop1 = cachedRoute->ipRouteNextHop;   /* fill in nexthop IP addr */
-         cachedRoute->ipRouteAge = cticks;      /* timestamp route entry */
-         return(cachedRoute->ifp); /* net to send on */
-      }
+      *hop1 = rc->rc_hop;                    /* fill in nexthop IP addr */
+      rc->rc_route->ipRouteAge = cticks;     /* timestamp route entry */
+      return(rc->rc_ifp);                    /* net to send on */
    }
 
    rtp = rt_lookup(host);
    if(rtp)
    {
-      cachedRoute = rtp;
+      rc->rc_dest = host;
+      rc->rc_gen = rt_gen;
+      rc->rc_route = rtp;
+      rc->rc_hop = rtp->ipRouteNextHop;
+      rc->rc_ifp = rtp->ifp;
+      rc->rc_arp = NULL;
       *hop1 = rtp->ipRouteNextHop;  /* fill in IP dest (next hop) */
       return(rtp->ifp);             /* return pointer to net */
    }
@@ -1265,10 +1269,19 @@ iproute(ip_addr host, ip_addr * hop1)
          ((ifp->n_ipaddr & ifp->snmask) == (host & ifp->snmask)))
       {
 #ifdef IP_ROUTING
-         /* make a cached Route entry for next time */
-         cachedRoute = add_route(host, 0xFFFFFFFF, host, i, IPRP_OTHER);
+         /* make a host route entry, and cache it, for next time */
+         rtp = add_route(host, 0xFFFFFFFF, host, i, IPRP_OTHER);
+         if (rtp)
+         {
+            rc->rc_dest = host;
+            rc->rc_gen = rt_gen;
+            rc->rc_route = rtp;
+            rc->rc_hop = host;
+            rc->rc_ifp = ifp;
+            rc->rc_arp = NULL;
+         }
 #ifdef NPDEBUG
-         if (cachedRoute == NULL)
+         else
             dtrap();
 #endif   /* NPDEBUG */
 #endif   /* IP_ROUTING */
@@ -1318,6 +1331,36 @@ iproute(ip_addr host, ip_addr * hop1)
 }
 
 
+
+/* FUNCTION: ip_csum_offload()
+ *
+ * Tells the transport layer whether a datagram to host leaves on an 
+ * iface which fills in the TCP checksum itself (NF_CSUM_TX). Sends to 
+ * one of our own or a loopback address come straight back in without 
+ * the device, and are always summed in software.
+ *
+ * PARAM1: ip_addr host
+ *
+ * RETURNS: TRUE if the checksum can be left to the device
+ */
+
+int
+ip_csum_offload(ip_addr host)
+{
+   NET      ifp;
+   ip_addr  hop;
+
+   if ((host & htonl(0xFF000000)) == htonl(0x7F000000))
+      return FALSE;
+
+   ifp = iproute(host, &hop);
+   if ((ifp == NULL) || !(ifp->n_flags & NF_CSUM_TX))
+      return FALSE;
+
+   return (ifp->n_ipaddr != host);
+}
+
+
 #ifdef NO_IP_MACROS     /* Replace some macros with functions */
 
 /* FUNCTION: ip_data()
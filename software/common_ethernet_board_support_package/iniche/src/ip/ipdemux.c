@@ -160,7 +160,10 @@ ip_rcv(PACKET p)
    csum = pip->ip_chksum;
    pip->ip_chksum = 0;
    hdrlen = ip_hlen(pip);
-   tempsum = ~cksum(pip, hdrlen >> 1);
+   if (PK_CSUM_OK(p, PKF_IPCSUM_OK))
+      tempsum = csum;      /* device already checked it */
+   else
+      tempsum = ~cksum(pip, hdrlen >> 1);
 
    if (csum != tempsum)
    {
@@ -27,7 +27,8 @@
 #include "../rip/rip.h"
 #endif
 
-RTMIB cachedRoute = NULL;        /* last route entry we used */
+struct rtcache rtcache[RTC_SIZE];   /* iproute()'s destination cache */
+unsigned rt_gen = 1;                /* bumped on route and ARP changes */
 
 u_char   rtp_priority[] =  {  /* route table entry priorities, by protocol */
    /* FOO */            0x00, /* empty entry, lowest priority */
@@ -179,6 +180,7 @@ add_route(
          rtp->ipRouteProto = prot;           /* icmp, or whatever */
          rtp->ipRouteMask = mask;
          rtp->ifp = ifp;
+         RT_CHANGED();
          return(rtp);   /* just update and exit */
       }
       /* if we didn't find empty slot yet, look for good slot to recycle */
@@ -241,6 +243,7 @@ add_route(
    rtp->ipRouteAge = cticks;        /* timestamp it */
    rtp->ipRouteMask = mask;
    rtp->ipRouteMetric5 = -1;
+   RT_CHANGED();     /* may have recycled a cached route */
    return(rtp);
 }
 
@@ -289,9 +292,9 @@ del_route(ip_addr dest, ip_addr mask, int iface)
          MEMSET(rtp, 0, sizeof(*rtp)); /* clear entry */
          retval++;
       }
-      if (cachedRoute == rtp) /* clear cache if it's being deleted */
-         cachedRoute = NULL;
    }
+   if (retval)
+      RT_CHANGED();  /* deleted routes may be in the route cache */
    return retval;
 }
 
@@ -385,10 +388,8 @@ rttmo(struct avl_node * node, long param, int depth)
    {
       ip_addr key;      /* for pass to avlremove() */
 
-       /* If the cached route is the one being deleted then clear the cache */
-      if (rt == cachedRoute)
-         cachedRoute = NULL;
-    
+      RT_CHANGED();     /* the route may be in the route cache */
+
 	  ((RTMIB)node)->ipRouteNextHop = 0; /* clear route */
       key = htonl(((RTMIB)node)->ipRouteDest);     /* pass key in machine endian */
 	  avlremove((struct avl_node **)&btreeRoot, (void*)&key);
@@ -602,6 +603,7 @@ add_route(
    {
       /* just update and exit */
       rtp_fillin(rtp, dest, mask, nexthop, ifp, prot);
+      RT_CHANGED();
       return(rtp);
    }
 
@@ -630,6 +632,7 @@ add_route(
 	return NULL;
   }
 
+   RT_CHANGED();     /* more specific route may beat cached ones */
    return(rtp);
 }
 
@@ -646,9 +649,7 @@ rtdel(struct avl_node * node, long param, int depth)
 
    if(n->ifp == (struct net *)param)
    {
-      /* If the cached route is the one being deleted then clear the cache */
-      if (n == cachedRoute)
-         cachedRoute = NULL;
+      RT_CHANGED();     /* the route may be in the route cache */
       /* delete the entry n. */
 	  n->ipRouteNextHop = 0; /* clear route */
       key = htonl(n->ipRouteDest);     /* pass key in machine endian */
@@ -683,9 +684,7 @@ del_route(ip_addr dest, ip_addr mask, int iface)
    {
       struct avl_node * delnode;    /* node to delete */
 
-       /* If the cached route is the one being deleted then clear the cache */
-      if (cachedRoute->ipRouteDest == dest)
-         cachedRoute = NULL;
+      RT_CHANGED();     /* the route may be in the route cache */
 
       /* call btree route to remove the actual entry */
       delnode = avlv4_access((struct avl_node *)btreeRoot, (ntohl(dest)));
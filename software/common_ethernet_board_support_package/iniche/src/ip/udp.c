@@ -40,6 +40,52 @@ extern int udp_soinput(PACKET pkt, void *so_ptr);
 #endif
 
 
+/* FUNCTION: udp_firstcon()
+ *
+ * Start a walk of the connections that may take a datagram for a
+ * local port: those in the port's hash bucket, then those in the 
+ * bucket of port 0, which holds the connections with no local port.
+ *
+ * PARAM1: unshort lport
+ *
+ * RETURNS: first connection to try, NULL if none
+ */
+
+static UDPCONN
+udp_firstcon(unshort lport)
+{
+   UDPCONN con;
+
+   con = udp_porthash[UDP_PORTHASH(lport)];
+   if (!con && (UDP_PORTHASH(lport) != UDP_PORTHASH(0)))
+      con = udp_porthash[UDP_PORTHASH(0)];
+   return con;
+}
+
+
+/* FUNCTION: udp_nextcon()
+ *
+ * Continue a walk started by udp_firstcon().
+ *
+ * PARAM1: UDPCONN con - connection just tried
+ * PARAM2: unshort lport
+ *
+ * RETURNS: next connection to try, NULL if none
+ */
+
+static UDPCONN
+udp_nextcon(UDPCONN con, unshort lport)
+{
+   unsigned bucket   =  UDP_PORTHASH(con->u_lport);
+
+   if (con->u_hnext)
+      return con->u_hnext;
+   if ((bucket == UDP_PORTHASH(lport)) && (bucket != UDP_PORTHASH(0)))
+      return udp_porthash[UDP_PORTHASH(0)];
+   return NULL;
+}
+
+
 /* FUNCTION: udpdemux()
  *
  * This routine handles incoming UDP packets. They're handed to it by 
@@ -85,8 +131,8 @@ udpdemux(PACKET p)
    }
 
    osum = pup->ud_cksum;
-   /* did other guy use checksumming? */
-   if (osum)
+   /* did other guy use checksumming, and is it left for us to check? */
+   if (osum && !PK_CSUM_OK(p, PKF_L4CSUM_OK))
    {
       if (plen & 1) ((char *)pup)[plen] = 0;
          php.ph_src = p->fhost;
@@ -166,7 +212,8 @@ udpdemux(PACKET p)
 
    /* run through the demux table and try to upcall it */
 
-   for (con = firstudp; con; con = con->u_next)
+   for (con = udp_firstcon(pup->ud_dstp); con; 
+        con = udp_nextcon(con, pup->ud_dstp))
    {
 #ifdef IP_V6
       /* we only want to check UDP-over-IPv4 connections */
@@ -491,15 +538,18 @@ udp_socket(void)
       if (usocket < MINSOCKET)
          usocket += MINSOCKET;
    }
-   /* scan existing connections, making sure socket isn't in use */
-   for (tmp = firstudp; tmp; tmp = tmp->u_next)
+   /* scan connections on the port's hash bucket, making sure socket 
+    * isn't in use */
+   tmp = udp_porthash[UDP_PORTHASH(usocket)];
+   while (tmp)
    {
       if (tmp->u_lport == usocket)
       {
          usocket++;     /* bump socket number */
-         tmp = firstudp;   /* restart scan */
+         tmp = udp_porthash[UDP_PORTHASH(usocket)];   /* restart scan */
          continue;
       }
+      tmp = tmp->u_hnext;
    }
    return usocket++;
 }
@@ -552,6 +552,7 @@ setlossy(void * pio)
 extern   queue    bigfreeq;   /* big free buffers */
 extern   queue    lilfreeq;   /* small free buffers */
 extern   unsigned    lilbufs;
+extern   unsigned    midbufs;
 extern   unsigned    bigbufs;
 
 
@@ -574,6 +575,21 @@ dumpqueues(void * pio)
     (void far *)lilfreeq.q_head, (void far *)lilfreeq.q_tail, 
     lilfreeq.q_len, lilfreeq.q_min, lilfreeq.q_max);
 
+#if PK_NUMMIDCLASSES > 0
+   {
+      int   c;
+      queue *  q;
+
+      for (c = 1; c < PK_CLASSES - 1; c++)
+      {
+         q = pk_classes[c].freeq;
+         ns_printf(pio,"%ufreeq: head:%p, tail:%p, len:%d, min:%d, max:%d\n",
+          pk_classes[c].size, (void far *)q->q_head, (void far *)q->q_tail, 
+          q->q_len, q->q_min, q->q_max);
+      }
+   }
+#endif   /* PK_NUMMIDCLASSES */
+
    ns_printf(pio,"rcvdq: head:%p, tail:%p, len:%d, min:%d, max:%d\n",
     (void far *)rcvdq.q_head, (void far *)rcvdq.q_tail, 
     rcvdq.q_len, rcvdq.q_min, rcvdq.q_max);
@@ -614,7 +630,7 @@ dumpbufs(void * pio)
    }
 
    ns_printf(pio,"PACKET    len  buffer    que data offset %d\n",offset);
-   for (i = 0; i < (int)(lilbufs+bigbufs); i++ )
+   for (i = 0; i < (int)(lilbufs+midbufs+bigbufs); i++ )
    {
       pkt = pktlog[i];
       ns_printf(pio,"%p,%4d,%p,%s:",
@@ -663,6 +679,16 @@ char * qname(PACKET pkt)
    for (tmp = bigfreeq.q_head; tmp; tmp = tmp->qe_next)
       if (tmp == (qp)pkt)
       return "big";
+#if PK_NUMMIDCLASSES > 0
+   {
+      int   c;
+
+      for (c = 1; c < PK_CLASSES - 1; c++)
+         for (tmp = pk_classes[c].freeq->q_head; tmp; tmp = tmp->qe_next)
+            if (tmp == (qp)pkt)
+            return "mid";
+   }
+#endif   /* PK_NUMMIDCLASSES */
    for (tmp = rcvdq.q_head; tmp; tmp = tmp->qe_next)
       if (tmp == (qp)pkt)
       return "rcv";
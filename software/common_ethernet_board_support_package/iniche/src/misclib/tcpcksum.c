@@ -109,6 +109,36 @@ tcp_cksum(struct ip * pip)
    return newsum;
 }
 
+
+
+/* FUNCTION: tcp_pseudo_cksum()
+ *
+ * tcp_pseudo_cksum(struct ip - Like tcp_cksum(), but sums only the 
+ * pseudo header (IP addresses, protocol and TCP length). The result is 
+ * not complemented; it is left in th_sum for a device which offloads 
+ * the TCP checksum (NF_CSUM_TX) to add the TCP header and data to.
+ *
+ * 
+ * PARAM1: struct ip * pip
+ *
+ * RETURNS: pseudo header sum for the th_sum field
+ */
+
+unshort
+tcp_pseudo_cksum(struct ip * pip)
+{
+   u_long   sum;
+   unshort  tcplen;  /* length of TCP header and data */
+
+   tcplen = htons(pip->ip_len) - (unshort)ip_hlen(pip);
+
+   /* cksum() returns the folded one's complement sum of the addresses */
+   sum = (u_long)cksum(&pip->ip_src, 4) + htons(tcplen + 6);
+   sum = (sum & 0xffff) + (sum >> 16);
+
+   return (unshort)sum;
+}
+
 #endif   /* INCLUDE_TCP */
 
 
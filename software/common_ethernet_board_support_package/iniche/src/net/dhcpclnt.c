@@ -90,6 +90,7 @@ static char *dhc_state_str[] =
 #define  DHC_INFINITY   0xffffffff        /* That is, "-1" */
 #define  DHC_MAX_TRIES  4                 /* Max num of retires to tbe done */
 #define  DHC_RETRY_TMO  4                 /* Timeout(secs) for retries */
+#define  DHC_REBOOT_TRIES 1               /* Retries of a remembered address */
 #define  DHCPDATA       ((void*)0xFFFFFFFD)  /* tag for pass to udp_open() */
 
 /* DHCP functions used within this file */
@@ -1141,6 +1142,37 @@ dhc_stats(void *pio)
 #endif   /* NET_STATS */
 
 
+/* FUNCTION: dhc_reuse()
+ *
+ * dhc_reuse() - go to BOUND on the address being reclaimed without an 
+ * ACK, for the lease already in dhc_states[]. Called when INIT-REBOOT 
+ * got no answer at all. The server ID must have been set with the lease 
+ * so the renewal at T1 goes to the server that granted it. 
+ *
+ * PARAM1: int iface
+ *
+ * RETURNS: void
+ */
+
+static void
+dhc_reuse(int iface)
+{
+   if ( dhc_states[iface].lease == DHC_INFINITY )
+   {
+      dhc_states[iface].t1 = DHC_INFINITY ;
+      dhc_states[iface].t2 = DHC_INFINITY ;
+   }
+   else
+   {
+      dhc_states[iface].t1 = dhc_states[iface].lease/2     ;
+      dhc_states[iface].t2 = (dhc_states[iface].lease/8)*7 ;
+   }
+   dhc_states[iface].lease_start = cticks;
+   dhc_setip(iface);
+   dhc_set_state(iface,DHCS_BOUND);
+}
+
+
 /* FUNCTION: dhc_second()
  *
  * dhc_second() - dhcp client timer. system should call this once a 
@@ -1157,6 +1189,7 @@ dhc_second(void)
 {
    int   iface;
    int   tries;
+   int   max_tries;
    int   e;
    u_long   half_time;
 
@@ -1190,10 +1223,12 @@ dhc_second(void)
          /* Discovery timeout = DHC_RETRY_TMO secs * (2 ** retries), max 64 */
 
          tries = dhc_states[iface].tries ;
+         max_tries = (dhc_states[iface].state == DHCS_REBOOTING) ?
+            DHC_REBOOT_TRIES : DHC_MAX_TRIES;
 
          /* Set the exponential count */
-         if ( tries >= DHC_MAX_TRIES) 
-            tries= DHC_MAX_TRIES;
+         if ( tries >= max_tries) 
+            tries= max_tries;
          if ( cticks > (dhc_states[iface].last_tick + 
              (((u_long) (DHC_RETRY_TMO*TPS)) << tries ) ) )
          {
@@ -1214,9 +1249,20 @@ dhc_second(void)
                break;
             }
          }
-         if ( tries == DHC_MAX_TRIES && 
+         if ( tries == max_tries && 
              (dhc_states[iface].state !=DHCS_SELECTING) )
          {
+            /* A server with no record of us stays silent (RFC 2131, 
+             * 4.3.2). If the caller handed a lease over with the 
+             * remembered address, use it for the rest of that lease 
+             * (RFC 2131, 3.2) rather than start over. 
+             */
+            if ((dhc_states[iface].state == DHCS_REBOOTING) &&
+                dhc_states[iface].lease)
+            {
+               dhc_reuse(iface);
+               break;
+            }
             /* We have tried enough. Restart from INIT state */
             dhc_set_state(iface,DHCS_RESTARTING);
             dhc_resetip(iface);
@@ -8,6 +8,7 @@
  * MODULE: INET
  *
  * ROUTINES: pk_init(), pk_alloc(), pk_validate(), pk_free()
+ * ROUTINES: pk_cache_alloc(), pk_cache_fill()
  * ROUTINES: pk_prepend(), pk_gather()
  * ROUTINES: pk_alloc_heapbuf(), pk_validate_heapbuf(), pk_free_heapbuf()
  *
@@ -45,9 +46,11 @@
 #endif
 
 
-/* We maintain 2 queues of free buffers, one for smallish packets
- * like ARPs, TCP acks,and PINGs; and big buffers for large datagrams
- * like FTP transfers.
+/* We maintain a queue of free buffers per size class. The smallest
+ * holds smallish packets like ARPs, TCP acks,and PINGs; the biggest
+ * holds large datagrams like FTP transfers. Any classes configured in
+ * between (PK_MIDCLASSES) catch the medium sized packets which would
+ * otherwise tie up a big buffer once the little ones run out.
  */
 queue   bigfreeq;    /* big free buffers */
 queue   lilfreeq;    /* small free buffers */
@@ -56,6 +59,27 @@ unsigned lilbufs = NUMLILBUFS;      /* number of small bufs to init */
 unsigned lilbufsiz = LILBUFSIZE;    /* big enough for most non-full size packets */
 unsigned bigbufs = NUMBIGBUFS;      /* number of big bufs to init */
 unsigned bigbufsiz = BIGBUFSIZE;    /* big enough for max. ethernet packet */
+unsigned midbufs;                   /* set by pk_init() from PK_MIDCLASSES */
+
+struct pk_class pk_classes[PK_CLASSES];
+
+#if PK_NUMMIDCLASSES > 0
+static unsigned pk_midcfg[PK_NUMMIDCLASSES][2] = { PK_MIDCLASSES };
+static queue    midfreeq[PK_NUMMIDCLASSES];
+#endif
+
+/* pk_alloc() maps a length to the smallest class that fits through
+ * pk_sizemap[], indexed by the length in PK_GRANULE units rounded up.
+ * pk_free() maps nb_blen back to its class the same way, so every class
+ * size but the biggest must be a multiple of PK_GRANULE; pk_setclasses()
+ * refuses any that are not.
+ */
+#ifndef PK_GRANULE
+#define PK_GRANULE   8
+#endif
+#define PK_MAPLEN(len)  (((len) + PK_GRANULE - 1) / PK_GRANULE)
+
+static u_char pk_sizemap[PK_MAPLEN(BIGBUFSIZE) + 1];
 
 #ifdef NPDEBUG
 PACKET pktlog[MAXPACKETS]; /* record where the packets are */
@@ -92,6 +116,13 @@ int dump_hbuf_stats (void * pio);
 /* dump regular (and heap buffer, when HEAPBUFS are defined) error statistics */
 int dump_buf_estats (void * pio);
 
+/* set up the size classes and the length to class map */
+static int pk_setclasses (void);
+/* get the data area for a buffer of a class */
+static char * pk_bufalloc (struct pk_class * pc, unsigned size);
+/* set up a buffer being handed out */
+static PACKET pk_prep (PACKET p);
+
 /* statistics data structure that contains counters for various
  * error conditions encountered when processing "regular" (little
  * and big) and heap buffers (the latter only when HEAPBUFS is defined) */
@@ -103,7 +134,7 @@ u_long memestats [MEMERR_NUM_STATS];
 /* FUNCTION: pk_init()
  *
  * Initialize the free queues for use by pk_alloc() and pk_free() for "regular" 
- * (little and big) buffers.  
+ * (little, in-between and big) buffers, one queue per size class.  
  *
  * This function also initializes heap buffer-related data structures, such
  * as the total amount of heap memory allocated (for use in heap buffers), 
@@ -121,14 +152,15 @@ u_long memestats [MEMERR_NUM_STATS];
  *
  * OUTPUT: Returns 0 if OK; in the event of an error (such as when an allocation
  * for a PACKET buffer or a data buffer fails, or if there is an inconsistency
- * between (bigbufs + lilbufs) and MAXPACKETS) it returns -1. 
+ * between (bigbufs + midbufs + lilbufs) and MAXPACKETS) it returns -1. 
  */
 
 int pk_init (void)
 {
    PACKET packet;
+   struct pk_class * pc;
    unsigned i;
-   unsigned numpkts = bigbufs + lilbufs;
+   unsigned n;
    u_char align_req;
    
 #ifdef ALIGN_BUFS
@@ -137,61 +169,35 @@ int pk_init (void)
    align_req = 0;
 #endif
 
-   for (i = 0; i < numpkts; i++)
-   {
-      packet = (PACKET)NB_ALLOC(sizeof(struct netbuf));
-      if (packet == NULL)
-         goto no_pkt_buf;
+   if (pk_setclasses())
+      return -1;
 
-#ifdef NPDEBUG
-      if (i >= MAXPACKETS)
+   i = 0;
+   for (pc = pk_classes; pc < &pk_classes[PK_CLASSES]; pc++)
+   {
+      for (n = 0; n < pc->count; n++, i++)
       {
-         dprintf("pk_init: bad define\n");
-         return -1;
-      }
-      pktlog[i] = packet;     /* save for debugging */
-#endif
-
-      packet->nb_tstamp = 0L;
+         packet = (PACKET)NB_ALLOC(sizeof(struct netbuf));
+         if (packet == NULL)
+            goto no_pkt_buf;
 
-      if (i < bigbufs)
-      {
 #ifdef NPDEBUG
+         if (i >= MAXPACKETS)
          {
-            int j;
-
-            /* for DEBUG compiles, bracket the data area with special chars */
-            packet->nb_buff = (char *)BB_ALLOC(bigbufsiz+ALIGN_TYPE+1);
-            if (!(packet->nb_buff))
-               goto no_pkt_buf;
-
-            /* Add memory markers for sanity check */
-            for(j = 0; j < ALIGN_TYPE; j++)
-               *(packet->nb_buff + j) = 'M'; /* MMs at start of buf */
-
-            *(packet->nb_buff + bigbufsiz + ALIGN_TYPE) = 'M';
-            packet->nb_buff += ALIGN_TYPE;   /* bump buf past MMs */
+            dprintf("pk_init: bad define\n");
+            return -1;
          }
-#else
-         packet->nb_buff = (char *)BB_ALLOC(bigbufsiz + align_req);
-#ifdef ALIGN_BUFS
-         /* align start of buffer pointer to desired offset */
-         packet->nb_buff += (ALIGN_BUFS - (((u_long) packet->nb_buff) & (ALIGN_BUFS - 1)));
-#endif
+         pktlog[i] = packet;     /* save for debugging */
 #endif
-         if (!(packet->nb_buff))
-            goto no_pkt_buf;
-         packet->nb_blen = bigbufsiz;
-         q_add(&bigfreeq, packet);        /* save it in big pkt free queue */
-      }
-      else     /* get a small buffer */
-      {
+
+         packet->nb_tstamp = 0L;
+
 #ifdef NPDEBUG
          {
             int j;
 
             /* for DEBUG compiles, bracket the data area with special chars */
-            packet->nb_buff = (char *)LB_ALLOC(lilbufsiz+ALIGN_TYPE+1);
+            packet->nb_buff = pk_bufalloc(pc, pc->size+ALIGN_TYPE+1);
             if (!(packet->nb_buff))
                goto no_pkt_buf;
 
@@ -199,11 +205,11 @@ int pk_init (void)
             for(j = 0; j < ALIGN_TYPE; j++)
                *(packet->nb_buff + j) = 'M'; /* MMs at start of buf */
 
-            *(packet->nb_buff + lilbufsiz + ALIGN_TYPE) = 'M';
-            packet->nb_buff += ALIGN_TYPE;
+            *(packet->nb_buff + pc->size + ALIGN_TYPE) = 'M';
+            packet->nb_buff += ALIGN_TYPE;   /* bump buf past MMs */
          }
 #else
-         packet->nb_buff = (char *)LB_ALLOC(lilbufsiz + align_req);
+         packet->nb_buff = pk_bufalloc(pc, pc->size + align_req);
 #ifdef ALIGN_BUFS
          /* align start of buffer pointer to desired offset */
          packet->nb_buff += (ALIGN_BUFS - (((u_long) packet->nb_buff) & (ALIGN_BUFS - 1)));
@@ -211,12 +217,11 @@ int pk_init (void)
 #endif
          if (!(packet->nb_buff))
             goto no_pkt_buf;
-         packet->nb_blen = lilbufsiz;
-         q_add(&lilfreeq, packet);        /* save it in little free queue */
+         packet->nb_blen = pc->size;
+         q_add(pc->freeq, packet);     /* save it in its class's free queue */
       }
+      pc->freeq->q_min = pc->count;
    }
-   bigfreeq.q_min = bigbufs;
-   lilfreeq.q_min = lilbufs;
 
 #ifdef HEAPBUFS
    /* initialize the counters that keep track of the total amount of memory 
@@ -236,13 +241,120 @@ no_pkt_buf:
    return(-1);
 }
 
+/* FUNCTION: pk_setclasses()
+ *
+ * Fill in pk_classes[] from lilbufs/lilbufsiz, PK_MIDCLASSES and
+ * bigbufs/bigbufsiz, and build pk_sizemap[] for pk_alloc(). Called by
+ * pk_init() before any buffers are made.
+ *
+ * INPUT: none
+ *
+ * OUTPUT: 0 if OK, -1 if the class sizes are not in increasing order,
+ * a size below bigbufsiz is not a multiple of PK_GRANULE, or bigbufsiz
+ * does not fit the size map.
+ */
+
+static int pk_setclasses(void)
+{
+   struct pk_class * pc;
+   unsigned len;
+   int c;
+
+   MEMSET(pk_classes, 0, sizeof(pk_classes));
+   pk_classes[0].size = lilbufsiz;
+   pk_classes[0].count = lilbufs;
+   pk_classes[0].freeq = &lilfreeq;
+   midbufs = 0;
+#if PK_NUMMIDCLASSES > 0
+   for (c = 0; c < PK_NUMMIDCLASSES; c++)
+   {
+      pk_classes[c + 1].size = pk_midcfg[c][0];
+      pk_classes[c + 1].count = pk_midcfg[c][1];
+      pk_classes[c + 1].freeq = &midfreeq[c];
+      midbufs += pk_midcfg[c][1];
+   }
+#endif
+   pk_classes[PK_CLASSES - 1].size = bigbufsiz;
+   pk_classes[PK_CLASSES - 1].count = bigbufs;
+   pk_classes[PK_CLASSES - 1].freeq = &bigfreeq;
+
+   for (c = 0; c < PK_CLASSES; c++)
+   {
+      if ((c > 0) && (pk_classes[c].size <= pk_classes[c - 1].size))
+      {
+         dprintf("pk_init: buffer classes out of order\n");
+         return -1;
+      }
+      /* else pk_blenclass() could not find the class from nb_blen */
+      if ((c < PK_CLASSES - 1) && (pk_classes[c].size % PK_GRANULE))
+      {
+         dprintf("pk_init: buffer size %u not a multiple of %u\n",
+            pk_classes[c].size, PK_GRANULE);
+         return -1;
+      }
+#ifdef PK_SRAM_CLASSES
+      pk_classes[c].in_sram = (PK_SRAM_CLASSES >> c) & 1;
+#endif
+   }
+   if (PK_MAPLEN(bigbufsiz) >= sizeof(pk_sizemap))
+   {
+      dprintf("pk_init: bigbufsiz over BIGBUFSIZE\n");
+      return -1;
+   }
+
+   /* each slot takes the smallest class holding its whole granule */
+   pc = pk_classes;
+   for (len = 0; len <= PK_MAPLEN(bigbufsiz); len++)
+   {
+      while (pc->size < len * PK_GRANULE && pc < &pk_classes[PK_CLASSES - 1])
+         pc++;
+      pk_sizemap[len] = (u_char)(pc - pk_classes);
+   }
+
+   return 0;
+}
+
+/* FUNCTION: pk_bufalloc()
+ *
+ * Get the data area for one buffer of a class. Classes placed in SRAM
+ * take from the heap once the SRAM is used up.
+ *
+ * INPUT: (1) Class the buffer is for
+ *        (2) Bytes to allocate
+ *
+ * OUTPUT: Pointer to the data area, or NULL if memory ran out.
+ */
+
+static char * pk_bufalloc(struct pk_class * pc, unsigned size)
+{
+   char * buf;
+
+#ifdef SB_ALLOC
+   if (pc->in_sram)
+   {
+      buf = (char *)SB_ALLOC(size);
+      if (buf)
+         return buf;
+   }
+#endif
+
+   if (pc == pk_classes)
+      buf = (char *)LB_ALLOC(size);
+   else
+      buf = (char *)BB_ALLOC(size);
+   return buf;
+}
+
 /* FUNCTION: pk_alloc ()
  *
  * This function is invoked to allocate memory.  If the requested allocation
  * is greater than bigbufsiz, this function will return 0 if HEAPBUFS is 
  * not defined; however, if HEAPBUFS is defined, it will attempt to allocate
- * a buffer from the heap via pk_alloc_heapbuf ().  After obtaining a regular
- * little or big) or heap buffer that meets the caller's requirements, this
+ * a buffer from the heap via pk_alloc_heapbuf ().  Otherwise the buffer 
+ * comes from the smallest size class that fits, or the next bigger class 
+ * that has one free; the hit, miss and fail counts of the class that fits 
+ * are updated.  After obtaining a regular
+ * (little, in-between or big) or heap buffer that meets the caller's requirements, this
  * function initializes various fields in the struct netbuf structure that 
  * corresponds to the just allocated data buffer.  Note that all struct 
  * netbuf fields are not initialized in this function; the remaining fields 
@@ -258,6 +370,8 @@ no_pkt_buf:
 PACKET pk_alloc(unsigned len)
 {
    PACKET p;
+   struct pk_class * want;
+   struct pk_class * pc;
 
    if (len > bigbufsiz) /* caller wants oversize buffer? */
    {
@@ -270,18 +384,47 @@ PACKET pk_alloc(unsigned len)
    }
    else
    {
-      if ((len > lilbufsiz) || (lilfreeq.q_len == 0)) /* must use a big buffer */
-         p = (PACKET)getq(&bigfreeq);
-      else
-         p = (PACKET)getq(&lilfreeq);
+      want = &pk_classes[pk_sizemap[PK_MAPLEN(len)]];
+      p = NULL;
+      for (pc = want; pc < &pk_classes[PK_CLASSES]; pc++)
+      {
+         if (pc->freeq->q_len == 0)    /* class empty, try a bigger one */
+            continue;
+         if ((p = (PACKET)getq(pc->freeq)) != NULL)
+            break;
+      }
 
+      /* statistics only, so no lock: callers hold FREEQ_RESID */
       if (!p)
+      {
+         want->fails++;
          return NULL;
+      }
+      if (pc == want)
+         want->hits++;
+      else
+         want->misses++;
    }
 
+   return(pk_prep(p));
+}
+
+/* FUNCTION: pk_prep ()
+ *
+ * Set up the struct netbuf fields of a buffer that is being handed out
+ * by pk_alloc () or pk_cache_alloc ().
+ * 
+ * INPUT: Pointer to the struct netbuf structure of the buffer.
+ *
+ * OUTPUT: The same pointer.
+ */
+
+static PACKET pk_prep(PACKET p)
+{
    p->nb_prot = p->nb_buff + MaxLnh;   /* point past biggest mac header */
    p->nb_plen = 0;   /* no protocol data there yet */
    p->net = NULL;
+   p->flags &= ~(PKF_IPCSUM_OK | PKF_L4CSUM_OK);   /* none checked yet */
 
 #ifdef LINKED_PKTS
    p->pk_next = p->pk_prev = NULL;
@@ -320,9 +463,31 @@ PACKET pk_alloc(unsigned len)
  * -1 if the validation failed.
  */
 
+/* FUNCTION: pk_blenclass ()
+ *
+ * Find the size class a regular buffer belongs to from its nb_blen.
+ * 
+ * INPUT: Length of the buffer's data area.
+ *
+ * OUTPUT: Pointer to the class, or NULL if no class has that size.
+ */
+
+static struct pk_class * pk_blenclass(unsigned blen)
+{
+   struct pk_class * pc;
+
+   if (blen > bigbufsiz)
+      return NULL;
+   pc = &pk_classes[pk_sizemap[PK_MAPLEN(blen)]];
+   if (pc->size != blen)
+      return NULL;
+   return pc;
+}
+
 int pk_validate(PACKET pkt)   /* check if pk_free() can free the pkt */
 {
    PACKET   p;
+   struct pk_class * pc;
 #ifdef NPDEBUG
    int      j;
 #endif
@@ -346,39 +511,25 @@ int pk_validate(PACKET pkt)   /* check if pk_free() can free the pkt */
    else  
 #endif /* HEAPBUFS */
    {
-      /* check if the packet is already in a freeq */
-      if (pkt->nb_blen == bigbufsiz)  /* check in bigfreeq */
+      /* check if the packet is already in its class's freeq */
+      pc = pk_blenclass(pkt->nb_blen);
+      if (pc == NULL)
       {
-         ENTER_CRIT_SECTION(&bigfreeq);
-         for (p=(PACKET)bigfreeq.q_head; p; p = p->next)
-            if (p == pkt)
-            {
-               dprintf("pk_free: buffer %p already in bigfreeq\n", pkt);
-               EXIT_CRIT_SECTION(&bigfreeq);
-               INCR_SHARED_VAR (memestats, MULTIPLE_FREE_ERR, 1);
-               return -1;
-            }
-         EXIT_CRIT_SECTION(&bigfreeq);
+         /* log an error */
+         INCR_SHARED_VAR (memestats, BAD_REGULAR_BUF_LEN_ERR, 1);
+         return -1;
       }
-      else if (pkt->nb_blen == lilbufsiz)  /* check in lilfreeq */
-      {
-         ENTER_CRIT_SECTION(&lilfreeq);
-         for (p=(PACKET)lilfreeq.q_head; p; p = p->next)
-            if (p == pkt)
+      ENTER_CRIT_SECTION(pc->freeq);
+      for (p=(PACKET)pc->freeq->q_head; p; p = p->next)
+         if (p == pkt)
          {
-            dprintf("pk_free: buffer %p already in lilfreeq\n", pkt);
-            EXIT_CRIT_SECTION(&lilfreeq);
+            dprintf("pk_free: buffer %p already in %u byte freeq\n", 
+             pkt, pc->size);
+            EXIT_CRIT_SECTION(pc->freeq);
             INCR_SHARED_VAR (memestats, MULTIPLE_FREE_ERR, 1);
             return -1;
          }
-         EXIT_CRIT_SECTION(&lilfreeq);
-      }
-      else
-      {
-         /* log an error */
-         INCR_SHARED_VAR (memestats, BAD_REGULAR_BUF_LEN_ERR, 1);
-         return -1;
-      }
+      EXIT_CRIT_SECTION(pc->freeq);
    }
 
 #ifdef NPDEBUG
@@ -468,10 +619,8 @@ void pk_free(PACKET pkt)   /* PACKET to place in free queue */
       else 
 #endif /* HEAPBUFS */
       {
-         if (pkt->nb_blen == bigbufsiz)
-            q_add(&bigfreeq, (qp)pkt);
-         else if (pkt->nb_blen == lilbufsiz)
-            q_add(&lilfreeq, (qp)pkt);
+         /* pk_validate () has checked nb_blen matches a class */
+         q_add(pk_blenclass(pkt->nb_blen)->freeq, (qp)pkt);
       }
 #ifdef LINKED_PKTS
       pkt = pknext;
@@ -480,6 +629,82 @@ void pk_free(PACKET pkt)   /* PACKET to place in free queue */
 
 }
 
+/* FUNCTION: pk_cache_alloc ()
+ *
+ * Allocate a buffer from a per-context cache.  A cache belongs to one 
+ * context, typically a driver's receive task, and only that context 
+ * touches it, so taking a buffer from it needs no critical section.  
+ * This keeps the per-frame allocation in the receive path from 
+ * disabling interrupts, which getq () on the shared free queues does.  
+ * (The Nios II has no compare-and-swap to build a lock-free free list 
+ * on.)  When the cache holds nothing of the class the length maps to, 
+ * this falls back to pk_alloc ().  Unlike pk_alloc (), the caller must 
+ * not hold FREEQ_RESID; it is taken here for the class statistics and 
+ * the fallback.
+ * 
+ * INPUT: (1) The caller's cache
+ *        (2) Length of requested allocation
+ *
+ * OUTPUT: 0 if the request cannot be satisfied, or a pointer to the struct
+ * netbuf structure that corresponds to the just allocated data buffer.
+ */
+
+PACKET pk_cache_alloc(struct pk_cache * cache, unsigned len)
+{
+   PACKET   p;
+   int      c;
+
+   if (len <= bigbufsiz)
+   {
+      c = pk_sizemap[PK_MAPLEN(len)];
+      if (cache->count[c] > 0)
+      {
+         p = cache->stash[c][--cache->count[c]];
+         LOCK_NET_RESOURCE(FREEQ_RESID);
+         pk_classes[c].hits++;
+         UNLOCK_NET_RESOURCE(FREEQ_RESID);
+         return(pk_prep(p));
+      }
+   }
+
+   LOCK_NET_RESOURCE(FREEQ_RESID);
+   p = pk_alloc(len);
+   UNLOCK_NET_RESOURCE(FREEQ_RESID);
+   return(p);
+}
+
+/* FUNCTION: pk_cache_fill ()
+ *
+ * Top up a per-context cache from the free queues.  Its owner calls this
+ * between bursts of pk_cache_alloc ()s, where the short critical section 
+ * of each getq () does not hold up anything time critical.  The last 
+ * PK_CACHE_DEPTH buffers of a class are left in its free queue for 
+ * everyone else.  Cached buffers count as in use in the class statistics.
+ * 
+ * INPUT: The caller's cache
+ *
+ * OUTPUT: None.
+ */
+
+void pk_cache_fill(struct pk_cache * cache)
+{
+   struct pk_class * pc;
+   PACKET   p;
+   int      c;
+
+   for (c = 0; c < PK_CLASSES; c++)
+   {
+      pc = &pk_classes[c];
+      while ((cache->count[c] < PK_CACHE_DEPTH) && 
+             (pc->freeq->q_len > PK_CACHE_DEPTH))
+      {
+         if ((p = (PACKET)getq(pc->freeq)) == NULL)
+            break;
+         cache->stash[c][cache->count[c]++] = p;
+      }
+   }
+}
+
 #ifdef LINKED_PKTS
 
 PACKET
@@ -992,7 +1217,8 @@ int dump_hbuf_stats (void * pio)
  * and heap buffers onto the system console.  The first three error 
  * counters (bad_regular_buf_len, guard_band_violated, and multiple_-
  * free_err) are for regular buffers only.  The 'inconsistent_location' 
- * field is a counter for both regular and heap buffers.
+ * field is a counter for both regular and heap buffers.  It also prints
+ * the allocation counts and high-water mark of each size class.
  * 
  * INPUT: Pointer to I/O structure for console.
  *
@@ -1002,6 +1228,7 @@ int dump_hbuf_stats (void * pio)
 int dump_buf_estats (void * pio)
 {
    u_long mlocal [MEMERR_NUM_STATS];
+   struct pk_class * pc;
 
    LOCK_NET_RESOURCE(FREEQ_RESID);
    ENTER_CRIT_SECTION(&memestats);
@@ -1013,6 +1240,14 @@ int dump_buf_estats (void * pio)
    ns_printf(pio, "Bad buffer length %lu, Guard band violations %lu\n",mlocal[BAD_REGULAR_BUF_LEN_ERR],mlocal[GUARD_BAND_VIOLATED_ERR]);
    ns_printf(pio, "Multiple frees %lu, Inconsistent location %lu\n",mlocal[MULTIPLE_FREE_ERR],mlocal[INCONSISTENT_LOCATION_ERR]);
 
+   ns_printf(pio, "Buffer classes:\n");
+   for (pc = pk_classes; pc < &pk_classes[PK_CLASSES]; pc++)
+   {
+      ns_printf(pio, "%4u bytes x %2u%s: free %d, most used %u, hits %lu, misses %lu, fails %lu\n",
+       pc->size, pc->count, pc->in_sram ? " (SRAM)" : "", pc->freeq->q_len, 
+       PK_CLASS_HIWAT(pc), pc->hits, pc->misses, pc->fails);
+   }
+
    return 0;
 }
 
@@ -7,7 +7,7 @@
  *
  * MODULE: INET
  *
- * ROUTINES: udp_open(), udp_close(), 
+ * ROUTINES: udp_open(), udp_close(), udp_rehash(), 
  *
  * PORTABLE: yes
  */
@@ -27,6 +27,10 @@
 
 
 UDPCONN firstudp = NULL;
+UDPCONN udp_porthash[UDP_HASHSIZE];    /* connections by local port */
+
+static void udp_hashin(UDPCONN con);
+static void udp_hashout(UDPCONN con);
 
 /* FUNCTION: udp_open()
  *
@@ -113,6 +117,7 @@ UDPCONN udp_open(
    con->u_rcv   = handler;
    con->u_data  = data;
    con->u_flags = UDPCF_V4;
+   udp_hashin(con);
 
    UNLOCK_NET_RESOURCE(NET_RESID);
    return(con);
@@ -165,10 +170,86 @@ udp_close(UDPCONN con)
       lcon->u_next = con->u_next;   /* unlink */
    else
       firstudp = con->u_next; /* remove from head */
+   udp_hashout(con);
 
    UC_FREE(con);  /* free memory for structure */
    UNLOCK_NET_RESOURCE(NET_RESID);
 }
+
+
+/* FUNCTION: udp_rehash()
+ *
+ * udp_rehash(UDPCONN, lport) - change the local port of a connection 
+ * and move it to the matching demux hash bucket. The caller holds 
+ * NET_RESID.
+ *
+ * 
+ * PARAM1: UDPCONN con
+ * PARAM2: unshort lport - new local port (host byte order)
+ *
+ * RETURNS: void
+ */
+
+void
+udp_rehash(UDPCONN con, unshort lport)
+{
+   udp_hashout(con);
+   con->u_lport = lport;
+   udp_hashin(con);
+}
+
+
+/* FUNCTION: udp_hashin()
+ *
+ * Add a connection to the tail of its local port's hash bucket, so
+ * udpdemux() still tries connections on a port in the order they 
+ * were opened.
+ *
+ * 
+ * PARAM1: UDPCONN con
+ *
+ * RETURNS: void
+ */
+
+static void
+udp_hashin(UDPCONN con)
+{
+   UDPCONN * link;
+
+   link = &udp_porthash[UDP_PORTHASH(con->u_lport)];
+   while (*link)
+      link = &(*link)->u_hnext;
+   con->u_hnext = NULL;
+   *link = con;
+}
+
+
+/* FUNCTION: udp_hashout()
+ *
+ * Remove a connection from its local port's hash bucket.
+ *
+ * 
+ * PARAM1: UDPCONN con
+ *
+ * RETURNS: void
+ */
+
+static void
+udp_hashout(UDPCONN con)
+{
+   UDPCONN * link;
+
+   for (link = &udp_porthash[UDP_PORTHASH(con->u_lport)]; *link; 
+        link = &(*link)->u_hnext)
+   {
+      if (*link == con)
+      {
+         *link = con->u_hnext;
+         break;
+      }
+   }
+   con->u_hnext = NULL;
+}
 /* end of file udp_open.c */
 
 
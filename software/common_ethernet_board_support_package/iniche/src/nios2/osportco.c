@@ -410,6 +410,7 @@ post_app_sem(unsigned long semid)
 #ifdef LOCKNET_CHECKING
 
 #include "q.h"       /* InterNiche queue defines */
+#include "netbuf.h"  /* packet buffer size classes */
 
 /* locally define external items involved in checking locks */
 extern queue rcvdq;
@@ -459,6 +460,14 @@ LOCKNET_CHECK(struct queue * q)
       (q != &bigfreeq) &&
       (q != &lilfreeq))
    {
+#if PK_NUMMIDCLASSES > 0
+      int c;
+
+      for (c = 1; c < PK_CLASSES - 1; c++)
+         if (q == pk_classes[c].freeq)
+            break;
+      if (c == PK_CLASSES - 1)
+#endif   /* PK_NUMMIDCLASSES */
       return;
    }
 
@@ -660,6 +660,34 @@ void ncpfree(void *ptr)
 
 #endif /* ALT_INICHE defined */
 
+#ifdef SB_ALLOC
+/*
+ * sramalloc(): carve packet buffers out of the board SRAM, past
+ * whatever the linker placed in its .sram section. Blocks are never
+ * given back, so this is only for buffers made once by pk_init().
+ * Returns NULL once the SRAM is used up.
+ */
+extern char _alt_partition_sram_end[];
+static char * sram_next;
+
+char * sramalloc(unsigned size)
+{
+   char *ptr;
+
+   if(!sram_next)
+      sram_next = _alt_partition_sram_end;
+
+   size = (size + ALIGN_TYPE - 1) & ~(ALIGN_TYPE - 1);
+   if(sram_next + size > (char *)(SRAM_BASE + SRAM_SPAN))
+      return NULL;
+
+   ptr = sram_next;
+   sram_next += size;
+   MEMSET(ptr, 0, size);
+   return ptr;
+}
+#endif /* SB_ALLOC */
+
 #ifdef   USE_PPP
 
 /* FUNCTION: ppp_type_setup(M_PPP)
@@ -8,7 +8,7 @@
  *
  * ROUTINES: in_pcballoc(), in_pcbbind(), ip6_pcbbind(), in_pcbconnect(), 
  * ROUTINES: in_pcbdisconnect(), in_pcbdetach(), in_setsockaddr(), 
- * ROUTINES: in_setpeeraddr(), in_pcblookup(), 
+ * ROUTINES: in_setpeeraddr(), in_pcblookup(), in_pcbrehash(), 
  *
  * PORTABLE: yes
  */
@@ -52,12 +52,23 @@
 
 #ifdef INCLUDE_TCP  /* include/exclude whole file at compile time */
 
-/* 2/9/00 - modified in_pcblookup() put the matched pcb at the head 
- * of the list to speed future searches. The stats below are to gauge 
- * the success of this.
+/* in_pcblookup() finds segments' PCBs through the hash tables below;
+ * only wildcard lookups without a foreign address, as bind does, walk
+ * the whole list. The stats below count the two.
  */
-long     inpcb_cachehits   =  0;
-long     inpcb_cachemiss   =  0;
+long     inpcb_hashlookups =  0;
+long     inpcb_listwalks   =  0;
+
+static struct inpcb *   inp_connhash[INP_HASHSIZE];   /* connected PCBs */
+static struct inpcb *   inp_porthash[INP_HASHSIZE];   /* all other PCBs */
+
+#define  INP_CONNHASH(faddr, fport, lport) \
+   (((unsigned)(faddr) ^ ((unsigned)(faddr) >> 16) ^ (fport) ^ (lport)) & \
+    (INP_HASHSIZE - 1))
+#define  INP_PORTHASH(lport) \
+   (((unsigned)(lport) ^ ((unsigned)(lport) >> 8)) & (INP_HASHSIZE - 1))
+
+static void in_pcbunhash(struct inpcb * inp);
 
 
 /* FUNCTION: in_pcballoc()
@@ -88,6 +99,7 @@ in_pcballoc(struct socket * so,
     */
    inp->inp_pmtu = 512;
    insque(inp, head);
+   in_pcbrehash(inp);
    so->so_pcb = inp;
    return 0;
 }
@@ -107,11 +119,71 @@ in_pcbdetach(struct inpcb * inp)
 
    so->so_pcb = 0;
    sofree(so);
+   in_pcbunhash(inp);
    remque(inp);
    INP_FREE (inp);
 }
 
 
+/* FUNCTION: in_pcbrehash()
+ *
+ * Move a PCB to the hash bucket its current addresses and ports 
+ * belong in. Called after changing inp_faddr, inp_fport or inp_lport.
+ *
+ * PARAM1: struct inpcb *inp
+ *
+ * RETURNS: 
+ */
+
+void
+in_pcbrehash(struct inpcb * inp)
+{
+   struct inpcb ** bucket;
+
+   in_pcbunhash(inp);
+   if (inp->inp_faddr.s_addr != INADDR_ANY)
+   {
+      bucket = &inp_connhash[INP_CONNHASH(inp->inp_faddr.s_addr, 
+         inp->inp_fport, inp->inp_lport)];
+   }
+   else
+      bucket = &inp_porthash[INP_PORTHASH(inp->inp_lport)];
+
+   inp->inp_hnext = *bucket;
+   *bucket = inp;
+   inp->inp_hbucket = bucket;
+}
+
+
+/* FUNCTION: in_pcbunhash()
+ *
+ * Take a PCB out of its hash bucket, if it is in one.
+ *
+ * PARAM1: struct inpcb *inp
+ *
+ * RETURNS: 
+ */
+
+static void
+in_pcbunhash(struct inpcb * inp)
+{
+   struct inpcb ** link;
+
+   if (inp->inp_hbucket == NULL)
+      return;
+   for (link = inp->inp_hbucket; *link; link = &(*link)->inp_hnext)
+   {
+      if (*link == inp)
+      {
+         *link = inp->inp_hnext;
+         break;
+      }
+   }
+   inp->inp_hnext = NULL;
+   inp->inp_hbucket = NULL;
+}
+
+
 
 #ifdef IP_V4   /* The rest of this file are specific to v4 */
 
@@ -186,6 +258,7 @@ noname:
       } while(in_pcblookup(head, 0L, 0, inp->inp_laddr.s_addr, lport, 0));
    }
    inp->inp_lport = lport;
+   in_pcbrehash(inp);
    return (0);
 }
 
@@ -268,6 +341,7 @@ in_pcbconnect(struct inpcb * inp,
    }
    inp->inp_faddr = sin->sin_addr;
    inp->inp_fport = sin->sin_port;
+   in_pcbrehash(inp);
    return 0;
 }
 
@@ -286,6 +360,7 @@ in_pcbdisconnect(struct inpcb * inp)
 
    inp->inp_faddr.s_addr = INADDR_ANY;
    inp->inp_fport = 0;
+   in_pcbrehash(inp);
    if (inp->inp_socket->so_state & SS_NOFDREF)
       in_pcbdetach (inp);
 }
@@ -339,10 +414,79 @@ in_setpeeraddr(
 
 
 
+/* FUNCTION: in_pcbwild()
+ *
+ * Check one PCB against the parameters of an in_pcblookup().
+ *
+ * PARAM1: struct inpcb *inp
+ * PARAM2: u_long faddr
+ * PARAM3: unshort fport
+ * PARAM4: u_long laddr
+ * PARAM5: unshort lport
+ *
+ * RETURNS: -1 if the PCB does not match, else the number of wildcards
+ * (0 to 2) it took to match it.
+ */
+
+static int
+in_pcbwild(struct inpcb * inp, 
+   u_long   faddr, 
+   unshort  fport,
+   u_long   laddr,
+   unshort  lport)
+{
+   int   wildcard;
+
+   if (inp->inp_lport != lport)
+      return -1;
+
+   /* Skip non IPv4 sockets */
+   if(inp->inp_socket->so_domain != AF_INET)
+      return -1;
+
+   wildcard = 0;
+   if (inp->inp_laddr.s_addr != INADDR_ANY) 
+   {
+      if (laddr == INADDR_ANY)
+         wildcard++;
+      else if (inp->inp_laddr.s_addr != laddr)
+         return -1;
+   }
+   else 
+   {
+      if (laddr != INADDR_ANY)
+         wildcard++;
+   }
+   if (inp->inp_faddr.s_addr != INADDR_ANY) 
+   {
+      if (faddr == INADDR_ANY)
+         wildcard++;
+      else if (inp->inp_faddr.s_addr != faddr ||
+          inp->inp_fport != fport)
+      {
+         return -1;
+      }
+   } else 
+   {
+      if (faddr != INADDR_ANY)
+         wildcard++;
+   }
+   return wildcard;
+}
+
+
+
 /* FUNCTION: in_pcblookup()
  *
  * Find a TCP connection in the passed list which matches the
- * parameters passed.
+ * parameters passed. Of several matches the one needing the fewest 
+ * wildcards wins.
+ *
+ * A connected PCB can only match without wildcards if faddr is given,
+ * so that case looks in its (faddr, fport, lport) hash bucket first.
+ * Unconnected PCBs are found in their lport bucket. Only a wildcard
+ * lookup without faddr, which may match PCBs of either kind, walks 
+ * the whole list.
  *
  * PARAM1: struct inpcb *head
  * PARAM2: u_long faddr
@@ -368,72 +512,56 @@ in_pcblookup(struct inpcb * head,
    unshort  lport =  xlport;
    int   matchwild   =  3;
    int   wildcard;
+   int   pass;
 
-   for (inp = head->inp_next; inp != head; inp = inp->inp_next) 
+   if ((faddr == INADDR_ANY) && (flags & INPLOOKUP_WILDCARD))
    {
-      if (inp->inp_lport != lport)
-         continue;
-
-      /* Skip non IPv4 sockets */
-      if(inp->inp_socket->so_domain != AF_INET)
-         continue;
-
-      wildcard = 0;
-      if (inp->inp_laddr.s_addr != INADDR_ANY) 
+      inpcb_listwalks++;
+      for (inp = head->inp_next; inp != head; inp = inp->inp_next) 
       {
-         if (laddr == INADDR_ANY)
-            wildcard++;
-         else if (inp->inp_laddr.s_addr != laddr)
+         wildcard = in_pcbwild(inp, faddr, fport, laddr, lport);
+         if (wildcard < 0)
             continue;
+         if (wildcard < matchwild) 
+         {
+            match = inp;
+            matchwild = wildcard;
+            if (matchwild == 0)
+               break;
+         }
       }
-      else 
+      return (match);
+   }
+
+   inpcb_hashlookups++;
+   for (pass = 0; pass < 2; pass++)
+   {
+      if (pass == 0)
       {
-         if (laddr != INADDR_ANY)
-            wildcard++;
+         if (faddr == INADDR_ANY)
+            continue;   /* can't be a connected PCB */
+         inp = inp_connhash[INP_CONNHASH(faddr, fport, lport)];
       }
-      if (inp->inp_faddr.s_addr != INADDR_ANY) 
+      else
+         inp = inp_porthash[INP_PORTHASH(lport)];
+
+      for ( ; inp; inp = inp->inp_hnext)
       {
-         if (faddr == INADDR_ANY)
-            wildcard++;
-         else if (inp->inp_faddr.s_addr != faddr ||
-             inp->inp_fport != fport)
-         {
+         if (inp->inp_head != head)
+            continue;
+         wildcard = in_pcbwild(inp, faddr, fport, laddr, lport);
+         if (wildcard < 0)
             continue;
+         if (wildcard && (flags & INPLOOKUP_WILDCARD) == 0)
+            continue;
+         if (wildcard < matchwild) 
+         {
+            match = inp;
+            matchwild = wildcard;
+            if (matchwild == 0)
+               return (match);
          }
-      } else 
-      {
-         if (faddr != INADDR_ANY)
-            wildcard++;
       }
-      if (wildcard && (flags & INPLOOKUP_WILDCARD) == 0)
-         continue;
-      if (wildcard < matchwild) 
-      {
-         match = inp;
-         matchwild = wildcard;
-         if (matchwild == 0)
-            break;
-      }
-   }
-   if (match == NULL)
-      return match;
-
-   if (head->inp_next == match)  /* got cache hit? */
-   {
-      inpcb_cachehits++;
-   }
-   else
-   {
-      inpcb_cachemiss++;
-      /* "cache" the match to be first checked next time. */
-      match->inp_next->inp_prev = match->inp_prev; /*unlink match */
-      match->inp_prev->inp_next = match->inp_next;
-
-      /* relink match as head->inp_next */
-      match->inp_next = head->inp_next;
-      head->inp_next = match;
-      match->inp_prev = head;
-      match->inp_next->inp_prev = match;
    }
    return (match);
 }
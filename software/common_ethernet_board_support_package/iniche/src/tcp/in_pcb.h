@@ -77,8 +77,20 @@ struct inpcb
    struct   socket * inp_socket; /* back pointer to socket */
    char *   inp_ppcb;            /* pointer to per-protocol (TCP, UDP) pcb */
    NET      ifp;                 /* interface if connected */
+   struct   inpcb *  inp_hnext;     /* next in its in_pcblookup() hash bucket */
+   struct   inpcb ** inp_hbucket;   /* that bucket, NULL if not hashed */
 };
 
+/* in_pcblookup() keeps IPv4 PCBs in two hash tables: connected ones by
+ * (faddr, fport, lport), listening and unconnected ones by lport. Code
+ * that changes any of those fields calls in_pcbrehash() afterwards.
+ * inp_laddr is not in the key; it changes under a connected PCB when
+ * the interface address does, and is compared within the bucket.
+ */
+#ifndef INP_HASHSIZE
+#define     INP_HASHSIZE      16    /* buckets per table, a power of 2 */
+#endif
+
 #define     INPLOOKUP_WILDCARD   1
 #define     INPLOOKUP_SETLOCAL   2
 
@@ -91,6 +103,7 @@ extern   int   in_pcbbind  __P ((struct inpcb *, struct mbuf *));
 extern   int   in_pcbconnect  __P ((struct inpcb *, struct mbuf *));
 extern   void  in_pcbdisconnect  __P ((struct inpcb *));
 extern   void  in_pcbdetach   __P ((struct inpcb *));
+extern   void  in_pcbrehash   __P ((struct inpcb *));
 extern   void  in_setsockaddr __P ((struct inpcb *, struct mbuf *));
 extern   void  in_setpeeraddr __P ((struct inpcb *, struct mbuf *));
 extern   void  in_losing   __P ((struct inpcb *));
@@ -49,6 +49,7 @@ unshort  select_wait;      /* select wait bits */
 
 
 extern   unsigned lilbufs;
+extern   unsigned midbufs;
 extern   unsigned bigbufs;
 
 extern   int   ip_write(u_char prot, PACKET pkt);
@@ -738,7 +739,7 @@ nptcp_init()
     * this will allow soreceive() to complete and free up the packet 
     * buffers. yes, its kind of an ugly hack and 3 is a wild guess.
     */
-   unsigned bufcount = (lilbufs + bigbufs) * 2 + 3;
+   unsigned bufcount = (lilbufs + midbufs + bigbufs) * 2 + 3;
    struct mbuf *  m; /* scratch mbuf for mfreeq init */
 
    MEMSET(&soq, 0, sizeof(soq));    /* Set socket queue to NULLs */
@@ -806,7 +807,7 @@ tcp_rcv(PACKET pkt)     /* NOTE: pkt has nb_prot pointing to IP header */
    /* verify checksum of received packet */
 
    tcpp = (struct tcphdr *)ip_data(bip);
-   if (tcp_cksum(bip) != tcpp->th_sum)
+   if (!PK_CSUM_OK(pkt, PKF_L4CSUM_OK) && (tcp_cksum(bip) != tcpp->th_sum))
    {
       TCP_MIB_INC(tcpInErrs);    /* keep MIB stats */
       tcpstat.tcps_rcvbadsum++;  /* keep BSD stats */
@@ -991,7 +992,10 @@ ip_output(struct mbuf * data, struct   ip_socopts * so_optsPack) /* mbuf chain w
    if (!(tcpp->th_flags & TH_SYN))
    tcpp->th_flags |= TH_PUSH;     /* force the PSH flag in TCP hdr */
 #endif
-   tcpp->th_sum = tcp_cksum(bip);
+   if (ip_csum_offload(pkt->fhost))
+      tcpp->th_sum = tcp_pseudo_cksum(bip);  /* device sums the rest */
+   else
+      tcpp->th_sum = tcp_cksum(bip);
 
    pkt->nb_prot = (char*)(bip + 1);    /* point past IP header */
    pkt->nb_plen = data->m_len - sizeof(struct ip);
@@ -497,6 +497,7 @@ findpcb:
       }
 
       inp->inp_lport = ti->ti_dport;
+      in_pcbrehash(inp);
       tp = intotcpcb(inp);
       tp->t_state = TCPS_LISTEN;
    }
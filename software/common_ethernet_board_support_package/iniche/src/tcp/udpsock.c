@@ -341,7 +341,7 @@ int udp4_sockbind(struct socket *so, struct mbuf *nam, int req )
         if ((udptmp->u_lport == lport) && (udptmp != udpconn))
           return(EADDRINUSE);
     /* bind the UDP endpoint */
-    udpconn->u_lport = lport;
+    udp_rehash(udpconn, lport);
     udpconn->u_lhost = lhost;
   }
   else /* PRU_CONNECT */
@@ -373,7 +373,7 @@ int udp4_sockbind(struct socket *so, struct mbuf *nam, int req )
       lport = udp_socket();
     /* bind and connect the UDP endpoint */
     udpconn->u_lhost = lhost;
-    udpconn->u_lport = lport;
+    udp_rehash(udpconn, lport);
     udpconn->u_fhost = fhost;
     udpconn->u_fport = fport;
     /* mark the socket as connected */